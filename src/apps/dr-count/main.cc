@@ -5,6 +5,7 @@
 #include <schwa/config.h>
 #include <schwa/dr.h>
 #include <schwa/io/logging.h>
+#include <schwa/io/mmapped_source.h>
 
 #include "processor.h"
 
@@ -18,18 +19,50 @@ using Formatting = schwa::dr_count::Processor::Formatting;
 namespace {
 
 static void
-main(std::istream &input, std::ostream &output, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id) {
+main_serial(std::istream &input, schwa::dr_count::Processor &processor) {
+  // Store counts are available from the document headers alone, so only the headers need to be
+  // read unless expressions are to be evaluated on the documents.
+  if (!processor.requires_decoding()) {
+    dr::DocHeader header;
+    dr::DocHeaderReader reader(input);
+    while (reader >> header)
+      processor.process_header(header);
+    return;
+  }
+
   // Construct a docrep reader over the provided input stream.
   dr::FauxDoc doc;
   dr::FauxDoc::Schema schema;
   dr::Reader reader(input, schema);
 
-  // Construct the document processor.
-  schwa::dr_count::Processor processor(output, all_stores, store, count_bytes, cumulative, per_doc, formatting, doc_id);
-
   // Read the documents off the input stream.
   while (reader >> doc)
     processor(doc);
+}
+
+
+static void
+main_parallel(const std::string &input_path, schwa::dr_count::Processor &processor, const unsigned int nthreads) {
+  // mmap the input and locate each of the documents, using the sidecar index if there is one.
+  io::MMappedSource source(input_path.c_str());
+  dr::DocIndex index;
+  if (!index.load_sidecar(input_path, source.size()))
+    index.build(source.data(), source.size());
+
+  processor.process_docs(source.data(), index, nthreads);
+}
+
+
+static void
+main(std::istream &input, const std::string &input_path, std::ostream &output, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id, const std::string &group_by, const std::string &aggregate, const unsigned int nthreads) {
+  // Construct the document processor.
+  schwa::dr_count::Processor processor(output, all_stores, store, count_bytes, cumulative, per_doc, formatting, doc_id, group_by, aggregate);
+
+  // Only regular files can be mmapped and split up between threads.
+  if (nthreads > 1 && input_path != cf::OpIStream::STDIN_STRING && io::MMappedSource::can_mmap(input_path.c_str()))
+    main_parallel(input_path, processor, nthreads);
+  else
+    main_serial(input, processor);
   processor.finalise();
 }
 
@@ -49,6 +82,9 @@ main(int argc, char **argv) {
   cf::Op<bool> cumulative(cfg, "cumulative", 'c', "Show cumulative counts per doc", false);
   cf::OpChoices<std::string> format(cfg, "format", 'f', "How to format the output data", {"aligned", "tabs"}, "aligned");
   cf::Op<std::string> doc_id(cfg, "doc-id", 'd', "Output this expression before each document instead when outputting per-document counts", cf::Flags::OPTIONAL);
+  cf::Op<std::string> group_by(cfg, "group-by", 'g', "Instead of counting stores, group the documents by the value of this expression and output per-group aggregates", cf::Flags::OPTIONAL);
+  cf::Op<std::string> aggregate(cfg, "aggregate", 'x', "Instead of counting stores, output the sum, min and max of the integer value of this expression per document (e.g. count(doc.tokens, ann.pos == \"NN\"))", cf::Flags::OPTIONAL);
+  cf::Op<unsigned int> nthreads(cfg, "nthreads", 'j', "The number of threads to count with. Only used when the input is a regular file, which is mmapped and split into ranges of documents", 1);
 
   // Parse argv.
   input.position_arg_precedence(0);
@@ -63,7 +99,7 @@ main(int argc, char **argv) {
 
   // Dispatch to main function.
   try {
-    main(input.file(), output.file(), all_stores(), store(), count_bytes(), cumulative(), per_doc(), formatting, doc_id());
+    main(input.file(), input(), output.file(), all_stores(), store(), count_bytes(), cumulative(), per_doc(), formatting, doc_id(), group_by(), aggregate(), nthreads());
   }
   catch (schwa::Exception &e) {
     std::cerr << schwa::print_exception(e) << std::endl;
@@ -2,13 +2,20 @@
 #include "processor.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstddef>
 #include <cstring>
+#include <exception>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
-#include <unordered_map>
+#include <thread>
+#include <vector>
 
 #include <schwa/dr.h>
 #include <schwa/dr/query.h>
@@ -20,6 +27,54 @@ namespace dq = schwa::dr::query;
 namespace schwa {
 namespace dr_count {
 
+// ============================================================================
+// Aggregates
+// ============================================================================
+/**
+ * Running aggregates of the integer value of an expression, grouped by the value of a second
+ * expression. Partial aggregates accumulated over disjoint sets of documents can be combined via
+ * merge, so the work can be split up and the results joined at the end.
+ **/
+class Aggregates {
+public:
+  class Group {
+  public:
+    uint64_t ndocs;
+    uint64_t nvalues;
+    int64_t sum;
+    int64_t min;
+    int64_t max;
+
+    Group(void) : ndocs(0), nvalues(0), sum(0), min(std::numeric_limits<int64_t>::max()), max(std::numeric_limits<int64_t>::min()) { }
+
+    inline void
+    add_value(const int64_t value) {
+      ++nvalues;
+      sum += value;
+      min = std::min(min, value);
+      max = std::max(max, value);
+    }
+
+    inline void
+    merge(const Group &o) {
+      ndocs += o.ndocs;
+      nvalues += o.nvalues;
+      sum += o.sum;
+      min = std::min(min, o.min);
+      max = std::max(max, o.max);
+    }
+  };
+
+  std::map<std::string, Group> groups;
+
+  inline void
+  merge(const Aggregates &o) {
+    for (const auto &pair : o.groups)
+      groups[pair.first].merge(pair.second);
+  }
+};
+
+
 // ============================================================================
 // Processor::Impl
 // ============================================================================
@@ -27,6 +82,9 @@ class Processor::Impl {
 public:
   static const size_t MIN_WIDTH;
   static const size_t NDOCS_WIDTH;
+  static const size_t BATCH_NDOCS;
+
+  class Counter;
 
 private:
   std::ostream &_out;
@@ -37,40 +95,220 @@ private:
   const Formatting _formatting;
   const std::string _store;
   const std::string _doc_id;
+  const std::string _group_by;
+  const std::string _aggregate;
   size_t _doc_id_width;
 
-  uint32_t _ndocs;
-  std::unordered_map<std::string, uint64_t> _counts;
-  std::unordered_map<std::string, uint32_t> _local_counts;
-  std::map<std::string, size_t> _widths;
-
-  dq::Interpreter _interpreter;
+  bool _initialised;
+  uint64_t _ndocs;
+  std::vector<std::string> _columns;
+  std::vector<size_t> _widths;
+  std::vector<uint64_t> _local_counts;
+  std::vector<uint64_t> _running_counts;
+  std::string _local_doc_id;
+  std::unique_ptr<Counter> _counter;
 
-  std::string _get_doc_id(const dr::Doc &doc) const;
   static std::string _int_to_str(const dq::Value &v);
+  static std::string _value_to_str(const dq::Value &v);
+
+  inline bool _is_aggregating(void) const { return !_group_by.empty() || !_aggregate.empty(); }
+  inline bool _has_row_doc_id(void) const { return _per_doc && !_doc_id.empty(); }
+  inline bool _requires_decoding(void) const { return _is_aggregating() || !_doc_id.empty(); }
+  void _finalise_aggregates(void);
+  void _initialise(const dr::Doc &doc);
+  void _initialise_columns(const std::vector<std::string> &store_names);
+  void _write_row(uint64_t ndocs, const std::string &doc_id, const uint64_t *counts);
 
 public:
-  Impl(std::ostream &out, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id) :
-      _out(out),
-      _all_stores(all_stores),
-      _count_bytes(count_bytes),
-      _cumulative(cumulative),
-      _per_doc(per_doc),
-      _formatting(formatting),
-      _store(store),
-      _doc_id(doc_id),
-      _ndocs(0)
-    {
-    if (!_doc_id.empty())
-      _interpreter.compile(_doc_id);
-  }
+  inline bool requires_decoding(void) const { return _requires_decoding(); }
+
+  Impl(std::ostream &out, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id, const std::string &group_by, const std::string &aggregate);
+  ~Impl(void);
 
   void finalise(void);
   void process_doc(const dr::Doc &doc);
+  void process_header(const dr::DocHeader &header);
+  void process_docs(const char *data, const dr::DocIndex &index, unsigned int nthreads);
 };
 
 const size_t Processor::Impl::MIN_WIDTH = 10;
 const size_t Processor::Impl::NDOCS_WIDTH = 10;
+const size_t Processor::Impl::BATCH_NDOCS = 1024;
+
+
+// ============================================================================
+// Processor::Impl::Counter
+// ============================================================================
+/**
+ * The counts and aggregates accumulated over a subset of the documents. Each thread owns its own
+ * Counter, and the partial results are merged once all of the documents have been processed. The
+ * column which each store of a document contributes to is resolved once and reused for as long as
+ * the documents keep the same stores in the same order, avoiding a map lookup per store per doc.
+ **/
+class Processor::Impl::Counter {
+private:
+  const Impl &_impl;
+  dq::Interpreter _doc_id_interpreter;
+  dq::Interpreter _group_by_interpreter;
+  dq::Interpreter _aggregate_interpreter;
+  std::vector<std::string> _store_serials;
+  std::vector<ptrdiff_t> _store_columns;
+
+  template <typename F>
+  void _resolve_columns(size_t nstores, F store_name);
+
+public:
+  Aggregates aggregates;
+  std::vector<uint64_t> totals;
+
+  explicit Counter(const Impl &impl);
+
+  /**
+   * Counts the stores of \p doc, the \p doc_num'th document on the stream. The per-column counts
+   * for the document are written to \p counts, and the value of the doc id expression is written
+   * to \p doc_id if it is not null. When aggregating, the document is added to its group instead.
+   **/
+  void count(const dr::Doc &doc, uint32_t doc_num, uint64_t *counts, std::string *doc_id);
+
+  /**
+   * Counts the stores of a document from its headers alone. Only usable when no expressions need
+   * to be evaluated on the document.
+   **/
+  void count(const dr::DocHeader &header, uint64_t *counts);
+
+  std::string doc_id(const dr::Doc &doc, uint32_t doc_num);
+  void merge(const Counter &o);
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(Counter);
+};
+
+
+Processor::Impl::Counter::Counter(const Impl &impl) : _impl(impl), totals(impl._columns.size(), 0) {
+  if (!_impl._doc_id.empty())
+    _doc_id_interpreter.compile(_impl._doc_id);
+  if (!_impl._group_by.empty())
+    _group_by_interpreter.compile(_impl._group_by);
+  if (!_impl._aggregate.empty())
+    _aggregate_interpreter.compile(_impl._aggregate);
+}
+
+
+template <typename F>
+void
+Processor::Impl::Counter::_resolve_columns(const size_t nstores, F store_name) {
+  bool same = nstores == _store_serials.size();
+  for (size_t i = 0; same && i != nstores; ++i)
+    same = store_name(i) == _store_serials[i];
+  if (same)
+    return;
+
+  const auto &columns = _impl._columns;
+  _store_serials.clear();
+  _store_columns.clear();
+  for (size_t i = 0; i != nstores; ++i) {
+    const std::string &serial = store_name(i);
+    const auto it = std::lower_bound(columns.begin(), columns.end(), serial);
+    _store_serials.push_back(serial);
+    _store_columns.push_back((it != columns.end() && *it == serial) ? it - columns.begin() : -1);
+  }
+}
+
+
+void
+Processor::Impl::Counter::count(const dr::Doc &doc, const uint32_t doc_num, uint64_t *const counts, std::string *const doc_id) {
+  if (_impl._is_aggregating()) {
+    // Find the group the document belongs to.
+    std::string key;
+    if (!_impl._group_by.empty())
+      key = _value_to_str(_group_by_interpreter(doc, doc_num));
+    Aggregates::Group &group = aggregates.groups[key];
+    ++group.ndocs;
+
+    // Accumulate the value of the aggregate expression for the document.
+    if (!_impl._aggregate.empty()) {
+      const dq::Value v = _aggregate_interpreter(doc, doc_num);
+      if (v.type == dq::TYPE_INTEGER)
+        group.add_value(v.via._int);
+      else if (v.type != dq::TYPE_MISSING) {
+        std::ostringstream msg;
+        msg << "The aggregate expression must evaluate to an integer but found " << dq::valuetype_name(v.type);
+        throw dq::RuntimeError(msg.str());
+      }
+    }
+    return;
+  }
+
+  // Add the counts of each of the output stores to the totals.
+  const dr::RTSchema &schema = *(doc.rt()->doc);
+  _resolve_columns(schema.stores.size(), [&](const size_t i) -> const std::string & { return schema.stores[i]->serial; });
+  std::fill(counts, counts + totals.size(), 0);
+  for (size_t i = 0; i != schema.stores.size(); ++i) {
+    const ptrdiff_t column = _store_columns[i];
+    if (column != -1) {
+      const dr::RTStoreDef &store = *schema.stores[i];
+      const uint64_t count = _impl._count_bytes ? store.lazy_nbytes : store.lazy_nelem;
+      counts[column] = count;
+      totals[column] += count;
+    }
+  }
+
+  if (doc_id != nullptr)
+    *doc_id = this->doc_id(doc, doc_num);
+}
+
+
+void
+Processor::Impl::Counter::count(const dr::DocHeader &header, uint64_t *const counts) {
+  _resolve_columns(header.stores.size(), [&](const size_t i) -> const std::string & { return header.stores[i].name; });
+  std::fill(counts, counts + totals.size(), 0);
+  for (size_t i = 0; i != header.stores.size(); ++i) {
+    const ptrdiff_t column = _store_columns[i];
+    if (column != -1) {
+      const dr::DocHeader::Store &store = header.stores[i];
+      const uint64_t count = _impl._count_bytes ? store.nbytes : store.nelem;
+      counts[column] = count;
+      totals[column] += count;
+    }
+  }
+}
+
+
+std::string
+Processor::Impl::Counter::doc_id(const dr::Doc &doc, const uint32_t doc_num) {
+  return _value_to_str(_doc_id_interpreter(doc, doc_num));
+}
+
+
+void
+Processor::Impl::Counter::merge(const Counter &o) {
+  aggregates.merge(o.aggregates);
+  for (size_t i = 0; i != totals.size(); ++i)
+    totals[i] += o.totals[i];
+}
+
+
+// ============================================================================
+// Processor::Impl
+// ============================================================================
+Processor::Impl::Impl(std::ostream &out, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id, const std::string &group_by, const std::string &aggregate) :
+    _out(out),
+    _all_stores(all_stores),
+    _count_bytes(count_bytes),
+    _cumulative(cumulative),
+    _per_doc(per_doc),
+    _formatting(formatting),
+    _store(store),
+    _doc_id(doc_id),
+    _group_by(group_by),
+    _aggregate(aggregate),
+    _doc_id_width(MIN_WIDTH),
+    _initialised(false),
+    _ndocs(0),
+    _counter(new Counter(*this))
+  { }
+
+Processor::Impl::~Impl(void) { }
 
 
 std::string
@@ -82,8 +320,7 @@ Processor::Impl::_int_to_str(const dq::Value &v) {
 
 
 std::string
-Processor::Impl::_get_doc_id(const dr::Doc &doc) const {
-  const dq::Value v = _interpreter(doc, _ndocs - 1);
+Processor::Impl::_value_to_str(const dq::Value &v) {
   switch (v.type) {
   case dq::TYPE_STRING: return v.via._str;
   case dq::TYPE_INTEGER: return _int_to_str(v);
@@ -93,93 +330,301 @@ Processor::Impl::_get_doc_id(const dr::Doc &doc) const {
 
 
 void
-Processor::Impl::process_doc(const dr::Doc &doc) {
-  const dr::RTManager &rt = *(doc.rt());
-  const dr::RTSchema &schema = *(rt.doc);
-
-  // Initialise state.
-  if (_ndocs == 0) {
-    if (!_doc_id.empty())
-      _doc_id_width = std::max(MIN_WIDTH, _get_doc_id(doc).size());
-
-    if (_all_stores || !_store.empty()) {
-      // Calculate the widths per column.
-      for (auto &store : schema.stores) {
-        bool keep = true;
-        if (!_store.empty())
-          keep = store->serial == _store;
-        if (keep)
-          _widths[store->serial] = std::max(MIN_WIDTH, store->serial.size());
+Processor::Impl::_finalise_aggregates(void) {
+  const bool has_values = !_aggregate.empty();
+  size_t key_width = MIN_WIDTH;
+  for (const auto &pair : _counter->aggregates.groups)
+    key_width = std::max(key_width, pair.first.size());
+
+  // Output the column headings.
+  static const char *const VALUE_HEADINGS[] = {"sum", "min", "max"};
+  if (_formatting == Formatting::ALIGNED) {
+    if (!_group_by.empty())
+      _out << std::setw(key_width) << "group" << ' ';
+    _out << std::setw(NDOCS_WIDTH) << "ndocs";
+    if (has_values)
+      for (const char *heading : VALUE_HEADINGS)
+        _out << ' ' << std::setw(MIN_WIDTH) << heading;
+  }
+  else {
+    if (!_group_by.empty())
+      _out << "group\t";
+    _out << "ndocs";
+    if (has_values)
+      for (const char *heading : VALUE_HEADINGS)
+        _out << '\t' << heading;
+  }
+  _out << std::endl;
+
+  // Output the aggregates per group. Groups without any values have no min or max.
+  for (const auto &pair : _counter->aggregates.groups) {
+    const Aggregates::Group &group = pair.second;
+    const bool has_extrema = group.nvalues != 0;
+    if (_formatting == Formatting::ALIGNED) {
+      if (!_group_by.empty())
+        _out << std::setw(key_width) << pair.first << ' ';
+      _out << std::setw(NDOCS_WIDTH) << group.ndocs;
+      if (has_values) {
+        _out << ' ' << std::setw(MIN_WIDTH) << group.sum;
+        if (has_extrema)
+          _out << ' ' << std::setw(MIN_WIDTH) << group.min << ' ' << std::setw(MIN_WIDTH) << group.max;
+        else
+          _out << ' ' << std::setw(MIN_WIDTH) << '-' << ' ' << std::setw(MIN_WIDTH) << '-';
+      }
+    }
+    else {
+      if (!_group_by.empty())
+        _out << pair.first << '\t';
+      _out << group.ndocs;
+      if (has_values) {
+        _out << '\t' << group.sum;
+        if (has_extrema)
+          _out << '\t' << group.min << '\t' << group.max;
+        else
+          _out << "\t-\t-";
       }
     }
+    _out << std::endl;
+  }
+}
+
+
+void
+Processor::Impl::_initialise(const dr::Doc &doc) {
+  if (!_doc_id.empty())
+    _doc_id_width = std::max(MIN_WIDTH, _counter->doc_id(doc, 0).size());
+
+  std::vector<std::string> store_names;
+  for (auto &store : doc.rt()->doc->stores)
+    store_names.push_back(store->serial);
+  _initialise_columns(store_names);
+}
+
+
+void
+Processor::Impl::_initialise_columns(const std::vector<std::string> &store_names) {
+  _initialised = true;
+
+  // Calculate the output columns and their widths.
+  if (_all_stores || !_store.empty()) {
+    for (const std::string &name : store_names)
+      if (_store.empty() || name == _store)
+        _columns.push_back(name);
+    std::sort(_columns.begin(), _columns.end());
+    _columns.erase(std::unique(_columns.begin(), _columns.end()), _columns.end());
+    for (const std::string &column : _columns)
+      _widths.push_back(std::max(MIN_WIDTH, column.size()));
   }
+  _local_counts.assign(_columns.size(), 0);
+  _running_counts.assign(_columns.size(), 0);
+  _counter->totals.assign(_columns.size(), 0);
 
   // Output the column headings.
-  if (_ndocs == 0 && !_widths.empty()) {
+  if (!_columns.empty()) {
     if (_formatting == Formatting::ALIGNED) {
       if (!_doc_id.empty())
         _out << std::setw(_doc_id_width) << "doc-id ";
       _out << std::setw(NDOCS_WIDTH) << "ndocs";
-      for (auto &pair : _widths)
-        _out << ' ' << std::setw(pair.second) << pair.first;
+      for (size_t i = 0; i != _columns.size(); ++i)
+        _out << ' ' << std::setw(_widths[i]) << _columns[i];
       _out << std::endl;
     }
     else {
       if (!_doc_id.empty())
         _out << "doc-id\t";
       _out << "ndocs";
-      for (auto &pair : _widths)
-        _out << '\t' << pair.first;
+      for (const std::string &column : _columns)
+        _out << '\t' << column;
       _out << std::endl;
     }
   }
+}
 
-  // Increment the number of docs processed.
-  ++_ndocs;
 
-  // Output the doc_id if per doc.
-  if (_per_doc && !_doc_id.empty()) {
-    const std::string doc_id = _get_doc_id(doc);
+void
+Processor::Impl::_write_row(const uint64_t ndocs, const std::string &doc_id, const uint64_t *const counts) {
+  // Output the doc_id.
+  if (!_doc_id.empty()) {
     if (_formatting == Formatting::ALIGNED)
       _out << std::setw(_doc_id_width) << doc_id << ' ';
     else
       _out << doc_id << '\t';
   }
 
-  // Output the document count if per_doc.
-  if (_per_doc && !_widths.empty()) {
-    const uint32_t count = _cumulative ? _ndocs : 1;
+  // Output the document count.
+  if (!_columns.empty()) {
+    const uint64_t count = _cumulative ? ndocs : 1;
     if (_formatting == Formatting::ALIGNED)
       _out << std::setw(NDOCS_WIDTH) << count;
     else
       _out << count;
   }
 
-  // For each store, add its counts to the stream counts.
-  _local_counts.clear();
-  for (auto &store : schema.stores) {
-    const uint32_t count = _count_bytes ? store->lazy_nbytes : store->lazy_nelem;
-    _counts[store->serial] += count;
-    _local_counts[store->serial] = count;
+  // Output the counts per store.
+  for (size_t i = 0; i != _columns.size(); ++i) {
+    _running_counts[i] += counts[i];
+    const uint64_t count = _cumulative ? _running_counts[i] : counts[i];
+    if (_formatting == Formatting::ALIGNED)
+      _out << ' ' << std::setw(_widths[i]) << count;
+    else
+      _out << '\t' << count;
   }
+  _out << '\n';
+}
 
-  // Output the counts per store.
-  if (_per_doc && !_widths.empty()) {
-    for (auto &pair : _widths) {
-      const uint64_t count = _cumulative ? _counts[pair.first] : _local_counts[pair.first];
-      if (_formatting == Formatting::ALIGNED)
-        _out << ' ' << std::setw(pair.second) << count;
-      else
-        _out << '\t' << count;
-    }
+
+void
+Processor::Impl::process_doc(const dr::Doc &doc) {
+  if (!_is_aggregating() && !_initialised)
+    _initialise(doc);
+
+  _counter->count(doc, _ndocs, _local_counts.data(), _has_row_doc_id() ? &_local_doc_id : nullptr);
+  ++_ndocs;
+  if (_per_doc && !_is_aggregating())
+    _write_row(_ndocs, _local_doc_id, _local_counts.data());
+}
+
+
+void
+Processor::Impl::process_header(const dr::DocHeader &header) {
+  if (!_initialised) {
+    std::vector<std::string> store_names;
+    for (auto &store : header.stores)
+      store_names.push_back(store.name);
+    _initialise_columns(store_names);
   }
+
+  _counter->count(header, _local_counts.data());
+  ++_ndocs;
   if (_per_doc)
-    _out << std::endl;
+    _write_row(_ndocs, _local_doc_id, _local_counts.data());
+}
+
+
+void
+Processor::Impl::process_docs(const char *const data, const dr::DocIndex &index, const unsigned int nthreads) {
+  const size_t ndocs = index.ndocs();
+  if (ndocs == 0)
+    return;
+
+  // The output columns are decided by the first document.
+  if (!_is_aggregating() && !_initialised) {
+    if (_requires_decoding()) {
+      dr::FauxDoc doc;
+      dr::FauxDoc::Schema schema;
+      dr::Reader reader(schema);
+      reader.read(doc, data + index.offset(0), index.nbytes(0));
+      _initialise(doc);
+    }
+    else {
+      dr::DocHeader header;
+      dr::read_doc_header(data + index.offset(0), index.nbytes(0), header);
+      std::vector<std::string> store_names;
+      for (auto &store : header.stores)
+        store_names.push_back(store.name);
+      _initialise_columns(store_names);
+    }
+  }
+
+  // The documents are split into fixed-size batches which the threads claim in order. Per-doc
+  // output is written by the thread holding the next batch in sequence, so the output is in
+  // document order and at most one batch per thread is ever waiting to be written out.
+  const uint64_t first_doc_num = _ndocs;
+  const size_t nbatches = (ndocs + BATCH_NDOCS - 1) / BATCH_NDOCS;
+  const size_t ncolumns = _columns.size();
+  const bool write_rows = _per_doc && !_is_aggregating();
+  size_t next_batch = 0, next_to_write = 0;
+  bool failed = false;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  const auto work = [&](void) {
+    Counter counter(*this);
+    counter.totals.assign(ncolumns, 0);
+    dr::FauxDoc doc;
+    dr::FauxDoc::Schema schema;
+    dr::Reader reader(schema);
+    dr::DocHeader header;
+    std::vector<uint64_t> counts(BATCH_NDOCS*ncolumns);
+    std::vector<std::string> doc_ids(_has_row_doc_id() ? BATCH_NDOCS : 0);
+
+    try {
+      while (true) {
+        // Claim the next batch of documents.
+        size_t batch;
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (failed || next_batch == nbatches)
+            break;
+          batch = next_batch++;
+        }
+
+        // Count the documents in the batch.
+        const size_t begin = batch*BATCH_NDOCS;
+        const size_t end = std::min(begin + BATCH_NDOCS, ndocs);
+        for (size_t d = begin; d != end; ++d) {
+          uint64_t *const doc_counts = counts.data() + (d - begin)*ncolumns;
+          if (_requires_decoding()) {
+            reader.read(doc, data + index.offset(d), index.nbytes(d));
+            counter.count(doc, first_doc_num + d, doc_counts, doc_ids.empty() ? nullptr : &doc_ids[d - begin]);
+          }
+          else if (dr::read_doc_header(data + index.offset(d), index.nbytes(d), header) != 0)
+            counter.count(header, doc_counts);
+          else
+            throw dr::ReaderException("Failed to read the headers of a document");
+        }
+
+        // Write out the per-doc rows once all of the preceding batches have been written.
+        if (write_rows) {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&](void) { return failed || next_to_write == batch; });
+          if (failed)
+            break;
+          lock.unlock();
+          for (size_t d = begin; d != end; ++d)
+            _write_row(first_doc_num + d + 1, doc_ids.empty() ? _local_doc_id : doc_ids[d - begin], counts.data() + (d - begin)*ncolumns);
+          lock.lock();
+          ++next_to_write;
+          cv.notify_all();
+        }
+      }
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!failed) {
+        error = std::current_exception();
+        failed = true;
+      }
+      cv.notify_all();
+      return;
+    }
+
+    // Merge the partial counts.
+    std::lock_guard<std::mutex> lock(mutex);
+    _counter->merge(counter);
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i != std::max(1u, nthreads); ++i)
+    threads.push_back(std::thread(work));
+  for (auto &thread : threads)
+    thread.join();
+  if (error)
+    std::rethrow_exception(error);
+
+  _ndocs += ndocs;
 }
 
 
 void
 Processor::Impl::finalise(void) {
+  if (_is_aggregating()) {
+    _finalise_aggregates();
+    return;
+  }
+  _out.flush();
+
   // Output the doc_id.
   if (!_doc_id.empty()) {
     if (_formatting == Formatting::ALIGNED)
@@ -200,10 +645,10 @@ Processor::Impl::finalise(void) {
 
   // Output the counts per store.
   if (_all_stores) {
-    for (auto &pair : _widths) {
-      const uint64_t count = _counts[pair.first];
+    for (size_t i = 0; i != _columns.size(); ++i) {
+      const uint64_t count = _counter->totals[i];
       if (_formatting == Formatting::ALIGNED)
-        _out << ' ' << std::setw(pair.second) << count;
+        _out << ' ' << std::setw(_widths[i]) << count;
       else
         _out << '\t' << count;
     }
@@ -215,7 +660,7 @@ Processor::Impl::finalise(void) {
 // ============================================================================
 // Processor
 // ============================================================================
-Processor::Processor(std::ostream &out, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id) : _impl(new Processor::Impl(out, all_stores, store, count_bytes, cumulative, per_doc, formatting, doc_id)) { }
+Processor::Processor(std::ostream &out, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id, const std::string &group_by, const std::string &aggregate) : _impl(new Processor::Impl(out, all_stores, store, count_bytes, cumulative, per_doc, formatting, doc_id, group_by, aggregate)) { }
 
 Processor::~Processor(void) {
   delete _impl;
@@ -226,6 +671,21 @@ Processor::process_doc(const dr::Doc &doc) {
   _impl->process_doc(doc);
 }
 
+void
+Processor::process_header(const dr::DocHeader &header) {
+  _impl->process_header(header);
+}
+
+bool
+Processor::requires_decoding(void) const {
+  return _impl->requires_decoding();
+}
+
+void
+Processor::process_docs(const char *const data, const dr::DocIndex &index, const unsigned int nthreads) {
+  _impl->process_docs(data, index, nthreads);
+}
+
 void
 Processor::finalise(void) {
   _impl->finalise();
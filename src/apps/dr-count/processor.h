@@ -10,6 +10,8 @@
 namespace schwa {
   namespace dr {
     class Doc;
+    class DocHeader;
+    class DocIndex;
   }
 
   namespace dr_count {
@@ -26,12 +28,27 @@ namespace schwa {
       Impl *_impl;
 
     public:
-      Processor(std::ostream &out, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id);
+      Processor(std::ostream &out, bool all_stores, const std::string &store, bool count_bytes, bool cumulative, bool per_doc, Formatting formatting, const std::string &doc_id, const std::string &group_by, const std::string &aggregate);
       ~Processor(void);
 
       void finalise(void);
       void process_doc(const dr::Doc &doc);
 
+      /**
+       * Processes a document using only the information in its headers. This can only be used
+       * when \ref requires_decoding is false, which is the case when no expressions need to be
+       * evaluated on the documents.
+       **/
+      void process_header(const dr::DocHeader &header);
+      bool requires_decoding(void) const;
+
+      /**
+       * Processes each of the documents listed in \p index, whose bytes are found in \p data (such
+       * as an mmapped docrep file), using \p nthreads threads. Each thread counts into its own
+       * partial counts which are merged at the end. Per-doc output is written in document order.
+       **/
+      void process_docs(const char *data, const dr::DocIndex &index, unsigned int nthreads);
+
       inline void operator ()(const dr::Doc &doc) { process_doc(doc); }
 
     private:
@@ -0,0 +1,444 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <schwa/config.h>
+#include <schwa/dr.h>
+#include <schwa/dr/query.h>
+#include <schwa/io/logging.h>
+#include <schwa/utils/hash.h>
+
+namespace cf = schwa::config;
+namespace dq = schwa::dr::query;
+namespace dr = schwa::dr;
+namespace io = schwa::io;
+
+
+namespace {
+
+/**
+ * Set of 64-bit hashes using open addressing with linear probing, which takes 8 bytes per slot
+ * rather than the tens of bytes per element of a node-based std::unordered_set. The table doubles
+ * in size once it is half full. 0 marks an empty slot, so a hash of 0 is stored as 1.
+ **/
+class HashSet {
+public:
+  static constexpr const size_t INITIAL_NSLOTS = 1 << 16;
+
+private:
+  std::vector<uint64_t> _slots;
+  size_t _size;
+
+  void
+  _grow(void) {
+    std::vector<uint64_t> old(_slots.size() * 2, 0);
+    std::swap(old, _slots);
+    _size = 0;
+    for (const uint64_t hash : old)
+      if (hash != 0)
+        insert(hash);
+  }
+
+public:
+  HashSet(void) : _slots(INITIAL_NSLOTS, 0), _size(0) { }
+
+  /** Inserts \p hash into the set, returning whether or not it was not already present. */
+  bool
+  insert(uint64_t hash) {
+    if (hash == 0)
+      hash = 1;
+    const size_t mask = _slots.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+      if (_slots[i] == hash)
+        return false;
+      else if (_slots[i] == 0) {
+        _slots[i] = hash;
+        if (2*(++_size) > _slots.size())
+          _grow();
+        return true;
+      }
+    }
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(HashSet);
+};
+
+
+/**
+ * Bloom filter over 64-bit hashes, for when there are too many documents to remember all of their
+ * hashes. The bit positions are derived from the hash by double hashing. A false positive causes a
+ * unique document to be dropped as a duplicate, at a rate which depends on the size of the filter
+ * relative to the number of distinct documents.
+ **/
+class BloomFilter {
+private:
+  std::vector<uint64_t> _words;
+  const uint64_t _nbits;
+  const unsigned int _nhashes;
+
+public:
+  BloomFilter(const uint64_t nbytes, const unsigned int nhashes) : _words((nbytes + 7) / 8, 0), _nbits(64 * _words.size()), _nhashes(nhashes) { }
+
+  /** Inserts \p hash into the filter, returning whether or not it was not already present. */
+  bool
+  insert(const uint64_t hash) {
+    const uint64_t step = (hash * 0x9e3779b97f4a7c15ULL) | 1;
+    bool inserted = false;
+    for (unsigned int i = 0; i != _nhashes; ++i) {
+      const uint64_t bit = (hash + i*step) % _nbits;
+      uint64_t &word = _words[bit >> 6];
+      const uint64_t mask = static_cast<uint64_t>(1) << (bit & 63);
+      if ((word & mask) == 0) {
+        word |= mask;
+        inserted = true;
+      }
+    }
+    return inserted;
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(BloomFilter);
+};
+
+
+/**
+ * Remembers the hashes of the documents seen so far, either exactly in a HashSet or approximately
+ * in a BloomFilter.
+ **/
+class Seen {
+private:
+  std::unique_ptr<HashSet> _set;
+  std::unique_ptr<BloomFilter> _bloom;
+
+public:
+  Seen(const uint64_t bloom_nbytes, const unsigned int bloom_nhashes) {
+    if (bloom_nbytes == 0)
+      _set.reset(new HashSet());
+    else
+      _bloom.reset(new BloomFilter(bloom_nbytes, bloom_nhashes));
+  }
+
+  inline bool insert(const uint64_t hash) { return _set ? _set->insert(hash) : _bloom->insert(hash); }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(Seen);
+};
+
+
+/**
+ * Hashes framed documents, either their raw bytes or the value of a key expression. Each thread
+ * needs its own, as the reader and the interpreter hold state for the document being evaluated.
+ **/
+class Hasher {
+private:
+  const bool _has_key;
+  dr::FauxDoc _doc;
+  dr::FauxDoc::Schema _schema;
+  dr::Reader _reader;
+  dq::Interpreter _interpreter;
+
+public:
+  explicit Hasher(const std::string &key) : _has_key(!key.empty()), _reader(_schema) {
+    if (_has_key)
+      _interpreter.compile(key);
+  }
+
+  /**
+   * Hashes the document in \p frame into \p hash. Returns false if the document has no value for
+   * the key expression, in which case it cannot be a duplicate.
+   **/
+  bool
+  operator ()(const std::string &frame, const uint32_t doc_num, uint64_t &hash) {
+    if (!_has_key) {
+      hash = schwa::murmur64a(frame.data(), frame.size());
+      return true;
+    }
+
+    _reader.read(_doc, frame.data(), frame.size());
+    const dq::Value v = _interpreter(_doc, doc_num);
+    switch (v.type) {
+    case dq::TYPE_MISSING:
+      return false;
+    case dq::TYPE_INTEGER:
+      hash = schwa::murmur64a(&v.via._int, sizeof(v.via._int));
+      return true;
+    case dq::TYPE_STRING:
+      hash = schwa::murmur64a(v.via._str, std::strlen(v.via._str));
+      return true;
+    default:
+      std::ostringstream msg;
+      msg << "The key expression must evaluate to a string or an integer but found " << dq::valuetype_name(v.type);
+      throw dq::RuntimeError(msg.str());
+    }
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(Hasher);
+};
+
+
+static void
+main_serial(std::istream &input, std::ostream &output, Seen &seen, const std::string &key) {
+  Hasher hasher(key);
+  std::string frame;
+  uint64_t hash;
+  uint32_t nkept = 0, i = 0;
+  for ( ; dr::read_lazy_doc(input, frame); ++i) {
+    if (hasher(frame, i, hash) && !seen.insert(hash))
+      continue;
+    output.write(frame.data(), frame.size());
+    ++nkept;
+  }
+  LOG(DEBUG) << "Kept " << nkept << " of " << i << " documents" << std::endl;
+}
+
+
+/**
+ * A group of framed documents read off the input stream which is hashed as a unit by one of the
+ * worker threads. Batches are recycled so that the frame buffers are reused.
+ **/
+class Batch {
+public:
+  static constexpr const size_t MAX_NFRAMES = 256;
+
+  uint64_t seq;
+  uint32_t first_doc_num;
+  size_t nframes;
+  std::vector<std::string> frames;
+  std::vector<uint64_t> hashes;
+  std::vector<bool> has_hash;
+
+  Batch(void) : seq(0), first_doc_num(0), nframes(0), frames(MAX_NFRAMES), hashes(MAX_NFRAMES), has_hash(MAX_NFRAMES) { }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(Batch);
+};
+
+
+/**
+ * Frames documents off the input stream on the calling thread and hashes the batches of frames on
+ * a set of worker threads. Checking the hashes against the documents seen so far and writing out
+ * the first occurrences happens for one batch at a time, in input order, so the output is the same
+ * as when deduplicating serially.
+ **/
+class ParallelDedup {
+private:
+  std::istream &_input;
+  std::ostream &_output;
+  Seen &_seen;
+  const std::string &_key;
+  const unsigned int _nthreads;
+
+  std::vector<std::unique_ptr<Batch>> _batches;
+  std::deque<Batch *> _todo;
+  std::vector<Batch *> _free;
+  uint64_t _next_to_write;
+  uint64_t _nread;
+  uint64_t _nkept;
+  bool _done_reading;
+  bool _failed;
+  std::exception_ptr _error;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+
+  void
+  _fail(void) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_failed) {
+      _error = std::current_exception();
+      _failed = true;
+    }
+    _cv.notify_all();
+  }
+
+  void
+  _read(void) {
+    uint32_t doc_num = 0;
+    for (uint64_t seq = 0; ; ++seq) {
+      // Wait for an empty batch to become available.
+      Batch *batch;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&](void) { return _failed || !_free.empty(); });
+        if (_failed)
+          return;
+        batch = _free.back();
+        _free.pop_back();
+      }
+
+      // Fill the batch with frames.
+      batch->seq = seq;
+      batch->first_doc_num = doc_num;
+      for (batch->nframes = 0; batch->nframes != Batch::MAX_NFRAMES; ++batch->nframes)
+        if (!dr::read_lazy_doc(_input, batch->frames[batch->nframes]))
+          break;
+      doc_num += batch->nframes;
+
+      // Hand the batch over to the workers.
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (batch->nframes == 0) {
+        _free.push_back(batch);
+        _done_reading = true;
+        _cv.notify_all();
+        return;
+      }
+      _todo.push_back(batch);
+      _cv.notify_all();
+    }
+  }
+
+  void
+  _write(const Batch &batch) {
+    for (size_t i = 0; i != batch.nframes; ++i) {
+      if (batch.has_hash[i] && !_seen.insert(batch.hashes[i]))
+        continue;
+      _output.write(batch.frames[i].data(), batch.frames[i].size());
+      ++_nkept;
+    }
+    _nread += batch.nframes;
+  }
+
+  void
+  _work(void) {
+    Hasher hasher(_key);
+    while (true) {
+      // Wait for a batch of frames to hash.
+      Batch *batch;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&](void) { return _failed || _done_reading || !_todo.empty(); });
+        if (_failed || _todo.empty())
+          return;
+        batch = _todo.front();
+        _todo.pop_front();
+      }
+
+      // Hash each of the frames.
+      for (size_t i = 0; i != batch->nframes; ++i) {
+        uint64_t hash = 0;
+        batch->has_hash[i] = hasher(batch->frames[i], batch->first_doc_num + i, hash);
+        batch->hashes[i] = hash;
+      }
+
+      // Only the worker holding the next batch in sequence is able to check and write, so no
+      // further locking of the seen hashes or the output is needed.
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cv.wait(lock, [&](void) { return _failed || _next_to_write == batch->seq; });
+      if (_failed)
+        return;
+      lock.unlock();
+      _write(*batch);
+      lock.lock();
+      ++_next_to_write;
+
+      // Recycle the batch.
+      _free.push_back(batch);
+      _cv.notify_all();
+    }
+  }
+
+public:
+  ParallelDedup(std::istream &input, std::ostream &output, Seen &seen, const std::string &key, unsigned int nthreads) :
+      _input(input),
+      _output(output),
+      _seen(seen),
+      _key(key),
+      _nthreads(nthreads),
+      _next_to_write(0),
+      _nread(0),
+      _nkept(0),
+      _done_reading(false),
+      _failed(false)
+    { }
+
+  void
+  run(void) {
+    // Allow each worker to have a batch in progress and one queued up.
+    for (unsigned int i = 0; i != 2*_nthreads; ++i) {
+      _batches.emplace_back(new Batch());
+      _free.push_back(_batches.back().get());
+    }
+
+    const auto work = [&](void) {
+      try {
+        _work();
+      }
+      catch (...) {
+        _fail();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i != _nthreads; ++i)
+      threads.push_back(std::thread(work));
+
+    try {
+      _read();
+    }
+    catch (...) {
+      _fail();
+    }
+
+    for (auto &thread : threads)
+      thread.join();
+    if (_error)
+      std::rethrow_exception(_error);
+    LOG(DEBUG) << "Kept " << _nkept << " of " << _nread << " documents" << std::endl;
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(ParallelDedup);
+};
+
+
+static void
+main(std::istream &input, std::ostream &output, const std::string &key, const uint64_t bloom_mb, const unsigned int bloom_nhashes, const unsigned int nthreads) {
+  if (bloom_mb != 0 && bloom_nhashes == 0)
+    throw cf::ConfigException("The Bloom filter requires at least one hash function");
+  Seen seen(bloom_mb * 1024 * 1024, bloom_nhashes);
+
+  if (nthreads <= 1)
+    main_serial(input, output, seen, key);
+  else {
+    ParallelDedup dedup(input, output, seen, key, nthreads);
+    dedup.run();
+  }
+}
+
+}  // namespace
+
+
+int
+main(int argc, char **argv) {
+  // Construct an option parser.
+  cf::Main cfg("dr-dedup", "Removes duplicate documents from a docrep stream, keeping the first occurrence.");
+  cf::OpIStream input(cfg, "input", 'i', "The input file");
+  cf::OpOStream output(cfg, "output", 'o', "The output file");
+  cf::Op<std::string> key(cfg, "key", 'k', "Compare documents by the value of this expression (e.g. doc.url or hash(doc.tokens, ann.raw)) instead of by their raw bytes. Documents where it is missing are always kept", cf::Flags::OPTIONAL);
+  cf::Op<uint64_t> bloom_size(cfg, "bloom-size", 'b', "Instead of remembering the hash of every document, use a Bloom filter of this many megabytes. This bounds memory usage, but may drop a small fraction of unique documents", cf::Flags::OPTIONAL);
+  cf::Op<unsigned int> bloom_nhashes(cfg, "bloom-nhashes", "The number of hash functions used by the Bloom filter", 7);
+  cf::Op<unsigned int> nthreads(cfg, "nthreads", 'j', "The number of threads to hash documents with", 1);
+
+  // Parse argv.
+  input.position_arg_precedence(0);
+  cfg.main<io::PrettyLogger>(argc, argv);
+
+  // Dispatch to main function.
+  try {
+    main(input.file(), output.file(), key(), bloom_size.was_assigned() ? bloom_size() : 0, bloom_nhashes(), nthreads());
+  }
+  catch (schwa::Exception &e) {
+    std::cerr << schwa::print_exception(e) << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -19,12 +19,20 @@ main(int argc, char **argv) {
   cf::Main cfg("dr-dist", "A docrep stream parallelisation source and sink.");
   cf::OpIStream input(cfg, "input", 'i', "The input file");
   cf::OpOStream output(cfg, "output", 'o', "The output file");
-  cf::Op<std::string> bind_host(cfg, "bind-host", "The network hostname to bind to", "*");
+  cf::Op<std::string> bind_host(cfg, "bind-host", "The network hostname to bind to (\"shm\" to pass documents through shared memory to workers on the same host)", "*");
   cf::Op<uint32_t> source_port(cfg, "source-port", "The network port to bind to on which to push docrep documents", 7301);
   cf::Op<uint32_t> sink_port(cfg, "sink-port", "The network port to bind to on which to pull docrep documents", 7302);
   cf::Op<uint32_t> control_port(cfg, "control-port", "The network port to bind to on which to publish control messages", 7303);
   cf::Op<bool> preserve_order(cfg, "preserve-order", "Whether or not the order of documents written out should be preserved", true);
   cf::Op<bool> kill_clients(cfg, "kill-clients", "Whether or not to instruct the clients to terminate once all of the documents have been processed", true);
+  cf::Op<uint32_t> batch_size(cfg, "batch-size", "The maximum number of documents to send to a worker in a single message", 64);
+  cf::Op<size_t> batch_bytes(cfg, "batch-bytes", "The number of bytes of documents after which a batch is sent without waiting for it to fill up", 1024*1024);
+  cf::Op<unsigned int> batch_linger(cfg, "batch-linger", "The number of milliseconds after which a batch is sent without waiting for it to fill up, for when the input is slow", 100);
+  cf::Op<uint64_t> window(cfg, "window", "The maximum number of documents sent out beyond the first one not yet received back, bounding memory use when workers are slow (0 for no limit)", 4096);
+  cf::Op<unsigned int> worker_timeout(cfg, "worker-timeout", "The number of milliseconds after which a worker which has not sent a heartbeat is presumed dead and its documents are re-sent to other workers (0 to never re-send)", 10000);
+  cf::Op<size_t> reorder_bytes(cfg, "reorder-bytes", "The number of bytes of documents which arrive out of order to hold in memory when preserving the order, beyond which they are spilled to a temporary file (0 for no limit)", 256*1024*1024);
+  cf::Op<uint32_t> stats_port(cfg, "stats-port", "The local network port to bind to on which to serve a report on the throughput and the workers in reply to any request (0 for none)", 7304);
+  cf::Op<unsigned int> stats_interval(cfg, "stats-interval", "The number of milliseconds between reports on the throughput and the workers written to the log (0 for none)", 10000);
 
   // Parse argv.
   cfg.main<io::ThreadsafePrettyLogger>(argc, argv);
@@ -34,14 +42,15 @@ main(int argc, char **argv) {
   const std::string sink_addr = schwa::dr_dist::build_socket_addr(bind_host(), sink_port());
   const std::string control_addr = schwa::dr_dist::build_socket_addr(bind_host(), control_port());
   const std::string direct_sink_addr = schwa::dr_dist::build_socket_addr(bind_host() == "*" ? "127.0.0.1" : bind_host(), sink_port());
+  const std::string stats_addr = stats_port() == 0 ? "" : schwa::dr_dist::build_socket_addr(bind_host() == "*" ? "127.0.0.1" : bind_host(), stats_port());
 
   // Run the source and sink threads.
   bool success_source, success_sink;
   auto wrap_source = [&](std::istream &input) {
-    success_source = schwa::dr_dist::source(source_addr, direct_sink_addr, input);
+    success_source = schwa::dr_dist::source(source_addr, direct_sink_addr, input, batch_size(), batch_bytes(), batch_linger(), window(), worker_timeout() != 0);
   };
   auto wrap_sink = [&](std::ostream &output) {
-    success_sink = schwa::dr_dist::sink(sink_addr, control_addr, preserve_order(), kill_clients(), output);
+    success_sink = schwa::dr_dist::sink(sink_addr, control_addr, preserve_order(), kill_clients(), output, worker_timeout(), stats_addr, stats_interval(), reorder_bytes());
   };
   std::thread source_thread(wrap_source, std::ref(input.file()));
   std::thread sink_thread(wrap_sink, std::ref(output.file()));
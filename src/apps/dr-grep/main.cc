@@ -1,6 +1,14 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <schwa/config.h>
 #include <schwa/dr.h>
@@ -15,22 +23,244 @@ namespace io = schwa::io;
 namespace {
 
 void
-main(std::istream &input, std::ostream &output, const std::string &expression) {
-  // Construct a docrep reader and writer over the provided streams.
+main_serial(std::istream &input, std::ostream &output, const std::string &expression) {
+  // Construct a docrep reader which decodes documents from in-memory frames.
   dr::FauxDoc doc;
   dr::FauxDoc::Schema schema;
-  dr::Reader reader(input, schema);
-  dr::Writer writer(output, schema);
+  dr::Reader reader(schema);
 
   // Construct an interpreter and compile the expression.
   dr::query::Interpreter interpreter;
   interpreter.compile(expression);
 
-  // Read the documents off the input stream and evaluate them against the expression.
-  for (uint32_t i = 0; reader >> doc; ++i) {
+  // Read the raw bytes of each document off the input stream. Documents which cannot contain the
+  // literal the expression requires are skipped without being decoded, and matching documents are
+  // written out verbatim rather than being re-serialised.
+  std::string frame;
+  for (uint32_t i = 0; dr::read_lazy_doc(input, frame); ++i) {
+    if (!interpreter.might_match(frame))
+      continue;
+    reader.read(doc, frame.data(), frame.size());
     const auto v = interpreter(doc, i);
     if (v)
-      writer << doc;
+      output.write(frame.data(), frame.size());
+  }
+}
+
+
+/**
+ * A group of framed documents read off the input stream which is evaluated as a unit by one of
+ * the worker threads. Batches are recycled so that the frame buffers are reused.
+ **/
+class Batch {
+public:
+  static constexpr const size_t MAX_NFRAMES = 256;
+
+  uint64_t seq;
+  uint32_t first_doc_num;
+  size_t nframes;
+  std::vector<std::string> frames;
+  std::vector<bool> matches;
+
+  Batch(void) : seq(0), first_doc_num(0), nframes(0), frames(MAX_NFRAMES), matches(MAX_NFRAMES) { }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(Batch);
+};
+
+
+/**
+ * Frames documents off the input stream on the calling thread and evaluates the batches of frames
+ * on a set of worker threads, each of which has its own Interpreter compiled from the same
+ * expression. The raw frames of matching documents are written out either in their original
+ * order or in the order in which their batches finish being evaluated.
+ **/
+class ParallelGrep {
+private:
+  std::istream &_input;
+  std::ostream &_output;
+  const std::string &_expression;
+  const unsigned int _nthreads;
+  const bool _preserve_order;
+
+  std::vector<std::unique_ptr<Batch>> _batches;
+  std::deque<Batch *> _todo;
+  std::vector<Batch *> _free;
+  uint64_t _next_to_write;
+  bool _done_reading;
+  bool _failed;
+  std::exception_ptr _error;
+  std::mutex _mutex;
+  std::mutex _output_mutex;
+  std::condition_variable _cv;
+
+  void
+  _fail(void) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_failed) {
+      _error = std::current_exception();
+      _failed = true;
+    }
+    _cv.notify_all();
+  }
+
+  void
+  _read(void) {
+    uint32_t doc_num = 0;
+    for (uint64_t seq = 0; ; ++seq) {
+      // Wait for an empty batch to become available.
+      Batch *batch;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&](void) { return _failed || !_free.empty(); });
+        if (_failed)
+          return;
+        batch = _free.back();
+        _free.pop_back();
+      }
+
+      // Fill the batch with frames.
+      batch->seq = seq;
+      batch->first_doc_num = doc_num;
+      for (batch->nframes = 0; batch->nframes != Batch::MAX_NFRAMES; ++batch->nframes)
+        if (!dr::read_lazy_doc(_input, batch->frames[batch->nframes]))
+          break;
+      doc_num += batch->nframes;
+
+      // Hand the batch over to the workers.
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (batch->nframes == 0) {
+        _free.push_back(batch);
+        _done_reading = true;
+        _cv.notify_all();
+        return;
+      }
+      _todo.push_back(batch);
+      _cv.notify_all();
+    }
+  }
+
+  void
+  _write(const Batch &batch) {
+    for (size_t i = 0; i != batch.nframes; ++i)
+      if (batch.matches[i])
+        _output.write(batch.frames[i].data(), batch.frames[i].size());
+  }
+
+  void
+  _work(void) {
+    dr::FauxDoc doc;
+    dr::FauxDoc::Schema schema;
+    dr::Reader reader(schema);
+    dr::query::Interpreter interpreter;
+    interpreter.compile(_expression);
+
+    while (true) {
+      // Wait for a batch of frames to evaluate.
+      Batch *batch;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&](void) { return _failed || _done_reading || !_todo.empty(); });
+        if (_failed || _todo.empty())
+          return;
+        batch = _todo.front();
+        _todo.pop_front();
+      }
+
+      // Evaluate each of the frames.
+      for (size_t i = 0; i != batch->nframes; ++i) {
+        const std::string &frame = batch->frames[i];
+        batch->matches[i] = false;
+        if (!interpreter.might_match(frame))
+          continue;
+        reader.read(doc, frame.data(), frame.size());
+        batch->matches[i] = interpreter(doc, batch->first_doc_num + i).to_bool();
+      }
+
+      // Write out the matching frames. When preserving order, only the worker holding the next
+      // batch in sequence is able to write, so no further locking of the output is needed.
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (_preserve_order) {
+        _cv.wait(lock, [&](void) { return _failed || _next_to_write == batch->seq; });
+        if (_failed)
+          return;
+        lock.unlock();
+        _write(*batch);
+        lock.lock();
+        ++_next_to_write;
+      }
+      else {
+        lock.unlock();
+        {
+          std::lock_guard<std::mutex> output_lock(_output_mutex);
+          _write(*batch);
+        }
+        lock.lock();
+      }
+
+      // Recycle the batch.
+      _free.push_back(batch);
+      _cv.notify_all();
+    }
+  }
+
+public:
+  ParallelGrep(std::istream &input, std::ostream &output, const std::string &expression, unsigned int nthreads, bool preserve_order) :
+      _input(input),
+      _output(output),
+      _expression(expression),
+      _nthreads(nthreads),
+      _preserve_order(preserve_order),
+      _next_to_write(0),
+      _done_reading(false),
+      _failed(false)
+    { }
+
+  void
+  run(void) {
+    // Allow each worker to have a batch in progress and one queued up.
+    for (unsigned int i = 0; i != 2*_nthreads; ++i) {
+      _batches.emplace_back(new Batch());
+      _free.push_back(_batches.back().get());
+    }
+
+    const auto work = [&](void) {
+      try {
+        _work();
+      }
+      catch (...) {
+        _fail();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i != _nthreads; ++i)
+      threads.push_back(std::thread(work));
+
+    try {
+      _read();
+    }
+    catch (...) {
+      _fail();
+    }
+
+    for (auto &thread : threads)
+      thread.join();
+    if (_error)
+      std::rethrow_exception(_error);
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(ParallelGrep);
+};
+
+
+void
+main(std::istream &input, std::ostream &output, const std::string &expression, const unsigned int nthreads, const bool preserve_order) {
+  if (nthreads <= 1)
+    main_serial(input, output, expression);
+  else {
+    ParallelGrep grep(input, output, expression, nthreads, preserve_order);
+    grep.run();
   }
 }
 
@@ -44,6 +274,8 @@ main(int argc, char **argv) {
   cf::OpIStream input(cfg, "input", 'i', "The input file");
   cf::OpOStream output(cfg, "output", 'o', "The output file");
   cf::Op<std::string> expression(cfg, "expression", 'e', "The expression to filter on");
+  cf::Op<unsigned int> nthreads(cfg, "nthreads", 'j', "The number of threads to evaluate the expression with", 1);
+  cf::Op<bool> preserve_order(cfg, "preserve-order", "Whether or not the order of documents written out should be preserved when using multiple threads", true);
 
   // Parse argv.
   expression.position_arg_precedence(0);
@@ -52,7 +284,7 @@ main(int argc, char **argv) {
 
   // Dispatch to main function.
   try {
-    main(input.file(), output.file(), expression());
+    main(input.file(), output.file(), expression(), nthreads(), preserve_order());
   }
   catch (schwa::Exception &e) {
     std::cerr << schwa::print_exception(e) << std::endl;
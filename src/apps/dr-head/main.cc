@@ -1,10 +1,16 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <string>
 
 #include <schwa/config.h>
+#include <schwa/dr/doc_index.h>
+#include <schwa/dr/exception.h>
 #include <schwa/dr/reader.h>
 #include <schwa/io/logging.h>
+#include <schwa/io/mmapped_source.h>
+#include <schwa/io/range_copier.h>
 
 namespace cf = schwa::config;
 namespace dr = schwa::dr;
@@ -14,11 +20,11 @@ namespace io = schwa::io;
 namespace {
 
 static void
-main(std::istream &input, std::ostream &output, const uint32_t count, const uint32_t skip) {
+main_stream(std::istream &input, std::ostream &output, const uint32_t count, const uint32_t skip) {
   // Read the documents off the input stream.
   uint32_t nread = 0;
+  std::string tmp;
   for (uint32_t i = 0; ; ++i) {
-    std::stringstream tmp;
     if (nread == count)
       break;
     else if (!dr::read_lazy_doc(input, tmp))
@@ -26,12 +32,58 @@ main(std::istream &input, std::ostream &output, const uint32_t count, const uint
     else if (i < skip)
       continue;
 
-    tmp.seekp(0);
-    output << tmp.rdbuf();
+    output.write(tmp.data(), tmp.size());
     ++nread;
   }
 }
 
+
+static void
+main_mmapped(const std::string &path, const cf::OpOStream &output, const uint32_t count, const uint32_t skip) {
+  io::MMappedSource source(path.c_str());
+  const uint64_t ndocs = static_cast<uint64_t>(skip) + count;
+
+  // The kept docs are contiguous, so find the byte range they span. This uses the sidecar index if
+  // there is one, otherwise only the docs up to the end of the range are framed.
+  uint64_t start = 0, end = 0;
+  dr::DocIndex index;
+  if (index.load_sidecar(path, source.size())) {
+    start = index.offset(std::min<uint64_t>(skip, index.ndocs()));
+    end = index.offset(std::min<uint64_t>(ndocs, index.ndocs()));
+  }
+  else {
+    uint64_t i = 0;
+    for ( ; i != ndocs && end != source.size(); ++i) {
+      if (i == skip)
+        start = end;
+      const size_t nbytes = dr::frame_lazy_doc(source.data() + end, source.size() - end);
+      if (nbytes == 0) {
+        std::ostringstream msg;
+        msg << "Failed to frame a document at byte offset " << end;
+        throw dr::ReaderException(msg.str());
+      }
+      end += nbytes;
+    }
+    if (i <= skip)
+      start = end;
+  }
+
+  // Copy the range straight from the input file to the output.
+  if (start != end) {
+    io::RangeCopier copier(path, output.dup_fd());
+    copier.copy(start, end - start);
+  }
+}
+
+
+static void
+main(std::istream &input, const std::string &input_path, const cf::OpOStream &output, const uint32_t count, const uint32_t skip) {
+  if (input_path != cf::OpIStream::STDIN_STRING && io::MMappedSource::can_mmap(input_path.c_str()))
+    main_mmapped(input_path, output, count, skip);
+  else
+    main_stream(input, output.file(), count, skip);
+}
+
 }  // namespace
 
 
@@ -50,7 +102,7 @@ main(int argc, char **argv) {
 
   // Dispatch to main function.
   try {
-    main(input.file(), output.file(), count(), skip());
+    main(input.file(), input(), output, count(), skip());
   }
   catch (schwa::Exception &e) {
     std::cerr << schwa::print_exception(e) << std::endl;
@@ -0,0 +1,148 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <schwa/config.h>
+#include <schwa/dr/doc_index.h>
+#include <schwa/dr/exception.h>
+#include <schwa/dr/inverted_index.h>
+#include <schwa/exception.h>
+#include <schwa/io/logging.h>
+#include <schwa/io/mmapped_source.h>
+#include <schwa/io/range_copier.h>
+
+namespace cf = schwa::config;
+namespace dr = schwa::dr;
+namespace io = schwa::io;
+
+
+namespace {
+
+/**
+ * Locates each of the documents in the mmapped docrep file, using its sidecar index if there is
+ * one.
+ **/
+static void
+load_doc_index(const std::string &input_path, const io::MMappedSource &source, dr::DocIndex &doc_index) {
+  if (!doc_index.load_sidecar(input_path, source.size()))
+    doc_index.build(source.data(), source.size());
+}
+
+
+static void
+main_build(const std::string &input_path, const std::string &index_path, const std::string &store, const std::string &field, const unsigned int nthreads) {
+  io::MMappedSource source(input_path.c_str());
+  dr::DocIndex doc_index;
+  load_doc_index(input_path, source, doc_index);
+
+  dr::InvertedIndex index;
+  index.build(source.data(), doc_index, store, field, nthreads);
+  LOG(DEBUG) << "Indexed " << index.nterms() << " terms over " << index.ndocs() << " documents in " << index.postings_nbytes() << " bytes of postings" << std::endl;
+
+  std::ofstream out(index_path, std::ios::binary);
+  if (!out)
+    throw schwa::IOException("Could not open file for writing", index_path);
+  index.save(out);
+  if (!out)
+    throw schwa::IOException("Failed to write the inverted index", index_path);
+}
+
+
+static void
+main_lookup(const std::string &input_path, const std::string &index_path, const std::string &store, const std::string &field, const std::string &term, const cf::OpOStream &output, const bool doc_nums_only) {
+  dr::InvertedIndex index;
+  {
+    std::ifstream in(index_path, std::ios::binary);
+    if (!in)
+      throw schwa::IOException("Could not open the inverted index. Build it first by running dr-invert without --lookup", index_path);
+    index.load(in);
+  }
+  if (!store.empty() && store != index.store())
+    throw cf::ConfigException("The inverted index is over the \"" + index.store() + "\" store, not \"" + store + "\"");
+  if (!field.empty() && field != index.field())
+    throw cf::ConfigException("The inverted index is over the \"" + index.field() + "\" field, not \"" + field + "\"");
+
+  // An index built for a different version of the docrep file would point at the wrong documents.
+  io::MMappedSource source(input_path.c_str());
+  dr::DocIndex doc_index;
+  load_doc_index(input_path, source, doc_index);
+  if (index.ndocs() != doc_index.ndocs() || index.total_nbytes() != doc_index.total_nbytes()) {
+    std::ostringstream msg;
+    msg << "The inverted index is stale: it covers " << index.ndocs() << " documents in " << index.total_nbytes() << " bytes but the docrep file has " << doc_index.ndocs() << " documents in " << doc_index.total_nbytes() << " bytes";
+    throw dr::ReaderException(msg.str());
+  }
+
+  std::vector<uint64_t> doc_nums;
+  index.find(term, doc_nums);
+  if (doc_nums_only) {
+    std::ostream &out = output.file();
+    for (const uint64_t doc_num : doc_nums)
+      out << doc_num << '\n';
+    out.flush();
+    return;
+  }
+
+  // Copy the matching docs straight from the input file, merging runs of adjacent docs into a
+  // single range.
+  io::RangeCopier copier(input_path, output.dup_fd());
+  for (size_t i = 0; i != doc_nums.size(); ) {
+    size_t j = i + 1;
+    while (j != doc_nums.size() && doc_nums[j] == doc_nums[j - 1] + 1)
+      ++j;
+    copier.copy(doc_index.offset(doc_nums[i]), doc_index.offset(doc_nums[j - 1] + 1) - doc_index.offset(doc_nums[i]));
+    i = j;
+  }
+}
+
+
+static void
+main(const std::string &input_path, std::string index_path, const std::string &store, const std::string &field, const std::string &term, const bool lookup, const cf::OpOStream &output, const bool doc_nums_only, const unsigned int nthreads) {
+  if (!io::MMappedSource::can_mmap(input_path.c_str()))
+    throw cf::ConfigException("The input must be a regular file, as documents are located by their byte offsets");
+  if (index_path.empty())
+    index_path = dr::InvertedIndex::sidecar_path(input_path);
+
+  if (lookup)
+    main_lookup(input_path, index_path, store, field, term, output, doc_nums_only);
+  else
+    main_build(input_path, index_path, store, field, nthreads);
+}
+
+}  // namespace
+
+
+int
+main(int argc, char **argv) {
+  // Construct an option parser.
+  cf::Main cfg("dr-invert", "Builds an inverted index over a field of a store in a docrep file, and uses it to look up the documents containing a term.");
+  cf::Op<std::string> input(cfg, "input", 'i', "The docrep file");
+  cf::Op<std::string> index(cfg, "index", 'x', "The path of the inverted index. Defaults to the input path with \".postings\" appended", cf::Flags::OPTIONAL);
+  cf::Op<std::string> store(cfg, "store", 's', "The store to index the annotations of", "tokens");
+  cf::Op<std::string> field(cfg, "field", 'f', "The string field of the annotations to index", "norm");
+  cf::Op<std::string> lookup(cfg, "lookup", 'l', "Instead of building the index, output the documents which contain this term", cf::Flags::OPTIONAL);
+  cf::OpOStream output(cfg, "output", 'o', "The output file for looked up documents");
+  cf::Op<bool> doc_nums(cfg, "doc-nums", 'n', "Output the numbers of the looked up documents, one per line, instead of the documents themselves", false);
+  cf::Op<unsigned int> nthreads(cfg, "nthreads", 'j', "The number of threads to build the index with", 1);
+
+  // Parse argv.
+  input.position_arg_precedence(0);
+  cfg.main<io::PrettyLogger>(argc, argv);
+
+  // Only check the store and field against an existing index if they were given explicitly.
+  const bool is_lookup = lookup.was_assigned();
+  const std::string store_ = (is_lookup && !store.was_assigned()) ? "" : store();
+  const std::string field_ = (is_lookup && !field.was_assigned()) ? "" : field();
+
+  // Dispatch to main function.
+  try {
+    main(input(), index(), store_, field_, lookup(), is_lookup, output, doc_nums(), nthreads());
+  }
+  catch (schwa::Exception &e) {
+    std::cerr << schwa::print_exception(e) << std::endl;
+    return 1;
+  }
+  return 0;
+}
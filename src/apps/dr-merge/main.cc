@@ -0,0 +1,259 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <schwa/config.h>
+#include <schwa/dr.h>
+#include <schwa/dr/sort_key.h>
+#include <schwa/exception.h>
+#include <schwa/io/logging.h>
+#include <schwa/io/range_copier.h>
+
+namespace cf = schwa::config;
+namespace dr = schwa::dr;
+namespace dq = schwa::dr::query;
+namespace io = schwa::io;
+
+
+namespace {
+
+static constexpr const size_t OUTPUT_BUFFER_NBYTES = 8 * 1024 * 1024;
+static constexpr const char *const STDIN_PATH = "-";
+
+
+static inline bool
+is_stdin(const std::string &path) {
+  return path == STDIN_PATH || path == cf::OpIStream::STDIN_STRING;
+}
+
+
+/**
+ * Accumulates framed documents into a large buffer which is written to the output stream in one
+ * go once full, so that the output is written in a few large writes rather than one per document.
+ **/
+class OutputBuffer {
+private:
+  std::ostream &_out;
+  std::string _buffer;
+
+public:
+  explicit OutputBuffer(std::ostream &out) : _out(out) {
+    _buffer.reserve(OUTPUT_BUFFER_NBYTES);
+  }
+
+  ~OutputBuffer(void) {
+    flush();
+  }
+
+  inline void
+  write(const std::string &frame) {
+    if (_buffer.size() + frame.size() > OUTPUT_BUFFER_NBYTES)
+      flush();
+    if (frame.size() >= OUTPUT_BUFFER_NBYTES)
+      _out.write(frame.data(), frame.size());
+    else
+      _buffer.append(frame);
+  }
+
+  void
+  flush(void) {
+    _out.write(_buffer.data(), _buffer.size());
+    _out.flush();
+    _buffer.clear();
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(OutputBuffer);
+};
+
+
+/**
+ * One of the inputs being merged. The input is read through its own read-ahead buffer, and holds
+ * the framed bytes and key of its current document.
+ **/
+class Input {
+private:
+  const std::string _path;
+  std::unique_ptr<char[]> _buffer;
+  std::ifstream _file;
+  std::istream *_in;
+  dq::SortKeyExtractor _extractor;
+  uint64_t _doc_num;
+  dq::SortKey _prev_key;
+  bool _warned;
+
+public:
+  dq::SortKey key;
+  std::string frame;
+
+  Input(const std::string &path, const std::string &key_expression, const size_t buffer_nbytes) :
+      _path(path),
+      _buffer(new char[buffer_nbytes]),
+      _in(&std::cin),
+      _extractor(key_expression),
+      _doc_num(0),
+      _warned(false) {
+    if (!is_stdin(path)) {
+      _file.rdbuf()->pubsetbuf(_buffer.get(), buffer_nbytes);
+      _file.open(path, std::ios::in | std::ios::binary);
+      if (!_file.is_open())
+        throw schwa::IOException("Could not open file for reading", path);
+      _in = &_file;
+    }
+  }
+
+  /**
+   * Reads the next document and evaluates its key, returning false at the end of the input. Warns
+   * once if the input is not sorted in \p direction order, as the output will then not be either.
+   **/
+  bool
+  next(const int direction) {
+    if (!dr::read_lazy_doc(*_in, frame))
+      return false;
+    std::swap(_prev_key, key);
+    _extractor(frame.data(), frame.size(), _doc_num, key);
+    if (_doc_num != 0 && !_warned && direction * _prev_key.compare(key) > 0) {
+      LOG(WARNING) << "Document " << _doc_num << " of " << _path << " is out of order, so the merged output will not be sorted" << std::endl;
+      _warned = true;
+    }
+    ++_doc_num;
+    return true;
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(Input);
+};
+
+
+static bool
+is_regular_file(const std::string &path, uint64_t &nbytes) {
+  struct stat st;
+  if (is_stdin(path) || ::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  nbytes = st.st_size;
+  return true;
+}
+
+
+/**
+ * Concatenates the inputs without decoding them. If every input is a regular file, the files are
+ * copied by the kernel where possible. Otherwise everything is copied through a large buffer, as
+ * writes to the output stream and to a duplicate of its file descriptor cannot be interleaved.
+ **/
+static void
+main_concatenate(const std::vector<std::string> &paths, const cf::OpOStream &output) {
+  std::vector<uint64_t> nbytes(paths.size());
+  bool all_regular = true;
+  for (size_t i = 0; i != paths.size(); ++i)
+    all_regular &= is_regular_file(paths[i], nbytes[i]);
+
+  if (all_regular) {
+    for (size_t i = 0; i != paths.size(); ++i) {
+      if (nbytes[i] == 0)
+        continue;
+      io::RangeCopier copier(paths[i], output.dup_fd());
+      copier.copy(0, nbytes[i]);
+    }
+    return;
+  }
+
+  std::unique_ptr<char[]> buffer(new char[io::RangeCopier::BUFFER_NBYTES]);
+  std::ostream &out = output.file();
+  for (const std::string &path : paths) {
+    std::ifstream file;
+    std::istream *in = &std::cin;
+    if (!is_stdin(path)) {
+      file.open(path, std::ios::in | std::ios::binary);
+      if (!file.is_open())
+        throw schwa::IOException("Could not open file for reading", path);
+      in = &file;
+    }
+    while (in->read(buffer.get(), io::RangeCopier::BUFFER_NBYTES) || in->gcount() != 0)
+      out.write(buffer.get(), in->gcount());
+  }
+  out.flush();
+}
+
+
+/**
+ * k-way merges the inputs, each of which should already be sorted by the key expression, with a
+ * min-heap over the current document of each input. Documents with equal keys are output in the
+ * order of the inputs they came from, so merging the shards of a stable sort is also stable.
+ **/
+static void
+main_merge(const std::vector<std::string> &paths, std::ostream &output, const std::string &key, const bool reverse, const size_t buffer_nbytes) {
+  const int direction = reverse ? -1 : 1;
+  std::vector<std::unique_ptr<Input>> inputs;
+  for (const std::string &path : paths)
+    inputs.emplace_back(new Input(path, key, buffer_nbytes));
+
+  const auto greater = [&](const size_t a, const size_t b) {
+    const int cmp = direction * inputs[a]->key.compare(inputs[b]->key);
+    return cmp == 0 ? a > b : cmp > 0;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i != inputs.size(); ++i)
+    if (inputs[i]->next(direction))
+      heap.push(i);
+
+  OutputBuffer out(output);
+  while (!heap.empty()) {
+    const size_t i = heap.top();
+    heap.pop();
+    out.write(inputs[i]->frame);
+    if (inputs[i]->next(direction))
+      heap.push(i);
+  }
+}
+
+
+static void
+main(std::vector<std::string> paths, const cf::OpOStream &output, const std::string &key, const bool reverse, const size_t buffer_kb) {
+  if (paths.empty())
+    paths.push_back(STDIN_PATH);
+  size_t nstdin = 0;
+  for (const std::string &path : paths)
+    nstdin += is_stdin(path);
+  if (nstdin > 1)
+    throw cf::ConfigException("Standard input can only be given as an input once");
+  if (buffer_kb == 0)
+    throw cf::ConfigException("The read-ahead buffer size must be positive");
+
+  if (key.empty())
+    main_concatenate(paths, output);
+  else
+    main_merge(paths, output.file(), key, reverse, buffer_kb * 1024);
+}
+
+}  // namespace
+
+
+int
+main(int argc, char **argv) {
+  // Construct an option parser.
+  cf::Main cfg("dr-merge", "Concatenates docrep streams, or merges streams which are sorted by a key into a single sorted stream.");
+  cf::OpOStream output(cfg, "output", 'o', "The output file");
+  cf::Op<std::string> key(cfg, "key", 'k', "The expression the inputs are sorted by (e.g. doc.id). If not given, the inputs are concatenated", cf::Flags::OPTIONAL);
+  cf::Op<bool> reverse(cfg, "reverse", 'r', "The inputs are sorted in descending order of the key", false);
+  cf::Op<size_t> buffer_size(cfg, "buffer-size", 'b', "The number of kilobytes to read ahead from each input when merging", 1024);
+
+  // Parse argv. The inputs are given as positional arguments, with "-" meaning stdin.
+  cfg.allow_unclaimed_args(true);
+  cfg.main<io::PrettyLogger>(argc, argv);
+
+  // Dispatch to main function.
+  try {
+    main(cfg.unclaimed_args(), output, key(), reverse(), buffer_size());
+  }
+  catch (schwa::Exception &e) {
+    std::cerr << schwa::print_exception(e) << std::endl;
+    return 1;
+  }
+  return 0;
+}
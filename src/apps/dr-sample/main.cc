@@ -1,64 +1,99 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <algorithm>
 #include <chrono>
 #include <iostream>
-#include <memory>
-#include <random>
-#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <schwa/config.h>
+#include <schwa/dr/doc_index.h>
 #include <schwa/dr/reader.h>
 #include <schwa/io/logging.h>
+#include <schwa/io/mmapped_source.h>
+#include <schwa/io/range_copier.h>
+#include <schwa/utils/reservoir.h>
 
 namespace cf = schwa::config;
 namespace dr = schwa::dr;
 namespace io = schwa::io;
+namespace utils = schwa::utils;
 
 
 namespace {
 
 static void
-main(std::istream &input, std::ostream &output, const uint32_t count) {
-  // Construct the random number generator with the current time as seed.
-  const auto seed = std::chrono::system_clock::now().time_since_epoch().count();
-  std::mt19937 generator(seed);
-
-  // Create an array to store the `count` random docs in.
-  std::unique_ptr<std::stringstream[]> bufs(new std::stringstream[count]);
-
-  // Use reservoir sampling to sample the random docs from the input stream.
-  uint32_t nread = 0;
-  while (true) {
-    // Attempt to read the next document into temp storage.
-    std::stringstream tmp;
-    if (!dr::read_lazy_doc(input, tmp))
-      break;
-
-    // Work out where to place the document, if anywhere.
-    bool keep = true;
-    uint32_t index = nread;
-    if (nread >= count) {
-      const uint32_t r = generator();
-      if ((r % (nread + 1)) < count)
-        index = r % count;
-      else
-        keep = false;
-    }
-
-    // Move the read in data into the appropriate buffer element, and increment the counts.
-    if (keep) {
-      bufs[index].str(tmp.str());
-      bufs[index].clear();
-    }
-    ++nread;
+main_stream(std::istream &input, std::ostream &output, utils::ReservoirSampler &sampler, const uint32_t count) {
+  // Each reservoir slot holds the document number and framed bytes of the doc.
+  std::vector<std::pair<uint64_t, std::string>> reservoir;
+  reservoir.reserve(count);
+
+  // Only the documents entering the reservoir are kept. Each one is read into temp storage and
+  // swapped into its slot, so the documents which are thrown away are never copied.
+  std::string tmp;
+  for (uint64_t doc_num = 0; dr::read_lazy_doc(input, tmp); ++doc_num) {
+    if (doc_num != sampler.next())
+      continue;
+    const size_t slot = sampler.advance();
+    if (slot == reservoir.size())
+      reservoir.emplace_back(doc_num, std::string());
+    reservoir[slot].first = doc_num;
+    std::swap(reservoir[slot].second, tmp);
   }
 
-  // Output the sampled docs.
-  for (uint32_t i = 0; i != std::min(nread, count); ++i) {
-    // Rewind the temp storage and write it out.
-    std::stringstream &tmp = bufs[i];
-    tmp.seekp(0);
-    output << tmp.rdbuf();
+  // Output the sampled docs in the order they appeared in the stream.
+  std::sort(reservoir.begin(), reservoir.end());
+  for (const auto &pair : reservoir)
+    output.write(pair.second.data(), pair.second.size());
+}
+
+
+static void
+main_mmapped(const std::string &path, const cf::OpOStream &output, utils::ReservoirSampler &sampler, const uint32_t count) {
+  // Locate each of the documents, using the sidecar index if there is one.
+  io::MMappedSource source(path.c_str());
+  dr::DocIndex index;
+  if (!index.load_sidecar(path, source.size()))
+    index.build(source.data(), source.size());
+
+  // With the number of documents known, the sampled document numbers are chosen up front.
+  std::vector<uint64_t> reservoir;
+  reservoir.reserve(count);
+  while (sampler.next() < index.ndocs()) {
+    const uint64_t doc_num = sampler.next();
+    const size_t slot = sampler.advance();
+    if (slot == reservoir.size())
+      reservoir.push_back(doc_num);
+    else
+      reservoir[slot] = doc_num;
   }
+
+  // Copy the sampled docs straight from the input file in the order they appear in it, merging
+  // runs of adjacent docs into a single range.
+  std::sort(reservoir.begin(), reservoir.end());
+  io::RangeCopier copier(path, output.dup_fd());
+  for (size_t i = 0; i != reservoir.size(); ) {
+    size_t j = i + 1;
+    while (j != reservoir.size() && reservoir[j] == reservoir[j - 1] + 1)
+      ++j;
+    copier.copy(index.offset(reservoir[i]), index.offset(reservoir[j - 1] + 1) - index.offset(reservoir[i]));
+    i = j;
+  }
+}
+
+
+static void
+main(std::istream &input, const std::string &input_path, const cf::OpOStream &output, const uint32_t count, uint64_t seed, const bool has_seed) {
+  // Construct the random number generator with the current time as seed if none was given.
+  if (!has_seed)
+    seed = std::chrono::system_clock::now().time_since_epoch().count();
+  LOG(DEBUG) << "Sampling with seed " << seed << std::endl;
+  utils::ReservoirSampler sampler(seed, count);
+
+  if (input_path != cf::OpIStream::STDIN_STRING && io::MMappedSource::can_mmap(input_path.c_str()))
+    main_mmapped(input_path, output, sampler, count);
+  else
+    main_stream(input, output.file(), sampler, count);
 }
 
 }  // namespace
@@ -71,6 +106,7 @@ main(int argc, char **argv) {
   cf::OpIStream input(cfg, "input", 'i', "The input file");
   cf::OpOStream output(cfg, "output", 'o', "The output file");
   cf::Op<uint32_t> count(cfg, "count", 'n', "How many documents to keep", 1);
+  cf::Op<uint64_t> seed(cfg, "seed", 's', "The seed for the random number generator, so that a sample can be reproduced. Defaults to the current time", cf::Flags::OPTIONAL);
 
   // Parse argv.
   input.position_arg_precedence(0);
@@ -78,7 +114,7 @@ main(int argc, char **argv) {
 
   // Dispatch to main function.
   try {
-    main(input.file(), output.file(), count());
+    main(input.file(), input(), output, count(), seed(), seed.was_assigned());
   }
   catch (schwa::Exception &e) {
     std::cerr << schwa::print_exception(e) << std::endl;
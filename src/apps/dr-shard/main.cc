@@ -0,0 +1,390 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>  // open
+
+#include <schwa/config.h>
+#include <schwa/dr.h>
+#include <schwa/dr/doc_index.h>
+#include <schwa/dr/query.h>
+#include <schwa/io/logging.h>
+#include <schwa/io/mmapped_source.h>
+#include <schwa/io/range_copier.h>
+#include <schwa/io/utils.h>
+#include <schwa/utils/hash.h>
+
+namespace cf = schwa::config;
+namespace dq = schwa::dr::query;
+namespace dr = schwa::dr;
+namespace io = schwa::io;
+
+
+namespace {
+
+enum class Strategy {
+  ROUND_ROBIN,
+  BLOCKS,
+  HASH,
+};
+
+static const char *const SHARD_PLACEHOLDER = "{}";
+
+
+static std::string
+shard_path(const std::string &pattern, const unsigned int shard) {
+  std::string path = pattern;
+  path.replace(path.find(SHARD_PLACEHOLDER), std::strlen(SHARD_PLACEHOLDER), std::to_string(shard));
+  return path;
+}
+
+
+/**
+ * Writes out the sidecar index for the shard at \p path, or removes any stale sidecar left over
+ * from a previous run so that it is not mistaken for the index of the new shard.
+ **/
+static void
+finish_index(const std::string &path, const dr::DocIndex &index, const bool write_index) {
+  const std::string sidecar_path = dr::DocIndex::sidecar_path(path);
+  if (write_index) {
+    std::unique_ptr<std::ofstream> out(io::safe_open_ofstream(sidecar_path));
+    index.save(*out);
+  }
+  else
+    std::remove(sidecar_path.c_str());
+}
+
+
+/**
+ * Hashes the value of the key expression. Integers are hashed via their decimal representation so
+ * that a key gets the same shard whether it is stored as a string or an integer. Documents where
+ * the key is missing are all placed in the same shard.
+ **/
+static uint64_t
+hash_value(const dq::Value &v) {
+  switch (v.type) {
+  case dq::TYPE_STRING:
+    return schwa::fnv1a_64(v.via._str, std::strlen(v.via._str));
+  case dq::TYPE_INTEGER: {
+    const std::string str = std::to_string(v.via._int);
+    return schwa::fnv1a_64(str.data(), str.size());
+  }
+  case dq::TYPE_MISSING:
+    return schwa::fnv1a_64(nullptr, 0);
+  default:
+    std::ostringstream msg;
+    msg << "The key expression must evaluate to a string or an integer but found " << dq::valuetype_name(v.type);
+    throw dq::RuntimeError(msg.str());
+  }
+}
+
+
+/**
+ * Writes documents out to a set of shard files. The documents for each shard are appended to an
+ * in-memory buffer, and full buffers are handed over to a pool of writer threads so that the
+ * shards are written to in parallel with the input being read and partitioned. Each shard is
+ * always written to by the same thread, so its documents are written in the order they were added.
+ * With no writer threads, full buffers are written out by the calling thread.
+ **/
+class ShardWriter {
+public:
+  static constexpr const size_t BUFFER_NBYTES = 4 * 1024 * 1024;
+
+private:
+  struct Shard {
+    std::string path;
+    std::unique_ptr<std::ofstream> out;
+    std::string buffer;
+    dr::DocIndex index;
+    unsigned int thread;
+  };
+
+  using Chunk = std::pair<Shard *, std::string>;
+
+  const bool _write_index;
+  std::vector<std::unique_ptr<Shard>> _shards;
+  std::vector<std::deque<Chunk>> _queues;
+  std::vector<std::string> _free;
+  std::vector<std::thread> _threads;
+  size_t _npending;
+  size_t _max_npending;
+  bool _done;
+  std::exception_ptr _error;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+
+  static void
+  _write(Shard &shard, const std::string &bytes) {
+    if (!shard.out->write(bytes.data(), bytes.size()))
+      throw schwa::IOException("Failed to write to the shard", shard.path);
+  }
+
+  void
+  _flush(Shard &shard) {
+    if (shard.buffer.empty())
+      return;
+    if (_threads.empty()) {
+      _write(shard, shard.buffer);
+      shard.buffer.clear();
+      return;
+    }
+
+    // Wait for the writers to catch up if too many buffers are queued, bounding memory usage.
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [&](void) { return _error || _npending < _max_npending; });
+    if (_error)
+      std::rethrow_exception(_error);
+
+    // Queue up the buffer and replace it with a recycled one.
+    _queues[shard.thread].emplace_back(&shard, std::string());
+    std::swap(_queues[shard.thread].back().second, shard.buffer);
+    if (!_free.empty()) {
+      std::swap(shard.buffer, _free.back());
+      _free.pop_back();
+    }
+    ++_npending;
+    _cv.notify_all();
+  }
+
+  void
+  _work(const unsigned int thread) {
+    std::deque<Chunk> &queue = _queues[thread];
+    while (true) {
+      Chunk chunk;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&](void) { return _error || _done || !queue.empty(); });
+        if (_error || queue.empty())
+          return;
+        chunk.first = queue.front().first;
+        std::swap(chunk.second, queue.front().second);
+        queue.pop_front();
+      }
+
+      _write(*chunk.first, chunk.second);
+
+      std::lock_guard<std::mutex> lock(_mutex);
+      chunk.second.clear();
+      _free.push_back(std::move(chunk.second));
+      --_npending;
+      _cv.notify_all();
+    }
+  }
+
+  void
+  _stop(void) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _done = true;
+      _cv.notify_all();
+    }
+    for (auto &thread : _threads)
+      thread.join();
+    _threads.clear();
+  }
+
+public:
+  ShardWriter(const std::string &pattern, const unsigned int nshards, const unsigned int nthreads, const bool write_index) :
+      _write_index(write_index),
+      _npending(0),
+      _max_npending(0),
+      _done(false) {
+    const unsigned int nwriters = nthreads <= 1 ? 0 : std::min(nthreads, nshards);
+    for (unsigned int i = 0; i != nshards; ++i) {
+      _shards.emplace_back(new Shard());
+      Shard &shard = *_shards.back();
+      shard.path = shard_path(pattern, i);
+      shard.out.reset(io::safe_open_ofstream(shard.path));
+      shard.thread = nwriters == 0 ? 0 : i % nwriters;
+    }
+
+    // Allow each writer to have a buffer in progress and one queued up.
+    _queues.resize(nwriters);
+    _max_npending = 2*nwriters;
+    for (unsigned int i = 0; i != nwriters; ++i)
+      _threads.push_back(std::thread([this, i](void) {
+        try {
+          _work(i);
+        }
+        catch (...) {
+          std::lock_guard<std::mutex> lock(_mutex);
+          if (!_error)
+            _error = std::current_exception();
+          _cv.notify_all();
+        }
+      }));
+  }
+
+  ~ShardWriter(void) {
+    _stop();
+  }
+
+  /** Appends the framed document in \p data to shard \p shard. */
+  void
+  add(const unsigned int shard_num, const char *const data, const size_t nbytes) {
+    Shard &shard = *_shards[shard_num];
+    shard.buffer.append(data, nbytes);
+    shard.index.add(nbytes);
+    if (shard.buffer.size() >= BUFFER_NBYTES)
+      _flush(shard);
+  }
+
+  /** Writes out everything which is still buffered, closes the shards, and writes their indexes. */
+  void
+  finish(void) {
+    for (auto &shard : _shards)
+      _flush(*shard);
+    _stop();
+    if (_error)
+      std::rethrow_exception(_error);
+
+    for (auto &shard : _shards) {
+      shard->out->close();
+      if (shard->out->fail())
+        throw schwa::IOException("Failed to write to the shard", shard->path);
+      finish_index(shard->path, shard->index, _write_index);
+    }
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(ShardWriter);
+};
+
+
+static void
+main_stream(std::istream &input, ShardWriter &writer, const Strategy strategy, const unsigned int nshards, const uint64_t block_ndocs, const std::string &key) {
+  // Construct a docrep reader and the interpreter for the key expression, which are only used
+  // when hashing. Otherwise the documents are never decoded.
+  dr::FauxDoc doc;
+  dr::FauxDoc::Schema schema;
+  dr::Reader reader(schema);
+  dq::Interpreter interpreter;
+  if (strategy == Strategy::HASH)
+    interpreter.compile(key);
+
+  // Frame each document once and append its raw bytes to its shard.
+  std::string frame;
+  for (uint64_t doc_num = 0; dr::read_lazy_doc(input, frame); ++doc_num) {
+    unsigned int shard = 0;
+    switch (strategy) {
+    case Strategy::ROUND_ROBIN:
+      shard = doc_num % nshards;
+      break;
+    case Strategy::BLOCKS:
+      shard = std::min<uint64_t>(doc_num / block_ndocs, nshards - 1);
+      break;
+    case Strategy::HASH:
+      reader.read(doc, frame.data(), frame.size());
+      shard = hash_value(interpreter(doc, doc_num)) % nshards;
+      break;
+    }
+    writer.add(shard, frame.data(), frame.size());
+  }
+  writer.finish();
+}
+
+
+static void
+main_blocks_mmapped(const std::string &input_path, const std::string &pattern, const unsigned int nshards, uint64_t block_ndocs, const bool write_index) {
+  // Locate each of the documents, using the sidecar index if there is one.
+  io::MMappedSource source(input_path.c_str());
+  dr::DocIndex index;
+  if (!index.load_sidecar(input_path, source.size()))
+    index.build(source.data(), source.size());
+
+  // Without a block size, the documents are split evenly between the shards.
+  if (block_ndocs == 0)
+    block_ndocs = std::max<uint64_t>(1, (index.ndocs() + nshards - 1) / nshards);
+
+  // Each shard is a contiguous range of the input, so it is copied straight from the input file.
+  for (unsigned int shard = 0; shard != nshards; ++shard) {
+    const size_t first = std::min<uint64_t>(shard*block_ndocs, index.ndocs());
+    const size_t last = (shard + 1 == nshards) ? index.ndocs() : std::min<uint64_t>((shard + 1)*block_ndocs, index.ndocs());
+    const std::string path = shard_path(pattern, shard);
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+      throw schwa::IOException(errno, path);
+    {
+      io::RangeCopier copier(input_path, fd);
+      copier.copy(index.offset(first), index.offset(last) - index.offset(first));
+    }
+
+    dr::DocIndex shard_index;
+    for (size_t doc = first; doc != last; ++doc)
+      shard_index.add(index.nbytes(doc));
+    finish_index(path, shard_index, write_index);
+  }
+}
+
+
+static void
+main(std::istream &input, const std::string &input_path, const std::string &pattern, const unsigned int nshards, const Strategy strategy, const uint64_t block_ndocs, const std::string &key, const bool write_index, const unsigned int nthreads) {
+  if (pattern.find(SHARD_PLACEHOLDER) == std::string::npos)
+    throw cf::ConfigException("The output pattern must contain \"{}\", which is replaced by the shard number");
+  if (nshards == 0)
+    throw cf::ConfigException("The number of shards must be positive");
+  if (strategy == Strategy::HASH && key.empty())
+    throw cf::ConfigException("Sharding by hash requires a key expression");
+
+  const bool can_mmap = input_path != cf::OpIStream::STDIN_STRING && io::MMappedSource::can_mmap(input_path.c_str());
+  if (strategy == Strategy::BLOCKS && can_mmap)
+    main_blocks_mmapped(input_path, pattern, nshards, block_ndocs, write_index);
+  else if (strategy == Strategy::BLOCKS && block_ndocs == 0)
+    throw cf::ConfigException("Splitting a stream into blocks requires a block size, as the number of documents is not known up front");
+  else {
+    ShardWriter writer(pattern, nshards, nthreads, write_index);
+    main_stream(input, writer, strategy, nshards, block_ndocs, key);
+  }
+}
+
+}  // namespace
+
+
+int
+main(int argc, char **argv) {
+  // Construct an option parser.
+  cf::Main cfg("dr-shard", "Splits a docrep stream into a number of shards.");
+  cf::OpIStream input(cfg, "input", 'i', "The input file");
+  cf::Op<std::string> output(cfg, "output", 'o', "The path pattern for the shards, in which {} is replaced by the shard number", "shard-{}.dr");
+  cf::Op<unsigned int> nshards(cfg, "nshards", 'n', "The number of shards to split the input into");
+  cf::OpChoices<std::string> strategy(cfg, "strategy", 's', "How documents are assigned to shards", {"round-robin", "blocks", "hash"}, "round-robin");
+  cf::Op<std::string> key(cfg, "key", 'k', "The expression whose value is hashed to choose the shard when using the hash strategy (e.g. doc.id)", cf::Flags::OPTIONAL);
+  cf::Op<uint64_t> block_size(cfg, "block-size", 'b', "The number of documents in each block when using the blocks strategy. Defaults to an even split, which requires the input to be a regular file", cf::Flags::OPTIONAL);
+  cf::Op<bool> index(cfg, "index", 'x', "Write a sidecar index of the document offsets alongside each shard", false);
+  cf::Op<unsigned int> nthreads(cfg, "nthreads", 'j', "The number of threads to write the shards with", 1);
+
+  // Parse argv.
+  input.position_arg_precedence(0);
+  cfg.main<io::PrettyLogger>(argc, argv);
+
+  // Construct the strategy enum value.
+  Strategy strategy_ = Strategy::ROUND_ROBIN;
+  if (strategy() == "blocks")
+    strategy_ = Strategy::BLOCKS;
+  else if (strategy() == "hash")
+    strategy_ = Strategy::HASH;
+
+  // Dispatch to main function.
+  try {
+    main(input.file(), input(), output(), nshards(), strategy_, block_size.was_assigned() ? block_size() : 0, key(), index(), nthreads());
+  }
+  catch (schwa::Exception &e) {
+    std::cerr << schwa::print_exception(e) << std::endl;
+    return 1;
+  }
+  return 0;
+}
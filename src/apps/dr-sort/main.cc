@@ -0,0 +1,57 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <schwa/config.h>
+#include <schwa/io/logging.h>
+
+#include "sorter.h"
+
+namespace cf = schwa::config;
+namespace io = schwa::io;
+
+
+namespace {
+
+static void
+main(std::istream &input, std::ostream &output, const std::string &key, const bool reverse, const uint64_t buffer_mb, std::string tmp_dir, const unsigned int nthreads) {
+  if (tmp_dir.empty()) {
+    const char *const env = std::getenv("TMPDIR");
+    tmp_dir = (env != nullptr && *env != '\0') ? env : "/tmp";
+  }
+
+  schwa::dr_sort::Sorter sorter(key, reverse, buffer_mb * 1024 * 1024, tmp_dir, nthreads);
+  sorter.sort(input, output);
+}
+
+}  // namespace
+
+
+int
+main(int argc, char **argv) {
+  // Construct an option parser.
+  cf::Main cfg("dr-sort", "Sorts the documents in a docrep stream by the value of an expression.");
+  cf::OpIStream input(cfg, "input", 'i', "The input file");
+  cf::OpOStream output(cfg, "output", 'o', "The output file");
+  cf::Op<std::string> key(cfg, "key", 'k', "The expression to sort the documents by (e.g. doc.id)");
+  cf::Op<bool> reverse(cfg, "reverse", 'r', "Sort in descending order of the key", false);
+  cf::Op<uint64_t> buffer_size(cfg, "buffer-size", 'S', "The number of megabytes of documents to hold in memory at once. Larger inputs are sorted in runs which are merged via temporary files", 512);
+  cf::Op<std::string> tmp_dir(cfg, "tmp-dir", 'T', "The directory to write the temporary files to. Defaults to $TMPDIR or /tmp", cf::Flags::OPTIONAL);
+  cf::Op<unsigned int> nthreads(cfg, "nthreads", 'j', "The number of threads to sort runs with", 1);
+
+  // Parse argv.
+  key.position_arg_precedence(0);
+  input.position_arg_precedence(1);
+  cfg.main<io::PrettyLogger>(argc, argv);
+
+  // Dispatch to main function.
+  try {
+    main(input.file(), output.file(), key(), reverse(), buffer_size(), tmp_dir(), nthreads());
+  }
+  catch (schwa::Exception &e) {
+    std::cerr << schwa::print_exception(e) << std::endl;
+    return 1;
+  }
+  return 0;
+}
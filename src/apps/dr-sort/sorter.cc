@@ -0,0 +1,430 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include "sorter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>  // close, mkstemp
+
+#include <schwa/dr.h>
+#include <schwa/dr/sort_key.h>
+#include <schwa/exception.h>
+#include <schwa/io/logging.h>
+
+namespace dr = schwa::dr;
+namespace dq = schwa::dr::query;
+
+
+namespace schwa {
+namespace dr_sort {
+
+// ============================================================================
+// Run
+// ============================================================================
+/**
+ * A run of framed documents read off the input, stored back to back in a single buffer, along
+ * with the key and location of each document.
+ **/
+class Run {
+public:
+  struct Entry {
+    dq::SortKey key;
+    size_t offset;
+    size_t nbytes;
+  };
+
+  uint64_t seq;
+  uint64_t first_doc_num;
+  std::string bytes;
+  std::vector<Entry> entries;
+
+  Run(void) : seq(0), first_doc_num(0) { }
+
+  inline void
+  clear(void) {
+    bytes.clear();
+    entries.clear();
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(Run);
+};
+
+
+// ============================================================================
+// TempFile
+// ============================================================================
+/** A uniquely named temporary file which is removed when the object is destroyed. */
+class TempFile {
+private:
+  std::string _path;
+
+public:
+  explicit TempFile(const std::string &dir) {
+    std::string path = dir + "/dr-sort-XXXXXX";
+    const int fd = ::mkstemp(&path[0]);
+    if (fd == -1)
+      throw IOException(errno, path);
+    ::close(fd);
+    _path = path;
+  }
+
+  ~TempFile(void) {
+    std::remove(_path.c_str());
+  }
+
+  inline const std::string &path(void) const { return _path; }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(TempFile);
+};
+
+
+/** Reads back the keys and framed documents of a run written to a temporary file. */
+class RunReader {
+public:
+  static constexpr const size_t BUFFER_NBYTES = 256 * 1024;
+
+private:
+  std::unique_ptr<char[]> _buffer;
+  std::ifstream _in;
+
+public:
+  dq::SortKey key;
+  std::string frame;
+
+  explicit RunReader(const std::string &path) : _buffer(new char[BUFFER_NBYTES]) {
+    _in.rdbuf()->pubsetbuf(_buffer.get(), BUFFER_NBYTES);
+    _in.open(path, std::ios::in | std::ios::binary);
+    if (!_in.is_open())
+      throw IOException("Could not open file for reading", path);
+  }
+
+  inline bool next(void) { return key.read(_in) && dr::read_lazy_doc(_in, frame); }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(RunReader);
+};
+
+
+// ============================================================================
+// Sorter::Impl
+// ============================================================================
+class Sorter::Impl {
+private:
+  static constexpr const size_t MIN_RUN_NBYTES = 1024 * 1024;
+
+  const std::string _key;
+  const bool _reverse;
+  const uint64_t _buffer_nbytes;
+  const std::string _tmp_dir;
+  const unsigned int _nthreads;
+
+  std::vector<std::unique_ptr<Run>> _runs;
+  std::vector<Run *> _free;
+  std::deque<Run *> _todo;
+  std::vector<std::unique_ptr<TempFile>> _run_files;
+  bool _done_reading;
+  bool _failed;
+  std::exception_ptr _error;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+
+  inline int
+  _compare(const dq::SortKey &a, const dq::SortKey &b) const {
+    return _reverse ? b.compare(a) : a.compare(b);
+  }
+
+  void _fail(void);
+  bool _fill(std::istream &in, Run &run, uint64_t first_doc_num, size_t run_nbytes);
+  void _generate_runs(std::istream &in, Run *first, size_t run_nbytes);
+  void _merge(size_t begin, size_t end, const std::vector<std::unique_ptr<TempFile>> &files, std::ostream &out, bool with_keys);
+  void _sort_run(Run &run, dq::SortKeyExtractor &extractor);
+  void _work(void);
+  void _write_run(const Run &run, std::ostream &out, bool with_keys);
+
+public:
+  Impl(const std::string &key, bool reverse, uint64_t buffer_nbytes, const std::string &tmp_dir, unsigned int nthreads);
+
+  void sort(std::istream &in, std::ostream &out);
+};
+
+
+Sorter::Impl::Impl(const std::string &key, const bool reverse, const uint64_t buffer_nbytes, const std::string &tmp_dir, const unsigned int nthreads) :
+    _key(key),
+    _reverse(reverse),
+    _buffer_nbytes(buffer_nbytes),
+    _tmp_dir(tmp_dir),
+    _nthreads(std::max(1u, nthreads)),
+    _done_reading(false),
+    _failed(false)
+  { }
+
+
+void
+Sorter::Impl::_fail(void) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_failed) {
+    _error = std::current_exception();
+    _failed = true;
+  }
+  _cv.notify_all();
+}
+
+
+/**
+ * Reads framed documents off \p in into \p run until it holds at least \p run_nbytes bytes.
+ * Returns false once the end of the input has been reached.
+ **/
+bool
+Sorter::Impl::_fill(std::istream &in, Run &run, const uint64_t first_doc_num, const size_t run_nbytes) {
+  run.clear();
+  run.first_doc_num = first_doc_num;
+  std::string frame;
+  while (run.bytes.size() < run_nbytes) {
+    if (!dr::read_lazy_doc(in, frame))
+      return false;
+    run.entries.push_back(Run::Entry());
+    run.entries.back().offset = run.bytes.size();
+    run.entries.back().nbytes = frame.size();
+    run.bytes.append(frame);
+  }
+  return true;
+}
+
+
+void
+Sorter::Impl::_sort_run(Run &run, dq::SortKeyExtractor &extractor) {
+  for (size_t i = 0; i != run.entries.size(); ++i) {
+    Run::Entry &entry = run.entries[i];
+    extractor(run.bytes.data() + entry.offset, entry.nbytes, run.first_doc_num + i, entry.key);
+  }
+  std::stable_sort(run.entries.begin(), run.entries.end(), [&](const Run::Entry &a, const Run::Entry &b) {
+    return _compare(a.key, b.key) < 0;
+  });
+}
+
+
+void
+Sorter::Impl::_write_run(const Run &run, std::ostream &out, const bool with_keys) {
+  for (const auto &entry : run.entries) {
+    if (with_keys)
+      entry.key.write(out);
+    out.write(run.bytes.data() + entry.offset, entry.nbytes);
+  }
+}
+
+
+void
+Sorter::Impl::_work(void) {
+  dq::SortKeyExtractor extractor(_key);
+  while (true) {
+    // Wait for a run to sort.
+    Run *run;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cv.wait(lock, [&](void) { return _failed || _done_reading || !_todo.empty(); });
+      if (_failed || _todo.empty())
+        return;
+      run = _todo.front();
+      _todo.pop_front();
+    }
+
+    // Sort the run and write it out to its own temporary file.
+    _sort_run(*run, extractor);
+    std::unique_ptr<TempFile> file(new TempFile(_tmp_dir));
+    {
+      std::ofstream out(file->path(), std::ios::out | std::ios::binary);
+      _write_run(*run, out, true);
+      out.close();
+      if (out.fail())
+        throw IOException("Failed to write the temporary file", file->path());
+    }
+
+    // Recycle the run.
+    std::lock_guard<std::mutex> lock(_mutex);
+    _run_files[run->seq] = std::move(file);
+    run->clear();
+    _free.push_back(run);
+    _cv.notify_all();
+  }
+}
+
+
+/**
+ * Reads the rest of the input into runs which are sorted and written out to temporary files by the
+ * worker threads, starting with the already read run \p first. Each worker can have a run in
+ * progress while the next run is being read.
+ **/
+void
+Sorter::Impl::_generate_runs(std::istream &in, Run *const first, const size_t run_nbytes) {
+  for (unsigned int i = 0; i != _nthreads; ++i) {
+    _runs.emplace_back(new Run());
+    _free.push_back(_runs.back().get());
+  }
+  first->seq = 0;
+  _run_files.emplace_back();
+  _todo.push_back(first);
+
+  const auto work = [&](void) {
+    try {
+      _work();
+    }
+    catch (...) {
+      _fail();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i != _nthreads; ++i)
+    threads.push_back(std::thread(work));
+
+  try {
+    uint64_t doc_num = first->first_doc_num + first->entries.size();
+    for (bool more = true; more; ) {
+      // Wait for an empty run to become available.
+      Run *run;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&](void) { return _failed || !_free.empty(); });
+        if (_failed)
+          break;
+        run = _free.back();
+        _free.pop_back();
+      }
+
+      more = _fill(in, *run, doc_num, run_nbytes);
+      doc_num += run->entries.size();
+
+      // Hand the run over to the workers.
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (run->entries.empty())
+        _free.push_back(run);
+      else {
+        run->seq = _run_files.size();
+        _run_files.emplace_back();
+        _todo.push_back(run);
+      }
+      _cv.notify_all();
+    }
+  }
+  catch (...) {
+    _fail();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _done_reading = true;
+    _cv.notify_all();
+  }
+  for (auto &thread : threads)
+    thread.join();
+  if (_error)
+    std::rethrow_exception(_error);
+}
+
+
+/**
+ * k-way merges the runs in \p files[begin, end) into \p out. Ties are broken by the order of the
+ * runs, which keeps documents with equal keys in their input order.
+ **/
+void
+Sorter::Impl::_merge(const size_t begin, const size_t end, const std::vector<std::unique_ptr<TempFile>> &files, std::ostream &out, const bool with_keys) {
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (size_t i = begin; i != end; ++i)
+    readers.emplace_back(new RunReader(files[i]->path()));
+
+  const auto greater = [&](const size_t a, const size_t b) {
+    const int cmp = _compare(readers[a]->key, readers[b]->key);
+    return cmp == 0 ? a > b : cmp > 0;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+  for (size_t i = 0; i != readers.size(); ++i)
+    if (readers[i]->next())
+      heap.push(i);
+
+  while (!heap.empty()) {
+    const size_t i = heap.top();
+    heap.pop();
+    RunReader &reader = *readers[i];
+    if (with_keys)
+      reader.key.write(out);
+    out.write(reader.frame.data(), reader.frame.size());
+    if (reader.next())
+      heap.push(i);
+  }
+}
+
+
+void
+Sorter::Impl::sort(std::istream &in, std::ostream &out) {
+  // The memory budget is split between the run being read and the runs being sorted.
+  const size_t run_nbytes = std::max<uint64_t>(MIN_RUN_NBYTES, _buffer_nbytes / (_nthreads + 1));
+
+  // If the whole input fits into the first run, it is sorted in memory without temporary files.
+  _runs.emplace_back(new Run());
+  Run *const first = _runs.back().get();
+  if (!_fill(in, *first, 0, run_nbytes)) {
+    dq::SortKeyExtractor extractor(_key);
+    _sort_run(*first, extractor);
+    _write_run(*first, out, false);
+    return;
+  }
+
+  _generate_runs(in, first, run_nbytes);
+  _runs.clear();
+  _free.clear();
+  LOG(DEBUG) << "Sorted " << _run_files.size() << " runs" << std::endl;
+
+  // Merge the runs, in multiple passes if there are too many to have open at once. Consecutive
+  // runs are merged together so that the runs stay in input order.
+  std::vector<std::unique_ptr<TempFile>> files;
+  std::swap(files, _run_files);
+  while (files.size() > MAX_MERGE_NRUNS) {
+    std::vector<std::unique_ptr<TempFile>> merged;
+    for (size_t begin = 0; begin < files.size(); begin += MAX_MERGE_NRUNS) {
+      std::unique_ptr<TempFile> file(new TempFile(_tmp_dir));
+      std::ofstream tmp(file->path(), std::ios::out | std::ios::binary);
+      _merge(begin, std::min(begin + MAX_MERGE_NRUNS, files.size()), files, tmp, true);
+      tmp.close();
+      if (tmp.fail())
+        throw IOException("Failed to write the temporary file", file->path());
+      merged.push_back(std::move(file));
+    }
+    std::swap(files, merged);
+  }
+  _merge(0, files.size(), files, out, false);
+}
+
+
+// ============================================================================
+// Sorter
+// ============================================================================
+Sorter::Sorter(const std::string &key, const bool reverse, const uint64_t buffer_nbytes, const std::string &tmp_dir, const unsigned int nthreads) :
+    _impl(new Impl(key, reverse, buffer_nbytes, tmp_dir, nthreads))
+  { }
+
+Sorter::~Sorter(void) {
+  delete _impl;
+}
+
+void
+Sorter::sort(std::istream &in, std::ostream &out) {
+  _impl->sort(in, out);
+}
+
+}  // namespace dr_sort
+}  // namespace schwa
@@ -0,0 +1,45 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_DRSORT_SORTER_H_
+#define SCHWA_DRSORT_SORTER_H_
+
+#include <iosfwd>
+#include <string>
+
+#include <schwa/_base.h>
+
+
+namespace schwa {
+  namespace dr_sort {
+
+    /**
+     * Sorts the documents of a docrep stream by the value of a dr-query key expression using a
+     * bounded amount of memory. The input is read in runs of framed documents; each run has its
+     * keys extracted and is sorted on a worker thread, and is then written to a temporary file
+     * along with the keys. The runs are then k-way merged into the output. Documents are never
+     * re-serialised, and documents with equal keys keep their input order.
+     *
+     * Keys which are missing sort before integers, which sort before strings.
+     **/
+    class Sorter {
+    public:
+      static constexpr const size_t MAX_MERGE_NRUNS = 128;
+
+    private:
+      class Impl;
+
+      Impl *_impl;
+
+    public:
+      Sorter(const std::string &key, bool reverse, uint64_t buffer_nbytes, const std::string &tmp_dir, unsigned int nthreads);
+      ~Sorter(void);
+
+      void sort(std::istream &in, std::ostream &out);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(Sorter);
+    };
+
+  }
+}
+
+#endif  // SCHWA_DRSORT_SORTER_H_
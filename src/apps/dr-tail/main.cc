@@ -1,11 +1,15 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
 #include <iostream>
-#include <memory>
-#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <schwa/config.h>
+#include <schwa/dr/doc_index.h>
 #include <schwa/dr/reader.h>
 #include <schwa/io/logging.h>
+#include <schwa/io/mmapped_source.h>
+#include <schwa/io/range_copier.h>
 
 namespace cf = schwa::config;
 namespace dr = schwa::dr;
@@ -15,24 +19,17 @@ namespace io = schwa::io;
 namespace {
 
 static void
-main(std::istream &input, std::ostream &output, const uint32_t count) {
+main_stream(std::istream &input, std::ostream &output, const uint32_t count) {
   // Allocate a circular array to store the last `count` docs in.
-  std::unique_ptr<std::stringstream[]> bufs(new std::stringstream[count]);
+  std::vector<std::string> bufs(count);
   size_t bufs_upto = 0;
 
-  // Read the documents off the input stream into the circular array.
+  // Read the documents off the input stream into the circular array. Each document is read into
+  // temp storage and then swapped into place, so no bytes are copied and the buffers are reused.
   uint32_t nread = 0;
-  while (true) {
-    // Attempt to read the next document into temp storage.
-    std::stringstream tmp;
-    if (!dr::read_lazy_doc(input, tmp))
-      break;
-
-    // Move the read in data into the next buffer element, and increment the counts.
-    // XXX Annoyingly, libstdc++ (gcc) hasn't implemented move semantics for iostreams yet.
-    // XXX bufs[bufs_upto].swap(tmp);
-    bufs[bufs_upto].str(tmp.str());
-    bufs[bufs_upto].clear();
+  std::string tmp;
+  while (dr::read_lazy_doc(input, tmp)) {
+    std::swap(bufs[bufs_upto], tmp);
     bufs_upto = (bufs_upto + 1) % count;
     ++nread;
   }
@@ -41,16 +38,44 @@ main(std::istream &input, std::ostream &output, const uint32_t count) {
   if (nread < count)
     bufs_upto = 0;
   for (uint32_t i = 0; i != std::min(nread, count); ++i) {
-    // Rewind the temp storage and write it out.
-    std::stringstream &tmp = bufs[bufs_upto];
-    tmp.seekp(0);
-    output << tmp.rdbuf();
-
-    // Go to the next element in the circular array.
+    output.write(bufs[bufs_upto].data(), bufs[bufs_upto].size());
     bufs_upto = (bufs_upto + 1) % count;
   }
 }
 
+
+static void
+main_mmapped(const std::string &path, const cf::OpOStream &output, const uint32_t count) {
+  io::MMappedSource source(path.c_str());
+
+  // Locate the start of the last `count` docs, using the sidecar index if there is one, otherwise
+  // by scanning backwards from the end of the file. Only if that fails is every document framed.
+  size_t offset;
+  dr::DocIndex index;
+  if (index.load_sidecar(path, source.size()))
+    offset = index.offset(index.ndocs() - std::min<size_t>(count, index.ndocs()));
+  else if (!dr::find_tail_offset(source.data(), source.size(), count, offset)) {
+    LOG(WARNING) << "Failed to find the document boundaries by scanning backwards. Framing the documents from the start instead." << std::endl;
+    index.build(source.data(), source.size());
+    offset = index.offset(index.ndocs() - std::min<size_t>(count, index.ndocs()));
+  }
+
+  // The last `count` docs are contiguous, so they are copied straight from the input file.
+  io::RangeCopier copier(path, output.dup_fd());
+  copier.copy(offset, source.size() - offset);
+}
+
+
+static void
+main(std::istream &input, const std::string &input_path, const cf::OpOStream &output, const uint32_t count) {
+  if (count == 0)
+    return;
+  if (input_path != cf::OpIStream::STDIN_STRING && io::MMappedSource::can_mmap(input_path.c_str()))
+    main_mmapped(input_path, output, count);
+  else
+    main_stream(input, output.file(), count);
+}
+
 }  // namespace
 
 
@@ -68,7 +93,7 @@ main(int argc, char **argv) {
 
   // Dispatch to main function.
   try {
-    main(input.file(), output.file(), count());
+    main(input.file(), input(), output, count());
   }
   catch (schwa::Exception &e) {
     std::cerr << schwa::print_exception(e) << std::endl;
@@ -1,13 +1,18 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
 #include <schwa/config/op.h>
 
+#include <cerrno>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
+#include <fcntl.h>   // open
+#include <unistd.h>  // dup, lseek
+
 #include <schwa/config/exception.h>
 #include <schwa/config/group.h>
 #include <schwa/config/main.h>
+#include <schwa/exception.h>
 #include <schwa/io/utils.h>
 #include <schwa/version.h>
 
@@ -144,6 +149,30 @@ OpOStream::_validate(const Main &) {
 }
 
 
+int
+OpOStream::dup_fd(void) const {
+  _out->flush();
+  int fd;
+  if (_value == STDOUT_STRING)
+    fd = ::dup(STDOUT_FILENO);
+  else if (_value == STDERR_STRING)
+    fd = ::dup(STDERR_FILENO);
+  else {
+    // The file was already created (and truncated) when the stream was opened. It is not opened
+    // with O_APPEND as some of the kernel copying functions refuse to write to such files.
+    fd = ::open(_value.c_str(), O_WRONLY);
+    if (fd != -1 && ::lseek(fd, 0, SEEK_END) == -1) {
+      const int err = errno;
+      ::close(fd);
+      throw IOException(err, _value);
+    }
+  }
+  if (fd == -1)
+    throw IOException(errno, _value);
+  return fd;
+}
+
+
 // ============================================================================
 // OpLogLevel
 // ============================================================================
@@ -141,6 +141,13 @@ namespace schwa {
 
       inline std::ostream &file(void) const { return *_out; }
 
+      /**
+       * Flushes the output stream and returns a new file descriptor for the output, positioned
+       * after anything already written, so that the output can be written to directly by system
+       * calls. The caller is responsible for closing the returned file descriptor.
+       **/
+      int dup_fd(void) const;
+
     private:
       SCHWA_DISALLOW_COPY_AND_ASSIGN(OpOStream);
     };
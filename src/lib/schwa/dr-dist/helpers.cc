@@ -1,17 +1,23 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
 #include <schwa/dr-dist/helpers.h>
 
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <sstream>
 
+#include <schwa/dr/reader.h>
 #include <schwa/io/array_reader.h>
+#include <schwa/dr/writer.h>
+#include <schwa/exception.h>
 #include <schwa/io/logging.h>
+#include <schwa/io/string_writer.h>
 #include <schwa/msgpack.h>
 #include <schwa/utils/enums.h>
 
 #include <zmq.h>
 
+namespace dr = schwa::dr;
 namespace io = schwa::io;
 namespace mp = schwa::msgpack;
 
@@ -19,6 +25,17 @@ namespace mp = schwa::msgpack;
 namespace schwa {
 namespace dr_dist {
 
+namespace {
+
+/** ØMQ free callback for message data owned by a heap allocated string. */
+static void
+free_string(void *, void *hint) {
+  delete static_cast<std::string *>(hint);
+}
+
+}  // namespace
+
+
 bool
 safe_zmq_close(void *const socket) {
   if (zmq_close(socket) == -1) {
@@ -121,6 +138,372 @@ unpack_message(const char *const buf, const size_t buf_len, MessageType &msg_typ
 }
 
 
+MessageType
+unpack_message_type(const char *const buf, const size_t buf_len) {
+  io::ArrayReader reader(buf, buf_len);
+  return from_underlying<MessageType>(mp::read_uint8(reader));
+}
+
+
+/**
+ * Reads the descriptor of a batch body held in a shared memory ring.
+ *
+ * <descriptor> ::= <ring_name> <offset> <nbytes> <end>
+ **/
+static void
+unpack_shared_body(const Message &msg, std::string &ring_name, uint64_t &offset, uint64_t &nbytes, uint64_t &end) {
+  io::ArrayReader reader(msg.data(1), msg.size(1));
+  ring_name = mp::read_raw(reader);
+  offset = mp::read_uint64(reader);
+  nbytes = mp::read_uint64(reader);
+  end = mp::read_uint64(reader);
+}
+
+
+bool
+unpack_batch(const Message &msg, std::vector<BatchDoc> &docs, SharedRings *const rings) {
+  docs.clear();
+  if (msg.nparts() != 2) {
+    LOG(ERROR) << "Expected a batch to have 2 message parts but found " << msg.nparts() << std::endl;
+    return false;
+  }
+
+  // A truncated or garbled header or descriptor makes the msgpack reads throw, and is treated like
+  // any other malformed batch.
+  try {
+    // <header> ::= <type> [ <doc_num> <nbytes> ... ]
+    // <body>   ::= <doc> ... | <descriptor>
+    io::ArrayReader reader(msg.data(0), msg.size(0));
+    const MessageType type = from_underlying<MessageType>(mp::read_uint8(reader));
+    const char *upto = msg.data(1);
+    size_t left = msg.size(1);
+    if (type == MessageType::DOCUMENT_BATCH_SHM) {
+      if (rings == nullptr) {
+        LOG(ERROR) << "Received a batch through shared memory without being set up for it" << std::endl;
+        return false;
+      }
+      std::string ring_name;
+      uint64_t offset, nbytes, end;
+      unpack_shared_body(msg, ring_name, offset, nbytes, end);
+      try {
+        const SharedRing &ring = rings->attach(ring_name);
+        if (end < nbytes || ring.tail() > end - nbytes || offset + nbytes > ring.capacity()) {
+          LOG(ERROR) << "The body of a batch in " << ring_name << " has already been released" << std::endl;
+          return false;
+        }
+        upto = ring.data(offset);
+        left = nbytes;
+      }
+      catch (IOException &e) {
+        LOG(ERROR) << "Failed to attach to shared memory: " << e.what() << std::endl;
+        return false;
+      }
+    }
+
+    const uint32_t ndocs = mp::read_array_size(reader);
+    if (ndocs > reader.left() / 2) {
+      LOG(ERROR) << "The batch header is shorter than the number of documents it claims" << std::endl;
+      return false;
+    }
+    docs.resize(ndocs);
+    for (uint32_t i = 0; i != ndocs; ++i) {
+      docs[i].doc_num = mp::read_uint64(reader);
+      docs[i].nbytes = mp::read_uint64(reader);
+      docs[i].data = upto;
+      if (docs[i].nbytes > left) {
+        LOG(ERROR) << "The batch body is shorter than the documents in its header" << std::endl;
+        docs.clear();
+        return false;
+      }
+      upto += docs[i].nbytes;
+      left -= docs[i].nbytes;
+    }
+  }
+  catch (mp::ReadException &e) {
+    LOG(ERROR) << "Failed to decode a batch: " << e.what() << std::endl;
+    docs.clear();
+    return false;
+  }
+  return true;
+}
+
+
+void
+release_batch(const Message &msg, SharedRings &rings) {
+  if (unpack_message_type(msg.data(0), msg.size(0)) != MessageType::DOCUMENT_BATCH_SHM || msg.nparts() != 2)
+    return;
+  std::string ring_name;
+  uint64_t offset, nbytes, end;
+  unpack_shared_body(msg, ring_name, offset, nbytes, end);
+  try {
+    rings.attach(ring_name).release(end);
+  }
+  catch (IOException &e) {
+    LOG(ERROR) << "Failed to attach to shared memory: " << e.what() << std::endl;
+  }
+}
+
+
+std::string
+build_claim(const uint64_t worker_id, const std::vector<BatchDoc> &docs) {
+  // <claim> ::= <type> <worker_id> [ <doc_num> ... ]
+  std::string msg;
+  io::StringWriter writer(msg);
+  mp::write_uint8(writer, to_underlying(MessageType::CLAIM));
+  mp::write_uint64(writer, worker_id);
+  mp::write_array_size(writer, docs.size());
+  for (const BatchDoc &doc : docs)
+    mp::write_uint64(writer, doc.doc_num);
+  return msg;
+}
+
+
+void
+unpack_claim(const char *const buf, const size_t buf_len, uint64_t &worker_id, std::vector<uint64_t> &doc_nums) {
+  io::ArrayReader reader(buf, buf_len);
+  mp::read_uint8(reader);
+  worker_id = mp::read_uint64(reader);
+  doc_nums.resize(mp::read_array_size(reader));
+  for (uint64_t &doc_num : doc_nums)
+    doc_num = mp::read_uint64(reader);
+}
+
+
+// ============================================================================
+// Message
+// ============================================================================
+Message::Message(void) : _nparts(0) { }
+
+
+Message::~Message(void) {
+  _close();
+  for (zmq_msg_t *part : _parts)
+    delete part;
+}
+
+
+void
+Message::_close(void) {
+  for (size_t i = 0; i != _nparts; ++i)
+    if (zmq_msg_close(_parts[i]) == -1)
+      LOG(CRITICAL) << "Failed to close ØMQ message: " << zmq_strerror(zmq_errno()) << std::endl;
+  _nparts = 0;
+}
+
+
+const char *
+Message::data(const size_t part) const {
+  return static_cast<const char *>(zmq_msg_data(_parts[part]));
+}
+
+
+size_t
+Message::size(const size_t part) const {
+  return zmq_msg_size(_parts[part]);
+}
+
+
+bool
+Message::recv(void *const socket) {
+  _close();
+
+  int64_t more = 0;
+  size_t more_size = sizeof(more);
+  do {
+    if (_nparts == _parts.size())
+      _parts.push_back(new zmq_msg_t);
+    zmq_msg_t *const part = _parts[_nparts];
+    if (zmq_msg_init(part) == -1) {
+      LOG(CRITICAL) << "Failed to init ØMQ message: " << zmq_strerror(zmq_errno()) << std::endl;
+      return false;
+    }
+    ++_nparts;
+
+    // Block until a message part is available.
+    if (zmq_msg_recv(part, socket, 0) == -1) {
+      LOG(CRITICAL) << "Failed to zmq_msg_recv: " << zmq_strerror(zmq_errno()) << std::endl;
+      return false;
+    }
+
+    // Determine if there are any more parts to this message.
+    if (zmq_getsockopt(socket, ZMQ_RCVMORE, &more, &more_size) == -1) {
+      LOG(CRITICAL) << "Failed to zmq_getsockopt ZMQ_RCVMORE: " << zmq_strerror(zmq_errno()) << std::endl;
+      return false;
+    }
+  } while (more);
+
+  return true;
+}
+
+
+// ============================================================================
+// Batch
+// ============================================================================
+Batch::Batch(void) : _body(new std::string()), _ndocs(0), _ring(nullptr), _ring_end(0) { }
+
+
+Batch::~Batch(void) {
+  delete _body;
+}
+
+
+void
+Batch::_added(const uint64_t doc_num, const size_t nbytes) {
+  if (_ndocs == 0)
+    _started = std::chrono::steady_clock::now();
+  io::StringWriter writer(_entries);
+  mp::write_uint64(writer, doc_num);
+  mp::write_uint64(writer, nbytes);
+  ++_ndocs;
+}
+
+
+void
+Batch::add(const uint64_t doc_num, const char *const doc, const size_t doc_len) {
+  _body->append(doc, doc_len);
+  _added(doc_num, doc_len);
+}
+
+
+void
+Batch::add(const uint64_t doc_num, const dr::Doc &doc, dr::Writer &writer) {
+  const size_t offset = _body->size();
+  writer.write(doc, *_body);
+  _added(doc_num, _body->size() - offset);
+}
+
+
+bool
+Batch::read(const uint64_t doc_num, std::istream &in) {
+  const size_t offset = _body->size();
+  if (!dr::append_lazy_doc(in, *_body))
+    return false;
+  _added(doc_num, _body->size() - offset);
+  return true;
+}
+
+
+void
+Batch::clear(void) {
+  _entries.clear();
+  _body->clear();
+  _ndocs = 0;
+}
+
+
+bool
+Batch::_send_shared(void *const socket, const uint64_t offset) {
+  // <header>     ::= <type> [ <doc_num> <nbytes> ... ]
+  // <descriptor> ::= <ring_name> <offset> <nbytes> <end>
+  _header.clear();
+  io::StringWriter writer(_header);
+  mp::write_uint8(writer, to_underlying(MessageType::DOCUMENT_BATCH_SHM));
+  mp::write_array_size(writer, _ndocs);
+  _header.append(_entries);
+  bool success = safe_zmq_send(socket, _header.c_str(), _header.size(), ZMQ_SNDMORE);
+
+  std::string descriptor;
+  io::StringWriter descriptor_writer(descriptor);
+  mp::write_raw(descriptor_writer, _ring->name());
+  mp::write_uint64(descriptor_writer, offset);
+  mp::write_uint64(descriptor_writer, _body->size());
+  mp::write_uint64(descriptor_writer, _ring_end);
+  success &= safe_zmq_send(socket, descriptor.c_str(), descriptor.size(), 0);
+  clear();
+  return success;
+}
+
+
+bool
+Batch::send(void *const socket) {
+  // Send the body through the shared memory ring if there is room for it in there.
+  _ring_end = 0;
+  uint64_t offset;
+  if (_ring != nullptr && !_body->empty() && _ring->write(_body->data(), _body->size(), offset, _ring_end))
+    return _send_shared(socket, offset);
+
+  // <header> ::= <type> [ <doc_num> <nbytes> ... ]
+  _header.clear();
+  io::StringWriter writer(_header);
+  mp::write_uint8(writer, to_underlying(MessageType::DOCUMENT_BATCH));
+  mp::write_array_size(writer, _ndocs);
+  _header.append(_entries);
+  const bool success = safe_zmq_send(socket, _header.c_str(), _header.size(), ZMQ_SNDMORE);
+
+  // Hand the body over to ØMQ, which frees it once it has been sent, and start a new one.
+  std::string *const body = _body;
+  _body = new std::string();
+  _body->reserve(body->capacity());
+  clear();
+  if (!success) {
+    delete body;
+    return false;
+  }
+
+  zmq_msg_t msg;
+  if (zmq_msg_init_data(&msg, &(*body)[0], body->size(), free_string, body) == -1) {
+    LOG(CRITICAL) << "Failed to init ØMQ message: " << zmq_strerror(zmq_errno()) << std::endl;
+    delete body;
+    return false;
+  }
+  if (zmq_msg_send(&msg, socket, 0) == -1) {
+    LOG(CRITICAL) << "Failed to send: " << zmq_strerror(zmq_errno()) << std::endl;
+    zmq_msg_close(&msg);
+    return false;
+  }
+  return true;
+}
+
+
+// ============================================================================
+// Heartbeat
+// ============================================================================
+Heartbeat::Heartbeat(void *const context, const std::string &sink_addr, const uint64_t worker_id, const unsigned int interval_ms) :
+    _stop(false),
+    _thread(&Heartbeat::_run, this, context, sink_addr, worker_id, interval_ms)
+  { }
+
+
+Heartbeat::~Heartbeat(void) {
+  stop();
+  _thread.join();
+}
+
+
+void
+Heartbeat::stop(void) {
+  std::unique_lock<std::mutex> lock(_lock);
+  _stop = true;
+  _cv.notify_all();
+}
+
+
+void
+Heartbeat::_run(void *const context, const std::string &sink_addr, const uint64_t worker_id, const unsigned int interval_ms) {
+  void *sink;
+  if (!safe_zmq_socket_connect(context, sink, ZMQ_PUSH, sink_addr))
+    return;
+
+  const std::string msg = build_message(MessageType::HEARTBEAT, worker_id, nullptr, 0);
+  const std::chrono::milliseconds interval(interval_ms);
+  std::unique_lock<std::mutex> lock(_lock);
+  while (!_stop) {
+    // Never block on a heartbeat, as the sink may already have gone away.
+    if (zmq_send(sink, msg.c_str(), msg.size(), ZMQ_DONTWAIT) == -1 && zmq_errno() != EAGAIN) {
+      LOG(ERROR) << "Failed to send heartbeat: " << zmq_strerror(zmq_errno()) << std::endl;
+      break;
+    }
+    _cv.wait_for(lock, interval, [this](void){ return _stop; });
+  }
+  lock.unlock();
+
+  // Don't hold up closing the context with unsent heartbeats.
+  const int linger = 0;
+  zmq_setsockopt(sink, ZMQ_LINGER, &linger, sizeof(linger));
+  safe_zmq_close(sink);
+}
+
+
 bool
 recv_multipart(void *const socket, std::unique_ptr<char[]> &buffer, size_t &buffer_len, size_t &buffer_written) {
   int64_t more = 0;
@@ -146,13 +529,15 @@ recv_multipart(void *const socket, std::unique_ptr<char[]> &buffer, size_t &buff
       return false;
     }
 
-    // Increase the size of the buffer if required.
+    // Increase the size of the buffer if required, keeping the earlier parts of the message.
     if (static_cast<size_t>(nbytes) > buffer_left) {
       LOG(DEBUG) << "Increasing buffer size from " << buffer_len << " and adding " << nbytes << std::endl;
       const size_t used = buffer_len - buffer_left;
       buffer_len += nbytes;
       buffer_left += nbytes;
-      buffer.reset(new char[buffer_len]);
+      std::unique_ptr<char[]> grown(new char[buffer_len]);
+      std::memcpy(grown.get(), buffer.get(), used);
+      buffer.swap(grown);
       buffer_upto = buffer.get() + used;
     }
 
@@ -184,9 +569,18 @@ recv_multipart(void *const socket, std::unique_ptr<char[]> &buffer, size_t &buff
 std::string
 build_socket_addr(const std::string &host, const uint32_t port) {
   std::ostringstream ss;
-  ss << "tcp://" << host << ":" << port;
+  if (host == "shm")
+    ss << "ipc:///tmp/dr-dist-" << port;
+  else
+    ss << "tcp://" << host << ":" << port;
   return ss.str();
 }
 
+
+bool
+is_shm_addr(const std::string &addr) {
+  return addr.compare(0, 6, "ipc://") == 0;
+}
+
 }
 }
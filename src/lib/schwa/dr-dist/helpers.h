@@ -4,9 +4,25 @@
 
 #include <schwa/_base.h>
 
+#include <chrono>
+#include <condition_variable>
 #include <iosfwd>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <schwa/dr-dist/shm.h>
+
+struct zmq_msg_t;
+
+namespace schwa {
+  namespace dr {
+    class Doc;
+    class Writer;
+  }
+}
 
 
 namespace schwa {
@@ -16,8 +32,144 @@ namespace schwa {
       DOCUMENT = 0,
       DOCUMENT_COUNT = 1,
       TERMINATE = 2,
+      DOCUMENT_BATCH = 3,
+      CLAIM = 4,
+      HEARTBEAT = 5,
+      DOCUMENT_BATCH_SHM = 6,
     };
 
+
+    /**
+     * A multi-part ØMQ message received without copying its parts out of the ØMQ message
+     * buffers. The parts remain valid until the next call to \ref recv or until the message is
+     * destroyed, so received documents can be parsed in place.
+     **/
+    class Message {
+    private:
+      std::vector<zmq_msg_t *> _parts;
+      size_t _nparts;
+
+      void _close(void);
+
+    public:
+      Message(void);
+      ~Message(void);
+
+      inline size_t nparts(void) const { return _nparts; }
+      const char *data(size_t part) const;
+      size_t size(size_t part) const;
+
+      /** Blocks until a message is available on \p socket and receives all of its parts. */
+      bool recv(void *socket);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(Message);
+    };
+
+
+    /** A document within a received DOCUMENT_BATCH or DOCUMENT_BATCH_SHM message. */
+    struct BatchDoc {
+      uint64_t doc_num;
+      const char *data;
+      size_t nbytes;
+    };
+
+
+    /**
+     * Accumulates documents, each along with its document number, into a DOCUMENT_BATCH message so
+     * that many short documents can share the cost of a single message. The message is sent as two
+     * parts: a header holding the message type and the number and size of each document, followed
+     * by a body holding the documents back to back. Documents can be framed straight off an input
+     * stream into the body, and the body is handed over to ØMQ on sending rather than copied. The
+     * receiver decodes the batch in place with \ref unpack_batch.
+     *
+     * If the batch has been given a \ref SharedRing, the body is instead copied into the ring when
+     * there is room for it and sent as a DOCUMENT_BATCH_SHM message, whose second part describes
+     * where in the ring the body lives. This is for when the receiver is on the same host.
+     **/
+    class Batch {
+    private:
+      std::string _header;
+      std::string _entries;
+      std::string *_body;
+      uint32_t _ndocs;
+      std::chrono::steady_clock::time_point _started;
+      SharedRing *_ring;
+      uint64_t _ring_end;
+
+      bool _send_shared(void *socket, uint64_t offset);
+
+      void _added(uint64_t doc_num, size_t nbytes);
+
+    public:
+      Batch(void);
+      ~Batch(void);
+
+      inline bool empty(void) const { return _ndocs == 0; }
+      inline uint32_t ndocs(void) const { return _ndocs; }
+      inline size_t nbytes(void) const { return _body->size(); }
+      inline const char *data(void) const { return _body->data(); }
+
+      /** Sends the bodies of subsequent batches through \p ring where possible. */
+      inline void set_ring(SharedRing *const ring) { _ring = ring; }
+
+      /**
+       * The position to release the ring up to once the last batch sent is no longer needed, or
+       * zero if it was not sent through the ring.
+       **/
+      inline uint64_t ring_end(void) const { return _ring_end; }
+
+      /** How long ago the first document was added to the batch. */
+      inline std::chrono::steady_clock::duration age(void) const { return std::chrono::steady_clock::now() - _started; }
+
+      void add(uint64_t doc_num, const char *doc, size_t doc_len);
+      inline void add(uint64_t doc_num, const std::string &doc) { add(doc_num, doc.data(), doc.size()); }
+
+      /** Serialises \p doc with \p writer directly into the batch. */
+      void add(uint64_t doc_num, const dr::Doc &doc, dr::Writer &writer);
+
+      /**
+       * Frames the next document off \p in directly into the batch. Returns false if no document
+       * could be read, in which case the batch is left unchanged.
+       **/
+      bool read(uint64_t doc_num, std::istream &in);
+
+      void clear(void);
+
+      /** Sends the batch as a multi-part message on \p socket and then clears it. */
+      bool send(void *socket);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(Batch);
+    };
+
+
+    /**
+     * Sends a HEARTBEAT message for a worker to the sink every \p interval_ms milliseconds from a
+     * background thread, on a socket of its own, for as long as the object exists. This lets the
+     * sink tell a worker which is busy on a long document apart from one which has died.
+     **/
+    class Heartbeat {
+    private:
+      std::condition_variable _cv;
+      std::mutex _lock;
+      bool _stop;
+      std::thread _thread;
+
+      void _run(void *context, const std::string &sink_addr, uint64_t worker_id, unsigned int interval_ms);
+
+    public:
+      Heartbeat(void *context, const std::string &sink_addr, uint64_t worker_id, unsigned int interval_ms);
+      ~Heartbeat(void);
+
+      /** Stops sending heartbeats, so that the sink comes to treat the worker as dead. */
+      void stop(void);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(Heartbeat);
+    };
+
+
     bool safe_zmq_close(void *socket);
     bool safe_zmq_ctx_destroy(void *context);
     bool safe_zmq_ctx_new(void *&context);
@@ -30,9 +182,38 @@ namespace schwa {
     std::string build_message(MessageType type, uint64_t doc_num, const std::string &doc);
     std::string build_message(MessageType type, uint64_t doc_num, const char *doc, size_t doc_len);
     void        unpack_message(const char *buf, size_t buf_len, MessageType &msg_type, uint64_t &doc_num, std::string &doc);
+    MessageType unpack_message_type(const char *buf, size_t buf_len);
+
+    /**
+     * Decodes the documents in a DOCUMENT_BATCH or DOCUMENT_BATCH_SHM message in place, attaching
+     * to the ring named in the latter through \p rings. Returns false if the batch is malformed or
+     * its body cannot be found.
+     **/
+    bool        unpack_batch(const Message &msg, std::vector<BatchDoc> &docs, SharedRings *rings=nullptr);
+
+    /**
+     * Releases the space used by a DOCUMENT_BATCH_SHM message in its ring once the receiver has
+     * finished with the documents in it. Does nothing for other messages.
+     **/
+    void        release_batch(const Message &msg, SharedRings &rings);
 
+    /**
+     * A CLAIM message is sent to the sink by a worker when it starts on a batch, naming the worker
+     * and the documents in the batch, so that the documents can be re-sent elsewhere if the worker
+     * goes quiet before returning them.
+     **/
+    std::string build_claim(uint64_t worker_id, const std::vector<BatchDoc> &docs);
+    void        unpack_claim(const char *buf, size_t buf_len, uint64_t &worker_id, std::vector<uint64_t> &doc_nums);
+
+    /**
+     * Builds the ØMQ address for \p port on \p host. The special host name "shm" gives an
+     * interprocess address instead, over which batch bodies are passed through shared memory.
+     **/
     std::string build_socket_addr(const std::string &host, uint32_t port);
 
+    /** Whether \p addr is on the same host, so that batch bodies can go through shared memory. */
+    bool        is_shm_addr(const std::string &addr);
+
   }
 }
 
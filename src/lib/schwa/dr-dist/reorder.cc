@@ -0,0 +1,178 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/dr-dist/reorder.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>  // close, ftruncate, mkstemp, pread, pwrite, unlink
+
+#include <schwa/exception.h>
+
+
+namespace schwa {
+namespace dr_dist {
+
+ReorderBuffer::ReorderBuffer(const size_t max_nbytes) :
+    _max_nbytes(max_nbytes),
+    _held_nbytes(0),
+    _spill_nbytes(0),
+    _spill_live_nbytes(0),
+    _spill_fd(-1)
+  { }
+
+
+ReorderBuffer::~ReorderBuffer(void) {
+  if (_spill_fd != -1)
+    ::close(_spill_fd);
+}
+
+
+bool
+ReorderBuffer::contains(const uint64_t doc_num) const {
+  return _held.count(doc_num) != 0 || _spilled.count(doc_num) != 0;
+}
+
+
+void
+ReorderBuffer::_read_spilled(const uint64_t offset, const size_t nbytes) {
+  _buffer.resize(nbytes);
+  for (size_t nread = 0; nread != nbytes; ) {
+    const ssize_t n = ::pread(_spill_fd, &_buffer[nread], nbytes - nread, offset + nread);
+    if (n == -1 && errno == EINTR)
+      continue;
+    else if (n == -1)
+      throw IOException(errno, _spill_path);
+    else if (n == 0)
+      throw IOException("Unexpected end of file", _spill_path);
+    nread += n;
+  }
+}
+
+
+void
+ReorderBuffer::_write_spilled(const char *const data, const size_t nbytes, const uint64_t offset) {
+  for (size_t written = 0; written != nbytes; ) {
+    const ssize_t n = ::pwrite(_spill_fd, data + written, nbytes - written, offset + written);
+    if (n == -1 && errno == EINTR)
+      continue;
+    else if (n == -1)
+      throw IOException(errno, _spill_path);
+    written += n;
+  }
+}
+
+
+void
+ReorderBuffer::_compact(void) {
+  // Move the spilled documents down over the gaps in the order they appear in the file, so that
+  // each one only ever moves towards the start of the file and over bytes which are not needed.
+  std::vector<std::pair<uint64_t, uint64_t>> order;
+  order.reserve(_spilled.size());
+  for (const auto &pair : _spilled)
+    order.emplace_back(pair.second.first, pair.first);
+  std::sort(order.begin(), order.end());
+
+  uint64_t upto = 0;
+  for (const auto &pair : order) {
+    auto &location = _spilled[pair.second];
+    if (location.first != upto) {
+      _read_spilled(location.first, location.second);
+      _write_spilled(_buffer.data(), location.second, upto);
+      location.first = upto;
+    }
+    upto += location.second;
+  }
+  if (::ftruncate(_spill_fd, upto) == -1)
+    throw IOException(errno, _spill_path);
+  _spill_nbytes = upto;
+}
+
+
+void
+ReorderBuffer::_spill(const uint64_t doc_num, const char *const data, const size_t nbytes) {
+  // Create the spill file the first time it is needed. It is unlinked straight away so that it
+  // goes away with the process however the process ends.
+  if (_spill_fd == -1) {
+    const char *const tmpdir = std::getenv("TMPDIR");
+    _spill_path = std::string(tmpdir == nullptr || *tmpdir == '\0' ? "/tmp" : tmpdir) + "/dr-dist-reorder-XXXXXX";
+    std::unique_ptr<char[]> path(new char[_spill_path.size() + 1]);
+    _spill_path.copy(path.get(), _spill_path.size());
+    path[_spill_path.size()] = '\0';
+    _spill_fd = ::mkstemp(path.get());
+    if (_spill_fd == -1)
+      throw IOException(errno, _spill_path);
+    _spill_path = path.get();
+    ::unlink(path.get());
+  }
+
+  // Rather than growing the file, reclaim the space of the documents already read back out of it
+  // once they take up most of it. Compacting only once there are as many dead bytes as live ones
+  // keeps the cost of moving the live ones down proportional to the bytes spilled.
+  const uint64_t dead_nbytes = _spill_nbytes - _spill_live_nbytes;
+  if (dead_nbytes > _spill_live_nbytes && dead_nbytes >= _max_nbytes)
+    _compact();
+
+  _write_spilled(data, nbytes, _spill_nbytes);
+  _spilled.emplace(doc_num, std::make_pair(_spill_nbytes, nbytes));
+  _spill_nbytes += nbytes;
+  _spill_live_nbytes += nbytes;
+}
+
+
+void
+ReorderBuffer::add(const uint64_t doc_num, const char *const data, const size_t nbytes) {
+  // Make room in memory by spilling the held documents furthest from being written, unless the
+  // new document is further away than all of them, in which case it is spilled itself.
+  if (_max_nbytes != 0) {
+    while (!_held.empty() && _held_nbytes + nbytes > _max_nbytes && _held.rbegin()->first > doc_num) {
+      const auto it = std::prev(_held.end());
+      _spill(it->first, it->second.data(), it->second.size());
+      _held_nbytes -= it->second.size();
+      _held.erase(it);
+    }
+    if (_held_nbytes + nbytes > _max_nbytes) {
+      _spill(doc_num, data, nbytes);
+      return;
+    }
+  }
+  _held.emplace(doc_num, std::string(data, nbytes));
+  _held_nbytes += nbytes;
+}
+
+
+bool
+ReorderBuffer::write(const uint64_t doc_num, std::ostream &out) {
+  const auto held = _held.find(doc_num);
+  if (held != _held.end()) {
+    out << held->second;
+    _held_nbytes -= held->second.size();
+    _held.erase(held);
+    return true;
+  }
+
+  const auto spilled = _spilled.find(doc_num);
+  if (spilled == _spilled.end())
+    return false;
+
+  // Read the document back from the spill file.
+  _read_spilled(spilled->second.first, spilled->second.second);
+  out << _buffer;
+  _spill_live_nbytes -= spilled->second.second;
+  _spilled.erase(spilled);
+
+  // Start the spill file afresh once nothing is left in it.
+  if (_spilled.empty()) {
+    if (::ftruncate(_spill_fd, 0) == -1)
+      throw IOException(errno, _spill_path);
+    _spill_nbytes = 0;
+  }
+  return true;
+}
+
+}  // namespace dr_dist
+}  // namespace schwa
@@ -0,0 +1,76 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_DRDIST_REORDER_H_
+#define SCHWA_DRDIST_REORDER_H_
+
+#include <schwa/_base.h>
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+
+namespace schwa {
+  namespace dr_dist {
+
+    /**
+     * Holds back the processed documents which arrive at an order-preserving sink ahead of the
+     * next one to be written. At most \p max_nbytes bytes of documents are held in memory, being
+     * those nearest to the next one to be written, and the rest are spilled to a temporary file
+     * along with an index of where each one lives in it. Spilled documents are read
+     * back when their turn comes. The file is emptied whenever nothing is left spilled in it, and
+     * is compacted before it grows if most of it is taken up by documents already read back.
+     *
+     * The temporary file is only created once something needs spilling. Failures to create, write
+     * to, or read from it throw an IOException.
+     **/
+    class ReorderBuffer {
+    private:
+      const size_t _max_nbytes;
+      std::map<uint64_t, std::string> _held;
+      std::unordered_map<uint64_t, std::pair<uint64_t, size_t>> _spilled;
+      size_t _held_nbytes;
+      uint64_t _spill_nbytes;
+      uint64_t _spill_live_nbytes;
+      std::string _spill_path;
+      int _spill_fd;
+      std::string _buffer;
+
+      void _compact(void);
+      void _read_spilled(uint64_t offset, size_t nbytes);
+      void _spill(uint64_t doc_num, const char *data, size_t nbytes);
+      void _write_spilled(const char *data, size_t nbytes, uint64_t offset);
+
+    public:
+      /** Creates a buffer which holds at most \p max_nbytes in memory, or everything if zero. */
+      explicit ReorderBuffer(size_t max_nbytes=0);
+      ~ReorderBuffer(void);
+
+      inline bool empty(void) const { return _held.empty() && _spilled.empty(); }
+      inline size_t ndocs(void) const { return _held.size() + _spilled.size(); }
+      inline size_t nspilled(void) const { return _spilled.size(); }
+      inline size_t held_nbytes(void) const { return _held_nbytes; }
+
+      /** The size of the spill file, including the space of the documents already read back. */
+      inline uint64_t spill_nbytes(void) const { return _spill_nbytes; }
+
+      bool contains(uint64_t doc_num) const;
+
+      /** Holds back the \p nbytes bytes of document number \p doc_num. */
+      void add(uint64_t doc_num, const char *data, size_t nbytes);
+
+      /**
+       * Writes document number \p doc_num to \p out and forgets it, returning false if it is not
+       * being held back.
+       **/
+      bool write(uint64_t doc_num, std::ostream &out);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(ReorderBuffer);
+    };
+
+  }
+}
+
+#endif  // SCHWA_DRDIST_REORDER_H_
@@ -0,0 +1,133 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include <schwa/dr-dist/reorder.h>
+
+
+namespace schwa {
+namespace dr_dist {
+
+namespace {
+
+/**
+ * The bytes of document number \p doc_num, which are \p nbytes long and tell the documents apart.
+ **/
+std::string
+make_doc(const uint64_t doc_num, const size_t nbytes=32) {
+  std::ostringstream doc;
+  doc << "doc" << doc_num << ":";
+  std::string bytes = doc.str();
+  bytes.resize(nbytes, static_cast<char>('a' + doc_num % 26));
+  return bytes;
+}
+
+
+void
+add_doc(ReorderBuffer &buffer, const uint64_t doc_num) {
+  const std::string doc = make_doc(doc_num);
+  buffer.add(doc_num, doc.data(), doc.size());
+}
+
+}  // namespace
+
+
+SUITE(schwa__dr_dist__reorder) {
+
+TEST(in_memory) {
+  ReorderBuffer buffer;
+  add_doc(buffer, 3);
+  add_doc(buffer, 1);
+  add_doc(buffer, 2);
+  CHECK_EQUAL(3, buffer.ndocs());
+  CHECK_EQUAL(0, buffer.nspilled());
+  CHECK_EQUAL(3*32, buffer.held_nbytes());
+  CHECK(buffer.contains(1));
+  CHECK(!buffer.contains(0));
+  CHECK(!buffer.contains(4));
+
+  std::ostringstream out;
+  CHECK(!buffer.write(0, out));
+  for (uint64_t doc_num = 1; doc_num != 4; ++doc_num) {
+    CHECK(buffer.write(doc_num, out));
+    CHECK(!buffer.contains(doc_num));
+  }
+  CHECK_EQUAL(make_doc(1) + make_doc(2) + make_doc(3), out.str());
+  CHECK(buffer.empty());
+  CHECK_EQUAL(0, buffer.held_nbytes());
+}
+
+
+TEST(spill_replay_order) {
+  // Only two documents fit in memory, so those furthest from being written are spilled, whatever
+  // order they arrive in.
+  ReorderBuffer buffer(64);
+  for (const uint64_t doc_num : {5, 2, 7, 1, 3, 6, 4})
+    add_doc(buffer, doc_num);
+  CHECK_EQUAL(7, buffer.ndocs());
+  CHECK_EQUAL(5, buffer.nspilled());
+  CHECK_EQUAL(64, buffer.held_nbytes());
+  for (uint64_t doc_num = 1; doc_num != 8; ++doc_num)
+    CHECK(buffer.contains(doc_num));
+  CHECK(!buffer.contains(0));
+  CHECK(!buffer.contains(8));
+
+  std::ostringstream out, expected;
+  for (uint64_t doc_num = 1; doc_num != 8; ++doc_num) {
+    CHECK(buffer.write(doc_num, out));
+    expected << make_doc(doc_num);
+  }
+  CHECK_EQUAL(expected.str(), out.str());
+  CHECK(buffer.empty());
+  CHECK_EQUAL(0, buffer.spill_nbytes());
+
+  // A document bigger than the memory limit goes straight to the spill file.
+  const std::string big = make_doc(8, 100);
+  buffer.add(8, big.data(), big.size());
+  CHECK_EQUAL(1, buffer.nspilled());
+  std::ostringstream big_out;
+  CHECK(buffer.write(8, big_out));
+  CHECK_EQUAL(big, big_out.str());
+}
+
+
+TEST(compaction) {
+  // A sliding window of documents where each one arrives ahead of its turn, so there are always
+  // documents spilled and the spill file is never emptied. Without compaction, it would grow by
+  // every document which passes through.
+  static constexpr uint64_t WINDOW = 10, NDOCS = 1000;
+  ReorderBuffer buffer(64);
+  for (uint64_t doc_num = WINDOW; doc_num-- != 0; )
+    add_doc(buffer, doc_num);
+
+  std::ostringstream out, expected;
+  uint64_t max_spill_nbytes = 0;
+  for (uint64_t doc_num = 0; doc_num != NDOCS; ++doc_num) {
+    add_doc(buffer, doc_num + WINDOW);
+    CHECK(buffer.contains(doc_num));
+    CHECK(buffer.write(doc_num, out));
+    CHECK(!buffer.contains(doc_num));
+    expected << make_doc(doc_num);
+    max_spill_nbytes = std::max(max_spill_nbytes, buffer.spill_nbytes());
+  }
+  CHECK_EQUAL(expected.str(), out.str());
+  CHECK_EQUAL(WINDOW, buffer.ndocs());
+  CHECK(max_spill_nbytes <= 2*(WINDOW + 1)*32 + 64);
+
+  // The documents still held are unaffected by having been moved around.
+  std::ostringstream rest_out, rest_expected;
+  for (uint64_t doc_num = NDOCS; doc_num != NDOCS + WINDOW; ++doc_num) {
+    CHECK(buffer.write(doc_num, rest_out));
+    rest_expected << make_doc(doc_num);
+  }
+  CHECK_EQUAL(rest_expected.str(), rest_out.str());
+  CHECK(buffer.empty());
+}
+
+}  // SUITE
+
+}  // namespace dr_dist
+}  // namespace schwa
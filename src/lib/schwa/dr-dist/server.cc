@@ -8,20 +8,30 @@
  **/
 #include <schwa/dr-dist/server.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <schwa/config.h>
 #include <schwa/dr/reader.h>
 #include <schwa/dr-dist/helpers.h>
+#include <schwa/dr-dist/reorder.h>
+#include <schwa/dr-dist/stats.h>
+#include <schwa/exception.h>
 #include <schwa/io/logging.h>
 
 #include <zmq.h>
@@ -33,18 +43,166 @@ static volatile bool sink_created = false;
 static std::condition_variable sink_created_cv;
 static std::mutex sink_created_lock;
 
+// The state shared between the source and the sink for flow control and re-dispatching. The sink
+// publishes the lowest document number it has not yet received, and the document numbers which
+// need re-sending because the workers they were sent to have gone quiet. The source publishes how
+// many documents it has sent.
+static uint64_t sink_ndocs_acked = 0;
+static bool sink_finished = false;
+static uint64_t source_ndocs_sent = 0;
+static std::vector<uint64_t> source_resend;
+static std::condition_variable sink_acked_cv;
+static std::mutex sink_acked_lock;
+
+// The runtime counters of the job, which are reported on by the sink.
+static schwa::dr_dist::Stats stats;
+
+
+namespace {
+
+/**
+ * Frames documents off an input stream on a background thread into a bounded queue, so that the
+ * source can wait for the next document with a deadline rather than blocking on the input, and
+ * send a partially filled batch once it has lingered for long enough.
+ **/
+class InputReader {
+public:
+  enum class Result { DOC, TIMEOUT, END };
+
+private:
+  std::istream &_input;
+  const size_t _max_ndocs;
+  std::deque<std::string> _queue;
+  bool _eof;
+  bool _stop;
+  std::exception_ptr _error;
+  std::condition_variable _cv;
+  std::mutex _lock;
+  std::thread _thread;
+
+  void
+  _run(void) {
+    std::string frame;
+    try {
+      while (dr::read_lazy_doc(_input, frame)) {
+        std::unique_lock<std::mutex> lock(_lock);
+        _cv.wait(lock, [this](void){ return _stop || _queue.size() < _max_ndocs; });
+        if (_stop)
+          return;
+        _queue.emplace_back();
+        _queue.back().swap(frame);
+        _cv.notify_all();
+      }
+    }
+    catch (...) {
+      std::unique_lock<std::mutex> lock(_lock);
+      _error = std::current_exception();
+    }
+    std::unique_lock<std::mutex> lock(_lock);
+    _eof = true;
+    _cv.notify_all();
+  }
+
+  /** Takes the next document off the queue. Must be called with the lock held. */
+  Result
+  _pop(std::string &frame) {
+    if (_queue.empty()) {
+      if (_error)
+        std::rethrow_exception(_error);
+      return Result::END;
+    }
+    frame.swap(_queue.front());
+    _queue.pop_front();
+    _cv.notify_all();
+    return Result::DOC;
+  }
+
+public:
+  InputReader(std::istream &input, const size_t max_ndocs) :
+      _input(input),
+      _max_ndocs(std::max<size_t>(max_ndocs, 1)),
+      _eof(false),
+      _stop(false),
+      _thread(&InputReader::_run, this)
+    { }
+
+  /** Stops reading, which waits for a read already in progress on the input to return. */
+  ~InputReader(void) {
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _stop = true;
+      _cv.notify_all();
+    }
+    _thread.join();
+  }
+
+  /** Waits for the next document, or for the end of the input. */
+  Result
+  next(std::string &frame) {
+    std::unique_lock<std::mutex> lock(_lock);
+    _cv.wait(lock, [this](void){ return _eof || !_queue.empty(); });
+    return _pop(frame);
+  }
+
+  /** Waits for the next document, or for the end of the input, until \p deadline. */
+  Result
+  next(std::string &frame, const std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(_lock);
+    if (!_cv.wait_until(lock, deadline, [this](void){ return _eof || !_queue.empty(); }))
+      return Result::TIMEOUT;
+    return _pop(frame);
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(InputReader);
+};
+
+}  // namespace
+
+
+/**
+ * Publishes the sink's progress to the source, releasing it if it is waiting for credit.
+ **/
+static void
+sink_ack(const uint64_t ndocs_acked, const bool finished=false) {
+  std::unique_lock<std::mutex> lock(sink_acked_lock);
+  sink_ndocs_acked = ndocs_acked;
+  sink_finished = finished;
+  sink_acked_cv.notify_all();
+}
+
+
+/**
+ * Releases the source when the sink fails before it has started, so that the source does not
+ * wait forever for it to be created.
+ **/
+static void
+sink_abort(void) {
+  sink_ack(0, true);
+  std::unique_lock<std::mutex> lock(sink_created_lock);
+  sink_created = true;
+  sink_created_cv.notify_all();
+}
+
 
 namespace schwa {
 namespace dr_dist {
 
 bool
-source(const std::string &source_addr, const std::string &direct_sink_addr, std::istream &input) {
+source(const std::string &source_addr, const std::string &direct_sink_addr, std::istream &input, const uint32_t batch_ndocs, const size_t batch_nbytes, const unsigned int batch_linger_ms, const uint64_t window, const bool redispatch) {
   // Wait for the sink to be created before starting.
   LOG(DEBUG) << "Waiting for sink to be created..." << std::endl;
   {
     std::unique_lock<std::mutex> lock(sink_created_lock);
     sink_created_cv.wait(lock, [](void){ return sink_created; });
   }
+  {
+    std::unique_lock<std::mutex> lock(sink_acked_lock);
+    if (sink_finished) {
+      LOG(ERROR) << "The sink failed to start, so no documents will be sent" << std::endl;
+      return false;
+    }
+  }
 
   // Prepare the ØMQ context and construct the sockets;
   void *context, *source, *sink;
@@ -55,28 +213,180 @@ source(const std::string &source_addr, const std::string &direct_sink_addr, std:
   if (!safe_zmq_socket_connect(context, sink, ZMQ_PUSH, direct_sink_addr))
     return false;
 
-  // Read documents from the input stream and broadcast them out.
+  // When re-dispatching, a copy of each sent document is kept until the sink has received it.
+  std::deque<std::string> sent;
+  uint64_t sent_first = 0;
+  std::vector<uint64_t> resend;
+  Batch resend_batch;
+  uint64_t doc_num, ndocs_read = 0;
+
+  // When the workers are on the same host, the batch bodies are passed to them through shared
+  // memory. The space used by a batch is released once the sink has received all of the documents
+  // up to the end of it. Re-sent documents are always sent inline, and as the worker first sent
+  // them may only be stalled and still reading them in place, nothing from the batch holding the
+  // earliest re-sent document onwards is ever released. Later batches are sent inline once the
+  // ring fills up.
+  std::unique_ptr<SharedRing> ring;
+  std::deque<std::pair<uint64_t, uint64_t>> ring_sent;
+  uint64_t ring_pinned = std::numeric_limits<uint64_t>::max();
+  Batch batch;
+  if (is_shm_addr(source_addr)) {
+    try {
+      ring.reset(new SharedRing(SharedRing::unique_name("source"), SharedRing::DEFAULT_CAPACITY));
+      batch.set_ring(ring.get());
+    }
+    catch (IOException &e) {
+      LOG(WARNING) << "Failed to create shared memory, so sending documents inline: " << e.what() << std::endl;
+    }
+  }
+
+  const auto send_batch = [&](Batch &batch) {
+    if (ring != nullptr) {
+      uint64_t release = 0;
+      {
+        std::unique_lock<std::mutex> lock(sink_acked_lock);
+        const uint64_t releasable = std::min(sink_ndocs_acked, ring_pinned);
+        for ( ; !ring_sent.empty() && ring_sent.front().second <= releasable; ring_sent.pop_front())
+          release = ring_sent.front().first;
+      }
+      if (release != 0)
+        ring->release(release);
+    }
+    const uint32_t ndocs = batch.ndocs();
+    const size_t nbytes = batch.nbytes();
+    if (!batch.send(source))
+      return false;
+    stats.ndocs_sent += ndocs;
+    stats.nbytes_sent += nbytes;
+    if (batch.ring_end() != 0)
+      ring_sent.emplace_back(batch.ring_end(), ndocs_read);
+    std::unique_lock<std::mutex> lock(sink_acked_lock);
+    source_ndocs_sent = ndocs_read;
+    return true;
+  };
+
+  const auto send_resends = [&](void) {
+    {
+      std::unique_lock<std::mutex> lock(sink_acked_lock);
+      resend.swap(source_resend);
+      for ( ; sent_first < sink_ndocs_acked && !sent.empty(); ++sent_first)
+        sent.pop_front();
+    }
+    for (const uint64_t n : resend)
+      if (n >= sent_first && n - sent_first < sent.size()) {
+        resend_batch.add(n, sent[n - sent_first]);
+        ring_pinned = std::min(ring_pinned, n);
+      }
+    resend.clear();
+    if (resend_batch.empty())
+      return true;
+    LOG(INFO) << "Re-sending " << resend_batch.ndocs() << " documents" << std::endl;
+    stats.ndocs_resent += resend_batch.ndocs();
+    stats.nbytes_sent += resend_batch.nbytes();
+    return resend_batch.send(source);
+  };
+
+  // Read documents from the input stream and broadcast them out in batches. A batch is sent once
+  // it is full, or once it has been waiting on a slow input for longer than the linger time. No
+  // more than `window` documents are sent beyond the lowest one the sink has not yet received,
+  // so a partial batch is sent if the source has to wait for the sink to catch up.
+  //
+  // A batch can only linger if it would not be sent after every document anyway. The input is
+  // then read on a separate thread so that the linger time is kept to while waiting on it.
+  const std::chrono::milliseconds linger(batch_linger_ms);
+  std::unique_ptr<InputReader> reader;
+  std::string frame;
+  if (batch_linger_ms != 0 && batch_ndocs > 1 && batch_nbytes != 0)
+    reader.reset(new InputReader(input, batch_ndocs));
   bool success = true;
-  uint64_t doc_num;
   for (doc_num = 0; ; ++doc_num) {
-    LOG(DEBUG) << "Attempting to read doc_num=" << doc_num << std::endl;
-    std::stringstream doc;
-    if (!dr::read_lazy_doc(input, doc))
-      break;
-    doc.seekg(0);
-
-    // Construct and send the transport message.
-    const std::string msg = build_message(MessageType::DOCUMENT, doc_num, doc.str());
-    if (!safe_zmq_send(source, msg.c_str(), msg.size(), 0)) {
+    if (redispatch && !send_resends()) {
       success = false;
       break;
     }
+    if (window != 0) {
+      std::unique_lock<std::mutex> lock(sink_acked_lock);
+      while (!sink_finished && doc_num >= sink_ndocs_acked + window) {
+        if (batch.empty() && source_resend.empty()) {
+          sink_acked_cv.wait(lock);
+          continue;
+        }
+        lock.unlock();
+        if ((!batch.empty() && !send_batch(batch)) || (redispatch && !send_resends())) {
+          success = false;
+          break;
+        }
+        lock.lock();
+      }
+      if (!success)
+        break;
+      if (sink_finished) {
+        LOG(ERROR) << "The sink finished before all of the documents were sent" << std::endl;
+        success = false;
+        break;
+      }
+    }
+
+    LOG(DEBUG) << "Attempting to read doc_num=" << doc_num << std::endl;
+    size_t offset = batch.nbytes();
+    if (reader == nullptr) {
+      if (!batch.read(doc_num, input))
+        break;
+    }
+    else {
+      InputReader::Result result;
+      if (batch.empty())
+        result = reader->next(frame);
+      else {
+        result = reader->next(frame, std::chrono::steady_clock::now() + linger - batch.age());
+        if (result == InputReader::Result::TIMEOUT) {
+          if (!send_batch(batch)) {
+            success = false;
+            break;
+          }
+          offset = 0;
+          result = reader->next(frame);
+        }
+      }
+      if (result == InputReader::Result::END)
+        break;
+      batch.add(doc_num, frame);
+    }
+    ndocs_read = doc_num + 1;
+    if (redispatch)
+      sent.emplace_back(batch.data() + offset, batch.nbytes() - offset);
+
+    if (batch.ndocs() >= batch_ndocs || batch.nbytes() >= batch_nbytes || batch.age() >= linger) {
+      if (!send_batch(batch)) {
+        success = false;
+        break;
+      }
+    }
   }
+  if (success && !batch.empty())
+    success = send_batch(batch);
 
   // Tell the sink how many documents to expect.
   const std::string msg = build_message(MessageType::DOCUMENT_COUNT, doc_num, nullptr, 0);
   success &= safe_zmq_send(sink, msg.c_str(), msg.size(), 0);
 
+  // Keep re-sending documents whose workers have gone quiet until the sink has received them all.
+  if (success && redispatch) {
+    std::unique_lock<std::mutex> lock(sink_acked_lock);
+    while (!sink_finished) {
+      if (source_resend.empty()) {
+        sink_acked_cv.wait(lock);
+        continue;
+      }
+      lock.unlock();
+      if (!send_resends()) {
+        success = false;
+        break;
+      }
+      lock.lock();
+    }
+  }
+
   // Close the source and sink sockets and destroy the ØMQ context.
   success &= safe_zmq_close(sink);
   success &= safe_zmq_close(source);
@@ -86,17 +396,31 @@ source(const std::string &source_addr, const std::string &direct_sink_addr, std:
 
 
 bool
-sink(const std::string &sink_addr, const std::string &control_addr, const bool preserve_order, const bool kill_clients, std::ostream &output) {
+sink(const std::string &sink_addr, const std::string &control_addr, const bool preserve_order, const bool kill_clients, std::ostream &output, const unsigned int worker_timeout_ms, const std::string &stats_addr, const unsigned int stats_interval_ms, const size_t reorder_nbytes) {
   // Prepare the ØMQ context and create the sockets.
-  void *context, *sink, *control;
-  if (!safe_zmq_ctx_new(context))
-    return false;
-  if (!safe_zmq_socket_bind(context, sink, ZMQ_PULL, sink_addr))
-    return false;
-  if (!safe_zmq_socket_bind(context, control, ZMQ_PUB, control_addr))
+  void *context, *sink, *control, *stats_socket = nullptr;
+  if (!safe_zmq_ctx_new(context) || !safe_zmq_socket_bind(context, sink, ZMQ_PULL, sink_addr) || !safe_zmq_socket_bind(context, control, ZMQ_PUB, control_addr)) {
+    sink_abort();
     return false;
+  }
+
+  // The stats are only a convenience, so the job goes ahead without serving them if the port is
+  // not available.
+  if (!stats_addr.empty() && !safe_zmq_socket_bind(context, stats_socket, ZMQ_REP, stats_addr)) {
+    LOG(WARNING) << "Not serving stats on " << stats_addr << " as it could not be bound to" << std::endl;
+    if (stats_socket != nullptr)
+      safe_zmq_close(stats_socket);
+    stats_socket = nullptr;
+  }
 
   // Tell the source that the sink socket has been created.
+  {
+    std::unique_lock<std::mutex> lock(sink_acked_lock);
+    source_ndocs_sent = 0;
+    source_resend.clear();
+    stats.reset();
+  }
+  sink_ack(0);
   {
     std::unique_lock<std::mutex> lock(sink_created_lock);
     sink_created = true;
@@ -105,56 +429,257 @@ sink(const std::string &sink_addr, const std::string &control_addr, const bool p
 
   uint64_t ndocs = 0, ndocs_written = 0, ndocs_received = 0;
   bool ndocs_known = false;
-  std::unordered_map<uint64_t, std::string> unwritten;
+  ReorderBuffer unwritten(reorder_nbytes);
 
-  size_t buffer_written;
-  size_t buffer_len = 2*1024*1024;  // 2MB
-  std::unique_ptr<char[]> buffer(new char[buffer_len]);
+  // The lowest document number not yet received, and the documents received after it when the
+  // order is not being preserved, so that late duplicates of re-sent documents can be discarded.
+  uint64_t ndocs_done = 0;
+  std::unordered_set<uint64_t> received;
 
+  Message msg;
   MessageType msg_type;
   uint64_t doc_num;
   std::string doc_bytes;
+  std::vector<BatchDoc> batch_docs;
+  SharedRings rings;
 
-  // Listen for documents to come back in until we've received all of them.
-  while (!ndocs_known || ndocs_received != ndocs) {
-    if (!recv_multipart(sink, buffer, buffer_len, buffer_written))
+  // When each document was claimed and by which worker, for the per-worker latencies.
+  const bool collect_stats = stats_socket != nullptr || stats_interval_ms != 0;
+  std::unordered_map<uint64_t, std::pair<uint64_t, std::chrono::steady_clock::time_point>> claimed_at;
+  std::chrono::steady_clock::time_point received_at;
+
+  const auto is_received = [&](const uint64_t doc_num) {
+    return doc_num < ndocs_done || unwritten.contains(doc_num) || received.count(doc_num) != 0;
+  };
+
+  // Writes out a processed document straight from the received message. If the order is being
+  // preserved, a document which arrives before its predecessors is copied out and held back until
+  // they have been written. Returns false if a held back document could not be spilled to disk or
+  // read back from it, in which case not all of the documents can be written.
+  const auto receive_doc = [&](const uint64_t doc_num, const char *const data, const size_t nbytes) {
+    LOG(DEBUG) << "received document " << doc_num << " of " << nbytes << " bytes" << std::endl;
+    if (collect_stats) {
+      const auto it = claimed_at.find(doc_num);
+      if (it != claimed_at.end()) {
+        stats.workers[it->second.first].add(received_at - it->second.second);
+        claimed_at.erase(it);
+      }
+    }
+    if (is_received(doc_num)) {
+      LOG(DEBUG) << "discarding duplicate of document " << doc_num << std::endl;
+      return true;
+    }
+    ++ndocs_received;
+    stats.nbytes_received += nbytes;
+    try {
+      if (preserve_order && doc_num != ndocs_written) {
+        unwritten.add(doc_num, data, nbytes);
+        return true;
+      }
+      output.write(data, nbytes);
+      ++ndocs_written;
+      if (preserve_order) {
+        while (unwritten.write(ndocs_written, output))
+          ++ndocs_written;
+        ndocs_done = ndocs_written;
+      }
+      else if (doc_num == ndocs_done) {
+        for (++ndocs_done; received.erase(ndocs_done) != 0; )
+          ++ndocs_done;
+      }
+      else
+        received.insert(doc_num);
+    }
+    catch (IOException &e) {
+      LOG(CRITICAL) << "Failed to hold back documents until their predecessors arrive: " << e.what() << std::endl;
       return false;
+    }
+    return true;
+  };
+
+  // The workers which have claimed documents, for re-sending their documents if they go quiet.
+  struct Worker {
+    std::chrono::steady_clock::time_point last_heard;
+    std::vector<uint64_t> claimed;
+  };
+  std::unordered_map<uint64_t, Worker> workers;
+  std::vector<uint64_t> claim;
+  uint64_t worker_id;
+
+  const std::chrono::milliseconds worker_timeout(worker_timeout_ms);
+  zmq_pollitem_t poll_items[] = {
+      {sink, 0, ZMQ_POLLIN, 0},
+      {stats_socket, 0, ZMQ_POLLIN, 0},
+  };
+  const int npoll_items = stats_socket == nullptr ? 1 : 2;
+
+  // Re-sends the documents claimed by workers which have not been heard from within the timeout,
+  // along with any unclaimed documents, as those may have been queued up for the lost workers.
+  const auto check_workers = [&](void) {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<uint64_t> resend;
+    bool lost = false;
+    for (auto it = workers.begin(); it != workers.end(); ) {
+      if (now - it->second.last_heard < worker_timeout) {
+        ++it;
+        continue;
+      }
+      LOG(WARNING) << "Worker " << it->first << " has gone quiet. Re-sending its documents." << std::endl;
+      for (const uint64_t n : it->second.claimed)
+        if (!is_received(n))
+          resend.push_back(n);
+      it = workers.erase(it);
+      lost = true;
+    }
+    if (!lost)
+      return;
+
+    std::unique_lock<std::mutex> lock(sink_acked_lock);
+    std::unordered_set<uint64_t> claimed(resend.begin(), resend.end());
+    for (const auto &pair : workers)
+      claimed.insert(pair.second.claimed.begin(), pair.second.claimed.end());
+    for (uint64_t n = ndocs_done; n < source_ndocs_sent; ++n)
+      if (!is_received(n) && claimed.count(n) == 0)
+        resend.push_back(n);
+    source_resend.insert(source_resend.end(), resend.begin(), resend.end());
+    sink_acked_cv.notify_all();
+  };
 
-    // Decode the received message.
-    unpack_message(buffer.get(), buffer_written, msg_type, doc_num, doc_bytes);
+  // Brings the counters which are not kept up to date as they change up to date, and samples the
+  // rates. Serves the report to whoever asked for it on the stats socket, and logs it periodically.
+  std::chrono::steady_clock::time_point reported = std::chrono::steady_clock::now();
+  const std::chrono::milliseconds stats_interval(stats_interval_ms);
+  const auto update_stats = [&](void) {
+    stats.ndocs_received = ndocs_received;
+    stats.reorder_ndocs = unwritten.ndocs();
+    stats.reorder_nbytes = unwritten.held_nbytes();
+    stats.reorder_nspilled = unwritten.nspilled();
+    {
+      std::unique_lock<std::mutex> lock(sink_acked_lock);
+      stats.ndocs_in_flight = source_ndocs_sent - std::min(source_ndocs_sent, ndocs_received);
+    }
+    stats.sample();
+  };
+  const auto serve_stats = [&](void) {
+    Message request;
+    if (!request.recv(stats_socket))
+      return false;
+    update_stats();
+    std::ostringstream report;
+    stats.report(report);
+    const std::string reply = report.str();
+    return safe_zmq_send(stats_socket, reply.c_str(), reply.size(), 0);
+  };
+  const auto log_stats = [&](void) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now - reported < stats_interval)
+      return;
+    reported = now;
+    update_stats();
+    std::ostringstream report;
+    stats.report(report);
+    LOG(INFO) << "Stats: " << report.str() << std::flush;
+  };
 
-    // Act upon the received message.
+  // Listen for documents to come back in until we've received all of them. When re-dispatching,
+  // the workers are checked on between messages, and when collecting stats, they are reported on.
+  long poll_timeout_ms = -1;
+  if (worker_timeout_ms != 0)
+    poll_timeout_ms = std::max(worker_timeout_ms/4, 1u);
+  if (stats_interval_ms != 0 && (poll_timeout_ms == -1 || stats_interval_ms < poll_timeout_ms))
+    poll_timeout_ms = stats_interval_ms;
+  while (!ndocs_known || ndocs_received != ndocs) {
+    if (poll_timeout_ms != -1 || stats_socket != nullptr) {
+      if (worker_timeout_ms != 0)
+        check_workers();
+      if (stats_interval_ms != 0)
+        log_stats();
+      const int npolled = zmq_poll(poll_items, npoll_items, poll_timeout_ms);
+      if (npolled == -1) {
+        LOG(CRITICAL) << "Call to zmq_poll failed: " << zmq_strerror(zmq_errno()) << std::endl;
+        sink_ack(ndocs_done, true);
+        return false;
+      }
+      if ((poll_items[1].revents & ZMQ_POLLIN) && !serve_stats()) {
+        sink_ack(ndocs_done, true);
+        return false;
+      }
+      if (!(poll_items[0].revents & ZMQ_POLLIN))
+        continue;
+    }
+    if (!msg.recv(sink)) {
+      sink_ack(ndocs_done, true);
+      return false;
+    }
+    received_at = std::chrono::steady_clock::now();
+
+    // Decode and act upon the received message.
+    msg_type = unpack_message_type(msg.data(0), msg.size(0));
     switch (msg_type) {
     case MessageType::DOCUMENT:
-      LOG(DEBUG) << "received document " << doc_num << " of " << doc_bytes.size() << " bytes" << std::endl;
-      ++ndocs_received;
-      if (preserve_order) {
-        unwritten.emplace(doc_num, doc_bytes);
-        for (decltype(unwritten)::const_iterator it; (it = unwritten.find(ndocs_written)) != unwritten.end(); ) {
-          output << it->second;
-          ++ndocs_written;
-          unwritten.erase(it);
-        }
+      unpack_message(msg.data(0), msg.size(0), msg_type, doc_num, doc_bytes);
+      if (!receive_doc(doc_num, doc_bytes.data(), doc_bytes.size())) {
+        sink_ack(ndocs_done, true);
+        return false;
       }
-      else {
-        output << doc_bytes;
-        ++ndocs_written;
+      break;
+    case MessageType::DOCUMENT_BATCH:
+    case MessageType::DOCUMENT_BATCH_SHM:
+      // The documents of a batch which cannot be decoded will never arrive, so the job fails.
+      if (!unpack_batch(msg, batch_docs, &rings)) {
+        LOG(CRITICAL) << "Failed to decode a batch of processed documents, so not all of the documents can be written" << std::endl;
+        sink_ack(ndocs_done, true);
+        return false;
       }
+      for (const BatchDoc &doc : batch_docs) {
+        if (!receive_doc(doc.doc_num, doc.data, doc.nbytes)) {
+          sink_ack(ndocs_done, true);
+          return false;
+        }
+      }
+      release_batch(msg, rings);
       break;
     case MessageType::DOCUMENT_COUNT:
+      unpack_message(msg.data(0), msg.size(0), msg_type, doc_num, doc_bytes);
       ndocs = doc_num;
       ndocs_known = true;
       LOG(DEBUG) << "count " << ndocs << std::endl;
       break;
+    case MessageType::CLAIM:
+      unpack_claim(msg.data(0), msg.size(0), worker_id, claim);
+      {
+        Worker &worker = workers[worker_id];
+        worker.last_heard = std::chrono::steady_clock::now();
+        worker.claimed.erase(std::remove_if(worker.claimed.begin(), worker.claimed.end(), is_received), worker.claimed.end());
+        worker.claimed.insert(worker.claimed.end(), claim.begin(), claim.end());
+      }
+      if (collect_stats)
+        for (const uint64_t n : claim)
+          claimed_at[n] = std::make_pair(worker_id, received_at);
+      break;
+    case MessageType::HEARTBEAT:
+      unpack_message(msg.data(0), msg.size(0), msg_type, worker_id, doc_bytes);
+      workers[worker_id].last_heard = std::chrono::steady_clock::now();
+      break;
     default:
       LOG(ERROR) << "Unknown message type received: " << static_cast<uint8_t>(msg_type) << std::endl;
       break;
     }
+
+    // Give the source credit for the documents which have now been received.
+    sink_ack(ndocs_done);
+  }
+  sink_ack(ndocs_done, true);
+  if (stats_interval_ms != 0) {
+    update_stats();
+    std::ostringstream report;
+    stats.report(report);
+    LOG(INFO) << "Final stats: " << report.str() << std::flush;
   }
 
   // This *should* always be true. Assert just as a sanity check.
   if (ndocs_received != ndocs_written || !unwritten.empty()) {
-    LOG(CRITICAL) << "ndocs_received=" << ndocs_received << " ndocs_written=" << ndocs_written << " |unwritten|=" << unwritten.size() << std::endl;
+    LOG(CRITICAL) << "ndocs_received=" << ndocs_received << " ndocs_written=" << ndocs_written << " |unwritten|=" << unwritten.ndocs() << std::endl;
   }
 
   // Publish that the clients should now terminate.
@@ -166,6 +691,8 @@ sink(const std::string &sink_addr, const std::string &control_addr, const bool p
   }
 
   // Close the sockets and destroy the ØMQ context.
+  if (stats_socket != nullptr)
+    success &= safe_zmq_close(stats_socket);
   success &= safe_zmq_close(control);
   success &= safe_zmq_close(sink);
   success &= safe_zmq_ctx_destroy(context);
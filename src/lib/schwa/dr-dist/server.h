@@ -11,8 +11,38 @@
 namespace schwa {
   namespace dr_dist {
 
-    bool sink(const std::string &sink_addr, const std::string &control_addr, bool preserve_order, bool kill_clients, std::ostream &output);
-    bool source(const std::string &source_addr, const std::string &direct_sink_addr, std::istream &input);
+    /**
+     * Receives the processed documents from the workers and writes them to \p output. If
+     * \p worker_timeout_ms is non-zero, a worker which has claimed documents but has not been
+     * heard from for that many milliseconds is presumed dead, and its documents are re-sent by the
+     * source to the other workers. Duplicate results for a document are discarded.
+     *
+     * The sink keeps counters on the throughput of the job, the number of documents in flight and
+     * held back for reordering, and the latency of each worker from claiming a document to
+     * returning it, for the workers which send heartbeats. A report on these is logged every
+     * \p stats_interval_ms milliseconds if it is non-zero, and is sent in reply to any request
+     * made on a ZMQ_REP socket bound to \p stats_addr if it is non-empty.
+     *
+     * When preserving the order, at most \p reorder_nbytes bytes of the documents which arrive
+     * ahead of their predecessors are held in memory, and the rest are spilled to a temporary file
+     * until their turn comes. If \p reorder_nbytes is zero, they are all held in memory.
+     **/
+    bool sink(const std::string &sink_addr, const std::string &control_addr, bool preserve_order, bool kill_clients, std::ostream &output, unsigned int worker_timeout_ms=0, const std::string &stats_addr="", unsigned int stats_interval_ms=0, size_t reorder_nbytes=0);
+
+    /**
+     * Reads documents off \p input and pushes them out to the workers in batches. A batch is sent
+     * once it holds \p batch_ndocs documents or \p batch_nbytes bytes, or once \p batch_linger_ms
+     * milliseconds have passed since its first document was read, whichever comes first.
+     *
+     * If \p window is non-zero, no document is sent until the sink has written out all but fewer
+     * than \p window of the documents before it, which bounds the number of documents in flight
+     * and the number the sink holds back when preserving the order. The source and sink must be
+     * running in the same process for this flow control to work.
+     *
+     * If \p redispatch is true, a copy of each document is kept until the sink has received it,
+     * so that it can be re-sent if the sink finds that the worker it was sent to has died.
+     **/
+    bool source(const std::string &source_addr, const std::string &direct_sink_addr, std::istream &input, uint32_t batch_ndocs=1, size_t batch_nbytes=0, unsigned int batch_linger_ms=0, uint64_t window=0, bool redispatch=false);
 
   }
 }
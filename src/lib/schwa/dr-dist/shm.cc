@@ -0,0 +1,203 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/dr-dist/shm.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+#include <dirent.h>    // closedir, opendir, readdir
+#include <fcntl.h>     // O_* constants, posix_fallocate
+#include <signal.h>    // kill
+#include <sys/mman.h>  // mmap, munmap, shm_open, shm_unlink
+#include <sys/stat.h>  // fstat
+#include <unistd.h>    // close, ftruncate, getpid
+
+#include <schwa/exception.h>
+#include <schwa/io/logging.h>
+
+
+namespace schwa {
+namespace dr_dist {
+
+static constexpr const uint64_t SHARED_RING_MAGIC = 0x474e495254534944;  // "DISTRING"
+static constexpr const char *const SHARED_RING_PREFIX = "dr-dist-";
+static constexpr const char *const SHM_DIR = "/dev/shm";
+
+
+struct SharedRing::Header {
+  uint64_t magic;
+  uint64_t capacity;
+  std::atomic<uint64_t> tail;
+  char padding[40];
+};
+
+
+SharedRing::SharedRing(const std::string &name, const size_t capacity) :
+    _name(name),
+    _owner(capacity != 0),
+    _mapped_nbytes(0),
+    _header(nullptr),
+    _data(nullptr),
+    _head(0) {
+  static_assert(sizeof(Header) == 64, "The shared ring header should fill a cache line");
+
+  if (_owner) {
+    // Rings left behind by producers which did not exit cleanly would otherwise hold on to their
+    // memory until reboot, so clear them out before creating the first ring.
+    static std::once_flag removed_stale;
+    std::call_once(removed_stale, remove_stale);
+
+    // Create the shared memory object and size it to hold the header and the ring. The memory is
+    // reserved up front, as running out of it on first touch would kill the process with SIGBUS.
+    const int fd = ::shm_open(_name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+      throw IOException(errno, _name);
+    int err = 0;
+    if (::ftruncate(fd, sizeof(Header) + capacity) == -1)
+      err = errno;
+    else
+      err = ::posix_fallocate(fd, 0, sizeof(Header) + capacity);
+    if (err != 0) {
+      ::close(fd);
+      ::shm_unlink(_name.c_str());
+      throw IOException(err, _name);
+    }
+    try {
+      _map(fd, sizeof(Header) + capacity);
+    }
+    catch (IOException &) {
+      ::shm_unlink(_name.c_str());
+      throw;
+    }
+    _header->magic = SHARED_RING_MAGIC;
+    _header->capacity = capacity;
+    _header->tail.store(0);
+  }
+  else {
+    // Attach to the existing shared memory object, which is sized to fit.
+    const int fd = ::shm_open(_name.c_str(), O_RDWR, 0);
+    if (fd == -1)
+      throw IOException(errno, _name);
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+      const int err = errno;
+      ::close(fd);
+      throw IOException(err, _name);
+    }
+    _map(fd, st.st_size);
+    if (_mapped_nbytes < sizeof(Header) || _header->magic != SHARED_RING_MAGIC)
+      throw IOException("Shared memory object is not a dr-dist ring", _name);
+  }
+}
+
+
+SharedRing::~SharedRing(void) {
+  if (_header != nullptr)
+    ::munmap(_header, _mapped_nbytes);
+  if (_owner)
+    ::shm_unlink(_name.c_str());
+}
+
+
+void
+SharedRing::_map(const int fd, const size_t nbytes) {
+  void *const data = ::mmap(nullptr, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int err = errno;
+  ::close(fd);
+  if (data == MAP_FAILED)
+    throw IOException(err, _name);
+  _mapped_nbytes = nbytes;
+  _header = static_cast<Header *>(data);
+  _data = static_cast<char *>(data) + sizeof(Header);
+}
+
+
+size_t
+SharedRing::capacity(void) const {
+  return _header->capacity;
+}
+
+
+uint64_t
+SharedRing::tail(void) const {
+  return _header->tail.load(std::memory_order_acquire);
+}
+
+
+bool
+SharedRing::write(const char *const data, const size_t nbytes, uint64_t &offset, uint64_t &end) {
+  // The bytes are always written contiguously, so skip over the end of the ring if they would
+  // otherwise wrap around.
+  const uint64_t capacity = _header->capacity;
+  if (nbytes > capacity)
+    return false;
+  uint64_t start = _head;
+  if (start % capacity + nbytes > capacity)
+    start += capacity - start % capacity;
+  if (start + nbytes - _header->tail.load(std::memory_order_acquire) > capacity)
+    return false;
+
+  offset = start % capacity;
+  std::memcpy(_data + offset, data, nbytes);
+  _head = end = start + nbytes;
+  return true;
+}
+
+
+void
+SharedRing::release(const uint64_t end) {
+  _header->tail.store(end, std::memory_order_release);
+}
+
+
+std::string
+SharedRing::unique_name(const std::string &tag) {
+  std::random_device random;
+  std::ostringstream name;
+  name << "/" << SHARED_RING_PREFIX << ::getpid() << "-" << tag << "-" << std::hex << random();
+  return name.str();
+}
+
+
+void
+SharedRing::remove_stale(void) {
+  // POSIX does not provide a way to list the shared memory objects, but Linux keeps them in a
+  // tmpfs, so this does nothing elsewhere.
+  DIR *const dir = ::opendir(SHM_DIR);
+  if (dir == nullptr)
+    return;
+  const size_t prefix_len = std::strlen(SHARED_RING_PREFIX);
+  while (const struct dirent *const entry = ::readdir(dir)) {
+    if (std::strncmp(entry->d_name, SHARED_RING_PREFIX, prefix_len) != 0)
+      continue;
+    char *end;
+    const long pid = std::strtol(entry->d_name + prefix_len, &end, 10);
+    if (pid <= 0 || *end != '-')
+      continue;
+    if (::kill(static_cast<pid_t>(pid), 0) == -1 && errno == ESRCH) {
+      const std::string name = std::string("/") + entry->d_name;
+      if (::shm_unlink(name.c_str()) == 0)
+        LOG(INFO) << "Removed shared memory ring " << name << " left behind by process " << pid << std::endl;
+    }
+  }
+  ::closedir(dir);
+}
+
+
+// ============================================================================
+// SharedRings
+// ============================================================================
+SharedRing &
+SharedRings::attach(const std::string &name) {
+  std::unique_ptr<SharedRing> &ring = _rings[name];
+  if (ring == nullptr)
+    ring.reset(new SharedRing(name));
+  return *ring;
+}
+
+}  // namespace dr_dist
+}  // namespace schwa
@@ -0,0 +1,103 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_DRDIST_SHM_H_
+#define SCHWA_DRDIST_SHM_H_
+
+#include <schwa/_base.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+
+namespace schwa {
+  namespace dr_dist {
+
+    /**
+     * A ring buffer in a named POSIX shared memory object, through which the bodies of batches are
+     * passed between processes on the same host. Only a small descriptor of where the body lives
+     * in the ring then needs to travel over ØMQ.
+     *
+     * Each ring has a single producer, which creates the shared memory object and appends to the
+     * ring, and whose consumers attach to it by name. Space is reclaimed by advancing the tail of
+     * the ring past bytes which are no longer needed, which is done either by the consumer or by
+     * the producer, depending on which side knows when the bytes have been used.
+     **/
+    class SharedRing {
+    public:
+      static constexpr const size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;  // 64MB
+
+    private:
+      struct Header;
+
+      const std::string _name;
+      const bool _owner;
+      size_t _mapped_nbytes;
+      Header *_header;
+      char *_data;
+      uint64_t _head;
+
+      void _map(int fd, size_t nbytes);
+
+    public:
+      /**
+       * Creates a new shared memory ring called \p name which can hold \p capacity bytes, or
+       * attaches to the existing ring called \p name if \p capacity is zero. Throws an IOException
+       * if the shared memory object cannot be created, reserved or mapped.
+       **/
+      explicit SharedRing(const std::string &name, size_t capacity=0);
+      ~SharedRing(void);
+
+      inline const std::string &name(void) const { return _name; }
+      size_t capacity(void) const;
+
+      /** The position up to which the ring has been released, as last passed to \ref release. */
+      uint64_t tail(void) const;
+
+      inline const char *data(const uint64_t offset) const { return _data + offset; }
+
+      /**
+       * Copies \p nbytes bytes from \p data into the ring, setting \p offset to where they were
+       * written and \p end to the position to release up to once they are no longer needed.
+       * Returns false without writing anything if the ring does not currently have room.
+       **/
+      bool write(const char *data, size_t nbytes, uint64_t &offset, uint64_t &end);
+
+      /** Reclaims the space in the ring up to \p end, as returned by \ref write. */
+      void release(uint64_t end);
+
+      /** Returns a ring name which is unique to this process and \p tag. */
+      static std::string unique_name(const std::string &tag);
+
+      /**
+       * Removes the rings whose producers are no longer running, such as after a crash. This is
+       * done automatically before a process creates its first ring.
+       **/
+      static void remove_stale(void);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(SharedRing);
+    };
+
+
+    /**
+     * The rings a consumer has attached to, keyed by name, so that each ring is only mapped once.
+     **/
+    class SharedRings {
+    private:
+      std::unordered_map<std::string, std::unique_ptr<SharedRing>> _rings;
+
+    public:
+      SharedRings(void) { }
+      ~SharedRings(void) { }
+
+      /** Returns the ring called \p name, attaching to it if needed. */
+      SharedRing &attach(const std::string &name);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(SharedRings);
+    };
+
+  }
+}
+
+#endif  // SCHWA_DRDIST_SHM_H_
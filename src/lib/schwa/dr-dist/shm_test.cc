@@ -0,0 +1,80 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <schwa/dr-dist/shm.h>
+#include <schwa/exception.h>
+
+
+namespace schwa {
+namespace dr_dist {
+
+SUITE(schwa__dr_dist__shm) {
+
+TEST(write_release) {
+  const std::string name = SharedRing::unique_name("test");
+  SharedRing producer(name, 100);
+  SharedRing consumer(name);
+  CHECK_EQUAL(100, consumer.capacity());
+  CHECK_EQUAL(0, consumer.tail());
+
+  const std::string a(40, 'a'), b(40, 'b'), c(40, 'c');
+  uint64_t offset, end;
+  CHECK(producer.write(a.data(), a.size(), offset, end));
+  CHECK_EQUAL(0, offset);
+  CHECK_EQUAL(40, end);
+  CHECK(producer.write(b.data(), b.size(), offset, end));
+  CHECK_EQUAL(40, offset);
+  CHECK_EQUAL(80, end);
+  CHECK_EQUAL(b, std::string(consumer.data(offset), b.size()));
+
+  // There is no room until the consumer releases the first body, after which the next one wraps
+  // around to the start of the ring rather than being split over its end.
+  CHECK(!producer.write(c.data(), c.size(), offset, end));
+  consumer.release(40);
+  CHECK_EQUAL(40, producer.tail());
+  CHECK(producer.write(c.data(), c.size(), offset, end));
+  CHECK_EQUAL(0, offset);
+  CHECK_EQUAL(140, end);
+  CHECK_EQUAL(c, std::string(consumer.data(offset), c.size()));
+
+  CHECK(!producer.write(nullptr, 101, offset, end));
+}
+
+
+TEST(attach_missing) {
+  const std::string name = SharedRing::unique_name("test");
+  CHECK_THROW(SharedRing ring(name), IOException);
+  {
+    SharedRing producer(name, 100);
+    SharedRing consumer(name);
+  }
+  // The producer removes the ring when it goes away.
+  CHECK_THROW(SharedRing ring(name), IOException);
+}
+
+
+TEST(remove_stale) {
+  // A ring named for a process which cannot exist is removed, and one for this process is not.
+  const std::string stale = "/dr-dist-2147483000-test-stale";
+  const int fd = ::shm_open(stale.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  CHECK(fd != -1);
+  ::close(fd);
+  SharedRing live(SharedRing::unique_name("test"), 100);
+
+  SharedRing::remove_stale();
+  CHECK(::shm_open(stale.c_str(), O_RDWR, 0) == -1);
+  SharedRing consumer(live.name());
+  CHECK_EQUAL(100, consumer.capacity());
+}
+
+}  // SUITE
+
+}  // namespace dr_dist
+}  // namespace schwa
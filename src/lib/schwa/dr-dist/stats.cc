@@ -0,0 +1,129 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/dr-dist/stats.h>
+
+#include <iomanip>
+#include <iostream>
+
+
+namespace schwa {
+namespace dr_dist {
+
+// ============================================================================
+// LatencyHistogram
+// ============================================================================
+LatencyHistogram::LatencyHistogram(void) : _count(0), _total(0) {
+  _counts.fill(0);
+}
+
+
+void
+LatencyHistogram::add(const std::chrono::steady_clock::duration latency) {
+  // Bucket i holds the latencies of less than 2^i milliseconds, and the last bucket the rest.
+  const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(latency).count();
+  size_t bucket = 0;
+  while (bucket + 1 != NBUCKETS && (static_cast<int64_t>(1) << bucket) <= ms)
+    ++bucket;
+  ++_counts[bucket];
+  ++_count;
+  _total += latency;
+}
+
+
+double
+LatencyHistogram::mean_ms(void) const {
+  if (_count == 0)
+    return 0;
+  return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(_total).count() / _count;
+}
+
+
+uint64_t
+LatencyHistogram::percentile_ms(const double p) const {
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket != NBUCKETS; ++bucket) {
+    seen += _counts[bucket];
+    if (seen != 0 && seen >= p*_count)
+      return static_cast<uint64_t>(1) << bucket;
+  }
+  return static_cast<uint64_t>(1) << (NBUCKETS - 1);
+}
+
+
+std::ostream &
+operator <<(std::ostream &out, const LatencyHistogram &histogram) {
+  out << "n=" << histogram.count();
+  out << " mean=" << std::fixed << std::setprecision(1) << histogram.mean_ms() << "ms";
+  out << " p50<" << histogram.percentile_ms(0.5) << "ms";
+  out << " p90<" << histogram.percentile_ms(0.9) << "ms";
+  out << " p99<" << histogram.percentile_ms(0.99) << "ms";
+  return out;
+}
+
+
+// ============================================================================
+// Stats
+// ============================================================================
+Stats::Stats(void) {
+  reset();
+}
+
+
+void
+Stats::reset(void) {
+  ndocs_sent = 0;
+  nbytes_sent = 0;
+  ndocs_resent = 0;
+  ndocs_received = 0;
+  nbytes_received = 0;
+  ndocs_in_flight = 0;
+  reorder_ndocs = 0;
+  reorder_nbytes = 0;
+  reorder_nspilled = 0;
+  workers.clear();
+
+  _started = _sampled = std::chrono::steady_clock::now();
+  _sampled_ndocs_sent = _sampled_nbytes_sent = 0;
+  _sampled_ndocs_received = _sampled_nbytes_received = 0;
+  _docs_sent_rate = _bytes_sent_rate = 0;
+  _docs_received_rate = _bytes_received_rate = 0;
+}
+
+
+void
+Stats::sample(void) {
+  const auto now = std::chrono::steady_clock::now();
+  const double secs = std::chrono::duration_cast<std::chrono::duration<double>>(now - _sampled).count();
+  if (secs <= 0)
+    return;
+
+  const uint64_t ndocs_sent = this->ndocs_sent, nbytes_sent = this->nbytes_sent;
+  _docs_sent_rate = (ndocs_sent - _sampled_ndocs_sent) / secs;
+  _bytes_sent_rate = (nbytes_sent - _sampled_nbytes_sent) / secs;
+  _docs_received_rate = (ndocs_received - _sampled_ndocs_received) / secs;
+  _bytes_received_rate = (nbytes_received - _sampled_nbytes_received) / secs;
+
+  _sampled = now;
+  _sampled_ndocs_sent = ndocs_sent;
+  _sampled_nbytes_sent = nbytes_sent;
+  _sampled_ndocs_received = ndocs_received;
+  _sampled_nbytes_received = nbytes_received;
+}
+
+
+void
+Stats::report(std::ostream &out) const {
+  const double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(_sampled - _started).count();
+  out << std::fixed << std::setprecision(1);
+  out << "elapsed=" << elapsed << "s";
+  out << " sent=" << ndocs_sent << " docs (" << _docs_sent_rate << "/s) " << nbytes_sent << " bytes (" << _bytes_sent_rate << "/s)";
+  out << " received=" << ndocs_received << " docs (" << _docs_received_rate << "/s) " << nbytes_received << " bytes (" << _bytes_received_rate << "/s)";
+  out << " resent=" << ndocs_resent;
+  out << " in_flight=" << ndocs_in_flight;
+  out << " reorder=" << reorder_ndocs << " docs (" << reorder_nbytes << " bytes in memory, " << reorder_nspilled << " docs spilled)";
+  out << " workers=" << workers.size() << std::endl;
+  for (const auto &pair : workers)
+    out << "worker " << std::hex << std::setw(16) << std::setfill('0') << pair.first << std::dec << std::setfill(' ') << " " << pair.second << std::endl;
+}
+
+}  // namespace dr_dist
+}  // namespace schwa
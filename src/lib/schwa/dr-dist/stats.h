@@ -0,0 +1,99 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_DRDIST_STATS_H_
+#define SCHWA_DRDIST_STATS_H_
+
+#include <schwa/_base.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
+#include <map>
+
+
+namespace schwa {
+  namespace dr_dist {
+
+    /**
+     * A histogram of latencies in power-of-two millisecond buckets, which is cheap enough to keep
+     * per worker and precise enough to tell a straggling worker apart from the rest.
+     **/
+    class LatencyHistogram {
+    public:
+      static constexpr const size_t NBUCKETS = 24;
+
+    private:
+      std::array<uint64_t, NBUCKETS> _counts;
+      uint64_t _count;
+      std::chrono::steady_clock::duration _total;
+
+    public:
+      LatencyHistogram(void);
+
+      inline uint64_t count(void) const { return _count; }
+
+      void add(std::chrono::steady_clock::duration latency);
+
+      /** The mean latency in milliseconds. */
+      double mean_ms(void) const;
+
+      /**
+       * An upper bound in milliseconds on the latency below which the fraction \p p of the
+       * latencies fall, to the precision of the buckets.
+       **/
+      uint64_t percentile_ms(double p) const;
+    };
+
+    std::ostream &operator <<(std::ostream &out, const LatencyHistogram &histogram);
+
+
+    /**
+     * The runtime counters of a dr-dist job. The source counts what it sends, from its own thread,
+     * and the sink counts everything else and reports on both. \ref sample is called periodically
+     * by the sink to compute the rates over the period since it was last called.
+     **/
+    class Stats {
+    public:
+      // Updated by the source.
+      std::atomic<uint64_t> ndocs_sent;
+      std::atomic<uint64_t> nbytes_sent;
+      std::atomic<uint64_t> ndocs_resent;
+
+      // Updated by the sink.
+      uint64_t ndocs_received;
+      uint64_t nbytes_received;
+      uint64_t ndocs_in_flight;
+      uint64_t reorder_ndocs;
+      uint64_t reorder_nbytes;
+      uint64_t reorder_nspilled;
+      std::map<uint64_t, LatencyHistogram> workers;
+
+    private:
+      std::chrono::steady_clock::time_point _started;
+      std::chrono::steady_clock::time_point _sampled;
+      uint64_t _sampled_ndocs_sent;
+      uint64_t _sampled_nbytes_sent;
+      uint64_t _sampled_ndocs_received;
+      uint64_t _sampled_nbytes_received;
+      double _docs_sent_rate;
+      double _bytes_sent_rate;
+      double _docs_received_rate;
+      double _bytes_received_rate;
+
+    public:
+      Stats(void);
+
+      void reset(void);
+      void sample(void);
+
+      /** Writes a one line summary of the job followed by a line per worker. */
+      void report(std::ostream &out) const;
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(Stats);
+    };
+
+  }
+}
+
+#endif  // SCHWA_DRDIST_STATS_H_
@@ -0,0 +1,76 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include <schwa/dr-dist/stats.h>
+
+
+namespace schwa {
+namespace dr_dist {
+
+SUITE(schwa__dr_dist__stats) {
+
+TEST(latency_histogram__buckets) {
+  // Bucket i holds latencies of less than 2^i milliseconds.
+  const auto percentile_of = [](const std::chrono::steady_clock::duration latency) {
+    LatencyHistogram histogram;
+    histogram.add(latency);
+    return histogram.percentile_ms(1.0);
+  };
+  CHECK_EQUAL(1, percentile_of(std::chrono::microseconds(500)));
+  CHECK_EQUAL(2, percentile_of(std::chrono::milliseconds(1)));
+  CHECK_EQUAL(4, percentile_of(std::chrono::milliseconds(3)));
+  CHECK_EQUAL(4, percentile_of(std::chrono::milliseconds(2)));
+  CHECK_EQUAL(1024, percentile_of(std::chrono::milliseconds(1000)));
+  CHECK_EQUAL(1 << (LatencyHistogram::NBUCKETS - 1), percentile_of(std::chrono::hours(24)));
+}
+
+
+TEST(latency_histogram__percentiles) {
+  LatencyHistogram histogram;
+  CHECK_EQUAL(0, histogram.count());
+  CHECK_EQUAL(0.0, histogram.mean_ms());
+
+  for (unsigned int i = 0; i != 50; ++i)
+    histogram.add(std::chrono::milliseconds(0));
+  for (unsigned int i = 0; i != 40; ++i)
+    histogram.add(std::chrono::milliseconds(3));
+  for (unsigned int i = 0; i != 10; ++i)
+    histogram.add(std::chrono::milliseconds(1000));
+
+  CHECK_EQUAL(100, histogram.count());
+  CHECK_CLOSE(101.2, histogram.mean_ms(), 1e-9);
+  CHECK_EQUAL(1, histogram.percentile_ms(0.5));
+  CHECK_EQUAL(4, histogram.percentile_ms(0.51));
+  CHECK_EQUAL(4, histogram.percentile_ms(0.9));
+  CHECK_EQUAL(1024, histogram.percentile_ms(0.91));
+  CHECK_EQUAL(1024, histogram.percentile_ms(0.99));
+
+  std::ostringstream out;
+  out << histogram;
+  CHECK_EQUAL("n=100 mean=101.2ms p50<1ms p90<4ms p99<1024ms", out.str());
+}
+
+
+TEST(report) {
+  Stats stats;
+  stats.ndocs_sent = 10;
+  stats.ndocs_received = 7;
+  stats.workers[0xabc].add(std::chrono::milliseconds(3));
+
+  std::ostringstream out;
+  stats.report(out);
+  const std::string report = out.str();
+  CHECK(report.find(" sent=10 docs ") != std::string::npos);
+  CHECK(report.find(" received=7 docs ") != std::string::npos);
+  CHECK(report.find(" workers=1\n") != std::string::npos);
+  CHECK(report.find("worker 0000000000000abc n=1 ") != std::string::npos);
+}
+
+}  // SUITE
+
+}  // namespace dr_dist
+}  // namespace schwa
@@ -1,15 +1,22 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <algorithm>
 #include <cerrno>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <functional>
 #include <memory>
-#include <sstream>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <schwa/config.h>
 #include <schwa/dr.h>
 #include <schwa/dr/config.h>
 #include <schwa/dr-dist/helpers.h>
+#include <schwa/exception.h>
 #include <schwa/io/logging.h>
 
 #include <zmq.h>
@@ -22,41 +29,46 @@ namespace io = schwa::io;
 namespace schwa {
 namespace dr_dist {
 
+/**
+ * Decodes the received document in place, runs \p callback over it, and serialises the result
+ * straight into the body of the \p reply batch. A document which cannot be read is replied to
+ * with no bytes.
+ **/
 template <typename DOC>
-static std::string
-process_doc(const std::string &input_doc_bytes, typename DOC::Schema &schema, std::function<void(DOC &)> callback) {
-  std::istringstream in(input_doc_bytes);
-  std::ostringstream out;
-
-  dr::Reader reader(in, schema);
-
+static void
+process_doc(const uint64_t doc_num, const char *const input_doc_bytes, const size_t input_doc_nbytes, dr::Reader &reader, dr::Writer &writer, std::function<void(DOC &)> callback, Batch &reply) {
   DOC doc;
-  if (!(reader >> doc)) {
-    LOG(ERROR) << "Failed to read received document" << std::endl;
-    return "";
+  try {
+    reader.read(doc, input_doc_bytes, input_doc_nbytes);
+  }
+  catch (dr::ReaderException &e) {
+    LOG(ERROR) << "Failed to read received document: " << e.what() << std::endl;
+    reply.add(doc_num, nullptr, 0);
+    return;
   }
 
-  LOG(DEBUG) << "Processing document " << input_doc_bytes.size() << std::endl;
+  LOG(DEBUG) << "Processing document " << input_doc_nbytes << std::endl;
   callback(doc);
 
-  dr::Writer writer(out, schema);
-  writer << doc;
-
-  return out.str();
+  reply.add(doc_num, doc, writer);
 }
 
 
 template <typename DOC>
 static bool
-drworker_recv(void *const source, void *const sink, void *const control, typename DOC::Schema &schema, std::function<void(DOC &)> callback) {
-  size_t buffer_written;
-  size_t buffer_len = 2*1024*1024;  // 2MB
-  std::unique_ptr<char[]> buffer(new char[buffer_len]);
-
+drworker_recv(void *const source, void *const sink, void *const control, const uint64_t worker_id, typename DOC::Schema &schema, std::function<void(DOC &)> callback, SharedRing *const reply_ring) {
+  Message received;
   MessageType msg_type;
   uint64_t doc_num;
   std::string doc_bytes;
 
+  std::vector<BatchDoc> batch_docs;
+  SharedRings rings;
+  Batch reply;
+  reply.set_ring(reply_ring);
+  dr::Reader reader(schema);
+  dr::Writer writer(schema);
+
   std::string msg;
 
   // Setup ØMQ polling between the source and control sockets.
@@ -73,26 +85,45 @@ drworker_recv(void *const source, void *const sink, void *const control, typenam
       return false;
     }
 
-    // Receive the message on the socket that was polled.
+    // Receive the message on the socket that was polled. Control messages take priority, so that
+    // a worker stops promptly once the sink is done rather than working through re-sent documents.
     void *socket = nullptr;
-    if (poll_items[0].revents & ZMQ_POLLIN)
-      socket = source;
-    else if (poll_items[1].revents & ZMQ_POLLIN)
+    if (poll_items[1].revents & ZMQ_POLLIN)
       socket = control;
+    else if (poll_items[0].revents & ZMQ_POLLIN)
+      socket = source;
     else
       continue;
-    if (!recv_multipart(socket, buffer, buffer_len, buffer_written))
+    if (!received.recv(socket))
       return false;
 
-    // Decode the received message.
-    unpack_message(buffer.get(), buffer_written, msg_type, doc_num, doc_bytes);
-
-    // Act upon the received message.
+    // Decode and act upon the received message. Batches are claimed so that the sink knows which
+    // documents to re-send if this worker dies. Documents are replied to with a batch of the
+    // processed documents. A batch which cannot be decoded, such as when its shared memory ring
+    // cannot be reached, would otherwise never be replied to, so the worker exits and leaves the
+    // sink to re-send its documents.
+    msg_type = unpack_message_type(received.data(0), received.size(0));
     switch (msg_type) {
+    case MessageType::DOCUMENT_BATCH:
+    case MessageType::DOCUMENT_BATCH_SHM:
+      if (!unpack_batch(received, batch_docs, &rings)) {
+        LOG(CRITICAL) << "Failed to decode a batch of documents. Shutting down." << std::endl;
+        return false;
+      }
+      if (worker_id != 0) {
+        msg = build_claim(worker_id, batch_docs);
+        if (!safe_zmq_send(sink, msg.c_str(), msg.size(), 0))
+          return false;
+      }
+      for (const BatchDoc &doc : batch_docs)
+        process_doc(doc.doc_num, doc.data, doc.nbytes, reader, writer, callback, reply);
+      if (!reply.send(sink))
+        return false;
+      break;
     case MessageType::DOCUMENT:
-      doc_bytes = process_doc(doc_bytes, schema, callback);
-      msg = build_message(MessageType::DOCUMENT, doc_num, doc_bytes);
-      if (!safe_zmq_send(sink, msg.c_str(), msg.size(), 0))
+      unpack_message(received.data(0), received.size(0), msg_type, doc_num, doc_bytes);
+      process_doc(doc_num, doc_bytes.data(), doc_bytes.size(), reader, writer, callback, reply);
+      if (!reply.send(sink))
         return false;
       break;
     case MessageType::TERMINATE:
@@ -109,13 +140,250 @@ drworker_recv(void *const source, void *const sink, void *const control, typenam
 }
 
 
+/**
+ * Runs the receive, process and send stages of a worker loop on three threads, so that the user
+ * callback never waits on the network: the next messages are prefetched and decoded while the
+ * callback runs, and the processed documents are encoded and sent afterwards. A fixed pool of
+ * \p depth work items circulates between the stages, which bounds the queues in between them and
+ * so the number of messages held by the worker at once.
+ **/
+template <typename DOC>
+class PipelinedWorker {
+public:
+  static constexpr const long POLL_TIMEOUT_MS = 100;
+
+private:
+  class Work {
+  public:
+    Message received;
+    std::string doc_bytes;
+    std::vector<BatchDoc> docs;
+    std::vector<std::unique_ptr<DOC>> results;
+
+    Work(void) { }
+
+  private:
+    SCHWA_DISALLOW_COPY_AND_ASSIGN(Work);
+  };
+
+  void *const _source;
+  void *const _sink;
+  void *const _control;
+  void *const _claims;
+  SharedRing *const _reply_ring;
+  const uint64_t _worker_id;
+  typename DOC::Schema &_schema;
+  std::function<void(DOC &)> _callback;
+
+  // The rings are attached to by the receiving stage, but must stay mapped until the other stages
+  // have finished with the documents in them.
+  SharedRings _rings;
+  std::vector<std::unique_ptr<Work>> _work;
+  std::deque<Work *> _free;
+  std::deque<Work *> _received;
+  std::deque<Work *> _processed;
+  bool _done_receiving;
+  bool _done_processing;
+  bool _failed;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+
+  void
+  _fail(void) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _failed = true;
+    _cv.notify_all();
+  }
+
+  void
+  _finish(bool &done) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    done = true;
+    _cv.notify_all();
+  }
+
+  void
+  _push(std::deque<Work *> &queue, Work *const work) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    queue.push_back(work);
+    _cv.notify_all();
+  }
+
+  /**
+   * Waits for the next work item on \p queue, returning nullptr on failure or once \p done has
+   * been set by the previous stage and the queue has been drained.
+   **/
+  Work *
+  _pop(std::deque<Work *> &queue, const bool &done) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [&](void) { return _failed || done || !queue.empty(); });
+    if (_failed || queue.empty())
+      return nullptr;
+    Work *const work = queue.front();
+    queue.pop_front();
+    return work;
+  }
+
+  void
+  _receive(void) {
+    zmq_pollitem_t poll_items[] = {
+        {_source, 0, ZMQ_POLLIN, 0},
+        {_control, 0, ZMQ_POLLIN, 0},
+    };
+    std::string msg;
+    MessageType msg_type;
+    uint64_t doc_num;
+
+    while (Work *const work = _pop(_free, _failed)) {
+      // Wait for a message, giving up if another stage has failed. Control messages take priority.
+      void *socket = nullptr;
+      while (socket == nullptr) {
+        if (zmq_poll(poll_items, sizeof(poll_items)/sizeof(zmq_pollitem_t), POLL_TIMEOUT_MS) == -1) {
+          LOG(CRITICAL) << "Call to zmq_poll failed: " << zmq_strerror(zmq_errno()) << std::endl;
+          _fail();
+          return;
+        }
+        if (poll_items[1].revents & ZMQ_POLLIN)
+          socket = _control;
+        else if (poll_items[0].revents & ZMQ_POLLIN)
+          socket = _source;
+        else {
+          std::lock_guard<std::mutex> lock(_mutex);
+          if (_failed)
+            return;
+        }
+      }
+      if (!work->received.recv(socket)) {
+        _fail();
+        return;
+      }
+
+      // Decode the message into the documents to process. A single document is treated as a
+      // batch of one, and batches are claimed so that the sink knows which documents to re-send
+      // if this worker dies. As in drworker_recv, a batch which cannot be decoded stops the worker.
+      msg_type = unpack_message_type(work->received.data(0), work->received.size(0));
+      switch (msg_type) {
+      case MessageType::DOCUMENT_BATCH:
+      case MessageType::DOCUMENT_BATCH_SHM:
+        if (!unpack_batch(work->received, work->docs, &_rings)) {
+          LOG(CRITICAL) << "Failed to decode a batch of documents. Shutting down." << std::endl;
+          _push(_free, work);
+          _fail();
+          return;
+        }
+        if (_worker_id != 0) {
+          msg = build_claim(_worker_id, work->docs);
+          if (!safe_zmq_send(_claims, msg.c_str(), msg.size(), 0)) {
+            _fail();
+            return;
+          }
+        }
+        _push(_received, work);
+        break;
+      case MessageType::DOCUMENT:
+        unpack_message(work->received.data(0), work->received.size(0), msg_type, doc_num, work->doc_bytes);
+        work->docs.assign(1, BatchDoc{doc_num, work->doc_bytes.data(), work->doc_bytes.size()});
+        _push(_received, work);
+        break;
+      case MessageType::TERMINATE:
+        LOG(INFO) << "Received command to terminate. Shutting down." << std::endl;
+        _push(_free, work);
+        _finish(_done_receiving);
+        return;
+      default:
+        LOG(ERROR) << "Unknown message type received: " << static_cast<uint8_t>(msg_type) << std::endl;
+        _push(_free, work);
+        break;
+      }
+    }
+  }
+
+  void
+  _process(void) {
+    dr::Reader reader(_schema);
+    while (Work *const work = _pop(_received, _done_receiving)) {
+      work->results.resize(work->docs.size());
+      for (size_t i = 0; i != work->docs.size(); ++i) {
+        const BatchDoc &input = work->docs[i];
+        std::unique_ptr<DOC> &doc = work->results[i];
+        doc.reset(new DOC());
+        try {
+          reader.read(*doc, input.data, input.nbytes);
+        }
+        catch (dr::ReaderException &e) {
+          LOG(ERROR) << "Failed to read received document: " << e.what() << std::endl;
+          doc.reset();
+          continue;
+        }
+        LOG(DEBUG) << "Processing document " << input.nbytes << std::endl;
+        _callback(*doc);
+      }
+      _push(_processed, work);
+    }
+    _finish(_done_processing);
+  }
+
+  void
+  _send(void) {
+    dr::Writer writer(_schema);
+    Batch reply;
+    reply.set_ring(_reply_ring);
+    while (Work *const work = _pop(_processed, _done_processing)) {
+      for (size_t i = 0; i != work->docs.size(); ++i) {
+        if (work->results[i] == nullptr)
+          reply.add(work->docs[i].doc_num, nullptr, 0);
+        else
+          reply.add(work->docs[i].doc_num, *work->results[i], writer);
+        work->results[i].reset();
+      }
+      if (!reply.send(_sink)) {
+        _fail();
+        return;
+      }
+      _push(_free, work);
+    }
+  }
+
+public:
+  PipelinedWorker(void *source, void *sink, void *control, void *claims, SharedRing *reply_ring, uint64_t worker_id, typename DOC::Schema &schema, std::function<void(DOC &)> callback, unsigned int depth) :
+      _source(source),
+      _sink(sink),
+      _control(control),
+      _claims(claims),
+      _reply_ring(reply_ring),
+      _worker_id(worker_id),
+      _schema(schema),
+      _callback(callback),
+      _done_receiving(false),
+      _done_processing(false),
+      _failed(false) {
+    for (unsigned int i = 0; i != depth; ++i) {
+      _work.emplace_back(new Work());
+      _free.push_back(_work.back().get());
+    }
+  }
+
+  /** Runs the pipeline until the sink says to terminate, calling the callback on this thread. */
+  bool
+  run(void) {
+    std::thread receiver(&PipelinedWorker::_receive, this);
+    std::thread sender(&PipelinedWorker::_send, this);
+    _process();
+    receiver.join();
+    sender.join();
+    return !_failed;
+  }
+
+private:
+  SCHWA_DISALLOW_COPY_AND_ASSIGN(PipelinedWorker);
+};
+
+
 template <typename DOC>
 static bool
-drworker(const std::string &source_addr, const std::string &sink_addr, const std::string &control_addr, typename DOC::Schema &schema, std::function<void(DOC &)> callback) {
-  // Prepare the ØMQ context and connect to the sockets.
-  void *context, *source, *sink, *control;
-  if (!safe_zmq_ctx_new(context))
-    return false;
+drworker_thread(void *const context, const std::string &source_addr, const std::string &sink_addr, const std::string &control_addr, const uint64_t worker_id, typename DOC::Schema &schema, std::function<void(DOC &)> callback, const unsigned int pipeline_depth) {
+  // Connect to the sockets.
+  void *source, *sink, *control;
   if (!safe_zmq_socket_connect(context, source, ZMQ_PULL, source_addr))
     return false;
   if (!safe_zmq_socket_connect(context, sink, ZMQ_PUSH, sink_addr))
@@ -127,13 +395,88 @@ drworker(const std::string &source_addr, const std::string &sink_addr, const std
     return false;
   }
 
-  // Receive and process documents from the source, sending results back to the sink.
-  bool success = drworker_recv(source, sink, control, schema, callback);
+  // When the sink is on the same host, send the processed documents back through shared memory.
+  std::unique_ptr<SharedRing> reply_ring;
+  if (is_shm_addr(sink_addr)) {
+    try {
+      reply_ring.reset(new SharedRing(SharedRing::unique_name("worker"), SharedRing::DEFAULT_CAPACITY));
+    }
+    catch (IOException &e) {
+      LOG(WARNING) << "Failed to create shared memory, so sending documents inline: " << e.what() << std::endl;
+    }
+  }
 
-  // Close the sockets and destroy the ØMQ context.
+  // Receive and process documents from the source, sending results back to the sink. When
+  // pipelining, the receiving stage sends its claims on a socket of its own.
+  bool success;
+  if (pipeline_depth == 0)
+    success = drworker_recv(source, sink, control, worker_id, schema, callback, reply_ring.get());
+  else {
+    void *claims;
+    if (!safe_zmq_socket_connect(context, claims, ZMQ_PUSH, sink_addr))
+      return false;
+    PipelinedWorker<DOC> pipeline(source, sink, control, claims, reply_ring.get(), worker_id, schema, callback, pipeline_depth);
+    success = pipeline.run();
+    success &= safe_zmq_close(claims);
+  }
+
+  // Close the sockets.
   success &= safe_zmq_close(control);
   success &= safe_zmq_close(sink);
   success &= safe_zmq_close(source);
+  return success;
+}
+
+
+/**
+ * Runs \p nthreads worker loops which share one ØMQ context, the schema, and \p callback, along
+ * with whatever model state the callback holds. Each loop has its own sockets and buffers, and the
+ * source balances documents across them as it would across separate worker processes. When
+ * \p nthreads is greater than one, \p callback must be safe to call from several threads at once.
+ * If \p pipeline_depth is non-zero, each loop is run as a \ref PipelinedWorker with that many
+ * messages in flight.
+ **/
+template <typename DOC>
+static bool
+drworker(const std::string &source_addr, const std::string &sink_addr, const std::string &control_addr, typename DOC::Schema &schema, std::function<void(DOC &)> callback, const unsigned int heartbeat_interval_ms=0, unsigned int nthreads=1, const unsigned int pipeline_depth=0) {
+  // Prepare the ØMQ context.
+  void *context;
+  if (!safe_zmq_ctx_new(context))
+    return false;
+
+  // Identify this worker process to the sink with regular heartbeats if asked to. The threads
+  // share the one identity, as they live and die together.
+  uint64_t worker_id = 0;
+  std::unique_ptr<Heartbeat> heartbeat;
+  if (heartbeat_interval_ms != 0) {
+    std::random_device random;
+    while (worker_id == 0)
+      worker_id = (static_cast<uint64_t>(random()) << 32) | random();
+    heartbeat.reset(new Heartbeat(context, sink_addr, worker_id, heartbeat_interval_ms));
+  }
+
+  // Run the worker loops, the last one on this thread.
+  nthreads = std::max(nthreads, 1u);
+  std::vector<std::thread> threads;
+  std::unique_ptr<bool[]> successes(new bool[nthreads]);
+  // A loop which fails may leave documents it was sent unprocessed, so heartbeats stop for the
+  // whole process, letting the sink re-send them once the other loops go quiet too.
+  const auto run = [&](const unsigned int i) {
+    successes[i] = drworker_thread(context, source_addr, sink_addr, control_addr, worker_id, schema, callback, pipeline_depth);
+    if (!successes[i] && heartbeat != nullptr)
+      heartbeat->stop();
+  };
+  for (unsigned int i = 0; i + 1 < nthreads; ++i)
+    threads.emplace_back(run, i);
+  run(nthreads - 1);
+  for (std::thread &thread : threads)
+    thread.join();
+  heartbeat.reset();
+
+  // Destroy the ØMQ context.
+  bool success = true;
+  for (unsigned int i = 0; i != nthreads; ++i)
+    success &= successes[i];
   success &= safe_zmq_ctx_destroy(context);
   return success;
 }
@@ -143,10 +486,13 @@ template <typename DOC, typename LOGGER>
 int
 worker_main(const int argc, char **const argv, cf::Main &cfg, typename DOC::Schema &schema, std::function<void(DOC &)> callback) {
   // Build upon an option parser.
-  cf::Op<std::string> host(cfg, "host", "The network host to connect to", "127.0.0.1");
+  cf::Op<std::string> host(cfg, "host", "The network host to connect to (\"shm\" to pass documents through shared memory when on the same host)", "127.0.0.1");
   cf::Op<uint32_t> source_port(cfg, "source-port", "The network port to bind to on which to pull docrep documents", 7301);
   cf::Op<uint32_t> sink_port(cfg, "sink-port", "The network port to bind to on which to push docrep documents", 7302);
   cf::Op<uint32_t> control_port(cfg, "control-port", "The network port to bind to on which to subscribe to control messages", 7303);
+  cf::Op<unsigned int> heartbeat_interval(cfg, "heartbeat-interval", "The number of milliseconds between heartbeats sent to the sink so that it can re-send the documents of dead workers (0 for none)", 1000);
+  cf::Op<unsigned int> nthreads(cfg, "nthreads", 'j', "The number of threads to process documents with, which share the one copy of any models", 1);
+  cf::Op<unsigned int> pipeline_depth(cfg, "pipeline-depth", "The number of messages each thread holds at once, so that the next messages are received and the processed ones sent while documents are being processed (0 to receive, process and send one message at a time)", 4);
   dr::DocrepGroup dr(cfg, schema);
 
   // Parse argv.
@@ -157,7 +503,7 @@ worker_main(const int argc, char **const argv, cf::Main &cfg, typename DOC::Sche
   const std::string sink_addr = build_socket_addr(host(), sink_port());
   const std::string control_addr = build_socket_addr(host(), control_port());
 
-  const bool success = drworker(source_addr, sink_addr, control_addr, schema, callback);
+  const bool success = drworker(source_addr, sink_addr, control_addr, schema, callback, heartbeat_interval(), nthreads(), pipeline_depth());
   return success ? 0 : 1;
 }
 
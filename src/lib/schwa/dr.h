@@ -2,10 +2,12 @@
 #ifndef SCHWA_DR_H_
 #define SCHWA_DR_H_
 
+#include <schwa/dr/doc_index.h>
 #include <schwa/dr/exception.h>
 #include <schwa/dr/field_defs.h>
 #include <schwa/dr/fields.h>
 #include <schwa/dr/helpers.h>
+#include <schwa/dr/inverted_index.h>
 #include <schwa/dr/istore.h>
 #include <schwa/dr/reader.h>
 #include <schwa/dr/runtime.h>
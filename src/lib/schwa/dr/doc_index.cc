@@ -0,0 +1,163 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/dr/doc_index.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <schwa/dr/exception.h>
+#include <schwa/dr/reader.h>
+
+
+namespace schwa {
+namespace dr {
+
+namespace {
+
+/**
+ * Scans backwards from \p end for the start of a document which frames exactly up to \p end.
+ * When \p verify is set, the candidate is only accepted if it is at the start of \p data or if
+ * the bytes before it end with another framed document.
+ **/
+static bool
+find_doc_start(const char *const data, const size_t end, size_t &start, const bool verify) {
+  for (size_t p = end; p-- != 0; ) {
+    if (static_cast<uint8_t>(data[p]) != Reader::WIRE_VERSION)
+      continue;
+    if (frame_lazy_doc(data + p, end - p) != end - p)
+      continue;
+    size_t prev_start;
+    if (!verify || p == 0 || find_doc_start(data, p, prev_start, false)) {
+      start = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+
+const char *const DocIndex::SIDECAR_SUFFIX = ".offsets";
+
+
+DocIndex::DocIndex(void) : _offsets(1, 0) { }
+
+
+void
+DocIndex::clear(void) {
+  _offsets.clear();
+  _offsets.push_back(0);
+}
+
+
+size_t
+DocIndex::find(const uint64_t offset) const {
+  const auto it = std::upper_bound(_offsets.begin() + 1, _offsets.end(), offset);
+  return (it - _offsets.begin()) - 1;
+}
+
+
+void
+DocIndex::build(const char *const data, const size_t nbytes) {
+  clear();
+  size_t upto = 0;
+  while (upto != nbytes) {
+    const size_t doc_nbytes = frame_lazy_doc(data + upto, nbytes - upto);
+    if (doc_nbytes == 0) {
+      std::ostringstream msg;
+      msg << "Failed to frame a document at byte offset " << upto;
+      throw ReaderException(msg.str());
+    }
+    add(doc_nbytes);
+    upto += doc_nbytes;
+  }
+}
+
+
+void
+DocIndex::build(std::istream &in) {
+  clear();
+  std::string frame;
+  while (read_lazy_doc(in, frame))
+    add(frame.size());
+}
+
+
+void
+DocIndex::load(std::istream &in, const uint64_t total_nbytes) {
+  clear();
+  _offsets.pop_back();
+
+  // Lines without a number of bytes end where the next document starts.
+  std::string line;
+  uint64_t end = 0;
+  bool end_known = true;
+  for (size_t linenum = 1; std::getline(in, line); ++linenum) {
+    uint64_t offset, nbytes;
+    std::istringstream ss(line);
+    if (!(ss >> offset) || (end_known ? offset != end : offset < end)) {
+      std::ostringstream msg;
+      msg << "Invalid document offset on line " << linenum << " of the index";
+      throw ReaderException(msg.str());
+    }
+    _offsets.push_back(offset);
+    end_known = static_cast<bool>(ss >> nbytes);
+    end = end_known ? offset + nbytes : offset;
+  }
+  if (!end_known)
+    end = total_nbytes;
+
+  _offsets.push_back(end);
+  if (end != total_nbytes) {
+    std::ostringstream msg;
+    msg << "The index covers " << end << " bytes but the docrep file has " << total_nbytes << " bytes";
+    throw ReaderException(msg.str());
+  }
+}
+
+
+bool
+DocIndex::load_sidecar(const std::string &path, const uint64_t total_nbytes) {
+  std::ifstream in(sidecar_path(path));
+  if (!in)
+    return false;
+  load(in, total_nbytes);
+  return true;
+}
+
+
+void
+DocIndex::save(std::ostream &out, const bool include_nbytes) const {
+  for (size_t i = 0; i != ndocs(); ++i) {
+    out << _offsets[i];
+    if (include_nbytes)
+      out << ' ' << nbytes(i);
+    out << '\n';
+  }
+  out.flush();
+}
+
+
+std::string
+DocIndex::sidecar_path(const std::string &path) {
+  return path + SIDECAR_SUFFIX;
+}
+
+
+bool
+find_tail_offset(const char *const data, const size_t nbytes, const size_t ndocs, size_t &offset) {
+  size_t end = nbytes;
+  for (size_t i = 0; i != ndocs && end != 0; ++i) {
+    size_t start;
+    if (!find_doc_start(data, end, start, true))
+      return false;
+    end = start;
+  }
+  offset = end;
+  return true;
+}
+
+}  // namespace dr
+}  // namespace schwa
@@ -0,0 +1,99 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_DR_DOC_INDEX_H_
+#define SCHWA_DR_DOC_INDEX_H_
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <schwa/_base.h>
+
+namespace schwa {
+  namespace dr {
+
+    /**
+     * The byte offsets of each of the documents in a docrep file, allowing documents to be located
+     * without reading through the documents which precede them. An index can be built by framing
+     * the documents in a file, or loaded from a sidecar file next to the docrep file. The sidecar
+     * format is the output of dr-offsets: one line per document containing its byte offset,
+     * optionally followed by its number of bytes.
+     **/
+    class DocIndex {
+    public:
+      static const char *const SIDECAR_SUFFIX;
+
+    private:
+      std::vector<uint64_t> _offsets;  // ndocs() + 1 entries; the last is the end of the last doc.
+
+    public:
+      DocIndex(void);
+      ~DocIndex(void) { }
+
+      inline size_t ndocs(void) const { return _offsets.size() - 1; }
+      inline uint64_t offset(const size_t doc) const { return _offsets[doc]; }
+      inline uint64_t nbytes(const size_t doc) const { return _offsets[doc + 1] - _offsets[doc]; }
+      inline uint64_t total_nbytes(void) const { return _offsets.back(); }
+
+      /** Appends a document of \p nbytes bytes to the end of the index. */
+      inline void add(const uint64_t nbytes) { _offsets.push_back(_offsets.back() + nbytes); }
+
+      void clear(void);
+
+      /**
+       * Returns the number of the first document which ends after byte \p offset, or ndocs() if
+       * \p offset is at or past the end of the last document. Useful for splitting a file into
+       * ranges of documents of roughly equal byte size.
+       **/
+      size_t find(uint64_t offset) const;
+
+      /**
+       * Builds the index by framing each of the documents in the \p nbytes bytes pointed to by
+       * \p data, such as an mmapped docrep file. Throws a ReaderException if the data does not
+       * consist solely of complete documents.
+       **/
+      void build(const char *data, size_t nbytes);
+
+      /** Builds the index by framing each of the documents read from \p in. */
+      void build(std::istream &in);
+
+      /**
+       * Loads the index from \p in, in the sidecar format. Since the sidecar format does not
+       * require the size of the last document, \p total_nbytes provides the size of the docrep
+       * file the index is for. Throws a ReaderException if the index is malformed or does not
+       * cover exactly \p total_nbytes bytes.
+       **/
+      void load(std::istream &in, uint64_t total_nbytes);
+
+      /**
+       * Attempts to load the sidecar index for the docrep file at \p path, which is
+       * \p total_nbytes bytes in size. Returns false if no sidecar exists.
+       **/
+      bool load_sidecar(const std::string &path, uint64_t total_nbytes);
+
+      /** Writes the index to \p out in the sidecar format. */
+      void save(std::ostream &out, bool include_nbytes=true) const;
+
+      /** Returns the path of the sidecar index for the docrep file at \p path. */
+      static std::string sidecar_path(const std::string &path);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(DocIndex);
+    };
+
+
+    /**
+     * Finds the byte offset of the start of the last \p ndocs documents in the \p nbytes bytes
+     * pointed to by \p data, such as an mmapped docrep file, by scanning backwards from the end
+     * instead of framing every document from the start. As the wire format has no sync markers, a
+     * candidate start is only accepted if it frames exactly up to the start of the following
+     * document and is either at the start of \p data or immediately preceded by another framed
+     * document. The offset is written to \p offset, which is 0 if there are fewer than \p ndocs
+     * documents. Returns false if the documents could not be located this way, in which case the
+     * caller should fall back to framing forwards from the start.
+     **/
+    bool find_tail_offset(const char *data, size_t nbytes, size_t ndocs, size_t &offset);
+
+  }
+}
+
+#endif  // SCHWA_DR_DOC_INDEX_H_
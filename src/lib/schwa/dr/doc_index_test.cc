@@ -0,0 +1,205 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <sstream>
+#include <string>
+
+#include <schwa/dr.h>
+
+
+namespace schwa {
+namespace dr {
+
+namespace {
+
+class DocWithField : public Doc {
+public:
+  std::string name;
+
+  class Schema;
+};
+
+class DocWithField::Schema : public Doc::Schema<DocWithField> {
+public:
+  DR_FIELD(&DocWithField::name) name;
+
+  Schema(void) :
+    Doc::Schema<DocWithField>("DocWithField", "Some help text about this Doc class"),
+    name(*this, "name", "some help text about name", FieldMode::READ_WRITE)
+    { }
+  virtual ~Schema(void) { }
+};
+
+
+/**
+ * Writes a stream of documents whose names are of differing lengths, returning the stream.
+ **/
+std::string
+write_docs(const size_t ndocs) {
+  DocWithField::Schema schema;
+  std::ostringstream out;
+  Writer writer(out, schema);
+  for (size_t i = 0; i != ndocs; ++i) {
+    DocWithField doc;
+    doc.name = std::string(i + 1, 'x');
+    writer << doc;
+  }
+  return out.str();
+}
+
+}  // namespace
+
+
+SUITE(schwa__dr__doc_index) {
+
+TEST(frame_lazy_doc) {
+  const std::string data = write_docs(3);
+  std::istringstream in(data);
+  std::string frame;
+
+  size_t upto = 0, first_nbytes = 0;
+  while (read_lazy_doc(in, frame)) {
+    if (upto == 0)
+      first_nbytes = frame.size();
+    CHECK_EQUAL(frame.size(), frame_lazy_doc(data.data() + upto, data.size() - upto));
+    upto += frame.size();
+  }
+  CHECK_EQUAL(data.size(), upto);
+
+  // Truncated documents cannot be framed.
+  CHECK_EQUAL(0, frame_lazy_doc(data.data(), 0));
+  CHECK_EQUAL(0, frame_lazy_doc(data.data(), first_nbytes - 1));
+}
+
+
+TEST(append_lazy_doc) {
+  const std::string data = write_docs(3);
+  std::istringstream in(data);
+  std::string frames = "prefix";
+  while (append_lazy_doc(in, frames)) { }
+  CHECK_EQUAL("prefix" + data, frames);
+
+  // A truncated document leaves the buffer unchanged.
+  std::istringstream truncated(data.substr(0, data.size() - 1));
+  std::string frame;
+  CHECK(read_lazy_doc(truncated, frame));
+  frames = "prefix";
+  CHECK(append_lazy_doc(truncated, frames));
+  const std::string before = frames;
+  CHECK(!append_lazy_doc(truncated, frames));
+  CHECK_EQUAL(before, frames);
+}
+
+
+TEST(build) {
+  const std::string data = write_docs(5);
+  DocIndex index;
+  index.build(data.data(), data.size());
+  CHECK_EQUAL(5, index.ndocs());
+  CHECK_EQUAL(0, index.offset(0));
+  CHECK_EQUAL(data.size(), index.total_nbytes());
+  for (size_t i = 1; i != index.ndocs(); ++i) {
+    CHECK_EQUAL(index.offset(i - 1) + index.nbytes(i - 1), index.offset(i));
+    CHECK(index.nbytes(i) > index.nbytes(i - 1));
+  }
+
+  DocIndex from_stream;
+  std::istringstream in(data);
+  from_stream.build(in);
+  CHECK_EQUAL(index.ndocs(), from_stream.ndocs());
+  for (size_t i = 0; i != index.ndocs(); ++i)
+    CHECK_EQUAL(index.offset(i), from_stream.offset(i));
+
+  CHECK_THROW(index.build(data.data(), data.size() - 1), ReaderException);
+}
+
+
+TEST(find) {
+  const std::string data = write_docs(3);
+  DocIndex index;
+  index.build(data.data(), data.size());
+  CHECK_EQUAL(0, index.find(0));
+  CHECK_EQUAL(0, index.find(index.offset(1) - 1));
+  CHECK_EQUAL(1, index.find(index.offset(1)));
+  CHECK_EQUAL(2, index.find(index.total_nbytes() - 1));
+  CHECK_EQUAL(3, index.find(index.total_nbytes()));
+}
+
+
+TEST(find_tail_offset) {
+  const std::string data = write_docs(20);
+  DocIndex index;
+  index.build(data.data(), data.size());
+
+  size_t offset;
+  for (size_t n = 0; n <= index.ndocs(); ++n) {
+    CHECK(find_tail_offset(data.data(), data.size(), n, offset));
+    CHECK_EQUAL(index.offset(index.ndocs() - n), offset);
+  }
+  CHECK(find_tail_offset(data.data(), data.size(), 100, offset));
+  CHECK_EQUAL(0, offset);
+
+  // Trailing garbage means no documents can be found.
+  const std::string garbage = data + "xyz";
+  CHECK(!find_tail_offset(garbage.data(), garbage.size(), 1, offset));
+}
+
+
+TEST(find_tail_offset_fake_header) {
+  // A string field containing what looks like the start of a document, whose instances size is
+  // not an integer, must not be mistaken for a document nor abort the scan.
+  const std::string fake("\x02\x90\x90\xa1" "abc", 7);
+  CHECK_EQUAL(0, frame_lazy_doc(fake.data(), fake.size()));
+
+  DocWithField::Schema schema;
+  std::ostringstream out;
+  Writer writer(out, schema);
+  for (size_t i = 0; i != 3; ++i) {
+    DocWithField doc;
+    doc.name = fake + std::string(i, 'x') + fake;
+    writer << doc;
+  }
+  const std::string data = out.str();
+  DocIndex index;
+  index.build(data.data(), data.size());
+  CHECK_EQUAL(3, index.ndocs());
+
+  size_t offset;
+  for (size_t n = 0; n <= index.ndocs(); ++n) {
+    CHECK(find_tail_offset(data.data(), data.size(), n, offset));
+    CHECK_EQUAL(index.offset(index.ndocs() - n), offset);
+  }
+}
+
+
+TEST(save_load) {
+  const std::string data = write_docs(4);
+  DocIndex index;
+  index.build(data.data(), data.size());
+
+  for (const bool include_nbytes : {true, false}) {
+    std::stringstream sidecar;
+    index.save(sidecar, include_nbytes);
+    DocIndex loaded;
+    loaded.load(sidecar, data.size());
+    CHECK_EQUAL(index.ndocs(), loaded.ndocs());
+    for (size_t i = 0; i != index.ndocs(); ++i) {
+      CHECK_EQUAL(index.offset(i), loaded.offset(i));
+      CHECK_EQUAL(index.nbytes(i), loaded.nbytes(i));
+    }
+  }
+
+  // The index must cover the whole file.
+  std::stringstream sidecar;
+  index.save(sidecar);
+  DocIndex loaded;
+  CHECK_THROW(loaded.load(sidecar, data.size() + 1), ReaderException);
+
+  std::istringstream bad("0 10\n5 10\n");
+  CHECK_THROW(loaded.load(bad, 15), ReaderException);
+}
+
+}  // SUITE
+
+}  // namespace dr
+}  // namespace schwa
@@ -0,0 +1,408 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/dr/inverted_index.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <schwa/dr/doc_index.h>
+#include <schwa/dr/exception.h>
+#include <schwa/dr/reader.h>
+#include <schwa/dr/runtime.h>
+#include <schwa/dr/schema.h>
+#include <schwa/io/array_reader.h>
+#include <schwa/io/null_writer.h>
+#include <schwa/msgpack.h>
+
+namespace mp = schwa::msgpack;
+
+
+namespace schwa {
+namespace dr {
+
+namespace {
+
+/** The postings of one term within a contiguous range of documents. */
+using TermPostings = std::pair<std::string, std::vector<uint64_t>>;
+
+
+/**
+ * Inverts documents [\p begin, \p end) of \p data into \p run, which is left sorted by term.
+ **/
+static void
+invert_range(const char *const data, const DocIndex &index, const size_t begin, const size_t end, const std::string &store, const std::string &field, std::vector<TermPostings> &run) {
+  FauxDoc::Schema schema;
+  Reader reader(schema);
+  std::unordered_map<std::string, std::vector<uint64_t>> postings;
+  std::vector<std::string> terms;
+
+  for (size_t doc_num = begin; doc_num != end; ++doc_num) {
+    FauxDoc doc;
+    reader.read(doc, data + index.offset(doc_num), index.nbytes(doc_num));
+    terms.clear();
+    extract_terms(doc, store, field, terms);
+    for (const std::string &term : terms) {
+      std::vector<uint64_t> &doc_nums = postings[term];
+      if (doc_nums.empty() || doc_nums.back() != doc_num)
+        doc_nums.push_back(doc_num);
+    }
+  }
+
+  run.clear();
+  run.reserve(postings.size());
+  for (auto &pair : postings)
+    run.emplace_back(pair.first, std::move(pair.second));
+  std::sort(run.begin(), run.end(), [](const TermPostings &a, const TermPostings &b) { return a.first < b.first; });
+}
+
+
+static void
+write_varint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+
+/**
+ * Decodes a LEB128 varint from [\p upto, \p end) into \p value, advancing \p upto past it.
+ * Returns false if the varint is truncated or overlong.
+ **/
+static bool
+read_varint(const char *&upto, const char *const end, uint64_t &value) {
+  value = 0;
+  for (unsigned int shift = 0; upto != end && shift < 64; shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(*upto++);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+
+static void
+write_string(std::string &out, const std::string &str) {
+  write_varint(out, str.size());
+  out.append(str);
+}
+
+
+/**
+ * Cursor over a serialised index which throws a ReaderException on malformed input.
+ **/
+class IndexReader {
+private:
+  const char *_upto;
+  const char *const _end;
+
+  [[noreturn]] static void
+  _malformed(void) {
+    throw ReaderException("Malformed inverted index");
+  }
+
+public:
+  IndexReader(const char *data, size_t nbytes) : _upto(data), _end(data + nbytes) { }
+
+  inline bool at_end(void) const { return _upto == _end; }
+
+  uint64_t
+  read_uint(void) {
+    uint64_t value;
+    if (!dr::read_varint(_upto, _end, value))
+      _malformed();
+    return value;
+  }
+
+  const char *
+  read_bytes(const uint64_t nbytes) {
+    if (nbytes > static_cast<uint64_t>(_end - _upto))
+      _malformed();
+    const char *const bytes = _upto;
+    _upto += nbytes;
+    return bytes;
+  }
+
+  std::string
+  read_string(void) {
+    const uint64_t nbytes = read_uint();
+    return std::string(read_bytes(nbytes), nbytes);
+  }
+};
+
+}  // namespace
+
+
+// ============================================================================
+// extract_terms
+// ============================================================================
+void
+extract_terms(const Doc &doc, const std::string &store, const std::string &field, std::vector<std::string> &terms) {
+  const RTManager *const rt = doc.rt();
+  if (rt == nullptr)
+    return;
+
+  // Find the store and the id of the field within its annotation class.
+  const RTStoreDef *rtstore = nullptr;
+  for (const RTStoreDef *s : rt->doc->stores) {
+    if (s->serial == store) {
+      rtstore = s;
+      break;
+    }
+  }
+  if (rtstore == nullptr || rtstore->lazy_data == nullptr)
+    return;
+
+  uint64_t field_id = 0;
+  const std::vector<RTFieldDef *> &fields = rtstore->klass->fields;
+  for (field_id = 0; field_id != fields.size(); ++field_id)
+    if (fields[field_id]->serial == field)
+      break;
+  if (field_id == fields.size())
+    return;
+
+  // <instances> ::= [ <instance> ]
+  // <instance>  ::= { <field_id> : <obj_val> }
+  io::NullWriter null_writer;
+  mp::WireType type;
+  io::ArrayReader reader(rtstore->lazy_data, rtstore->lazy_nbytes);
+  const uint32_t ninstances = mp::read_array_size(reader);
+  for (uint32_t i = 0; i != ninstances; ++i) {
+    const uint32_t size = mp::read_map_size(reader);
+    for (uint32_t j = 0; j != size; ++j) {
+      const uint64_t key = mp::read_uint(reader);
+      if (key == field_id && mp::is_raw(mp::header_type(reader.peek())))
+        terms.push_back(mp::read_raw(reader));
+      else
+        mp::read_lazy(reader, null_writer, type);
+    }
+  }
+}
+
+
+// ============================================================================
+// InvertedIndex
+// ============================================================================
+const char *const InvertedIndex::SIDECAR_SUFFIX = ".postings";
+const char *const InvertedIndex::MAGIC = "DRPOSTINGS";
+
+
+InvertedIndex::InvertedIndex(void) : _ndocs(0), _total_nbytes(0), _offsets(1, 0) { }
+
+
+void
+InvertedIndex::clear(void) {
+  _store.clear();
+  _field.clear();
+  _ndocs = 0;
+  _total_nbytes = 0;
+  _terms.clear();
+  _doc_freqs.clear();
+  _offsets.clear();
+  _offsets.push_back(0);
+  _postings.clear();
+}
+
+
+void
+InvertedIndex::build(const char *const data, const DocIndex &index, const std::string &store, const std::string &field, unsigned int nthreads) {
+  clear();
+  _store = store;
+  _field = field;
+  _ndocs = index.ndocs();
+  _total_nbytes = index.total_nbytes();
+
+  // Invert contiguous ranges of documents in parallel, so that every doc number in one run is less
+  // than every doc number in the runs after it.
+  if (nthreads == 0)
+    nthreads = 1;
+  if (nthreads > index.ndocs())
+    nthreads = std::max<size_t>(index.ndocs(), 1);
+  std::vector<std::vector<TermPostings>> runs(nthreads);
+  std::vector<std::exception_ptr> errors(nthreads);
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t != nthreads; ++t) {
+    const size_t begin = (index.ndocs() * t) / nthreads;
+    const size_t end = (index.ndocs() * (t + 1)) / nthreads;
+    const auto fn = [&, t, begin, end](void) {
+      try {
+        invert_range(data, index, begin, end, store, field, runs[t]);
+      }
+      catch (...) {
+        errors[t] = std::current_exception();
+      }
+    };
+    if (t + 1 == nthreads)
+      fn();
+    else
+      threads.emplace_back(fn);
+  }
+  for (auto &thread : threads)
+    thread.join();
+  for (const auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+
+  // k-way merge the sorted runs. Equal terms are popped in run order, so concatenating their
+  // postings keeps the doc numbers ascending.
+  using Cursor = std::pair<size_t, size_t>;  // (run, position within the run)
+  const auto cmp = [&runs](const Cursor &a, const Cursor &b) {
+    const std::string &ta = runs[a.first][a.second].first;
+    const std::string &tb = runs[b.first][b.second].first;
+    const int c = ta.compare(tb);
+    return c != 0 ? c > 0 : a.first > b.first;
+  };
+  std::priority_queue<Cursor, std::vector<Cursor>, decltype(cmp)> heap(cmp);
+  for (size_t r = 0; r != runs.size(); ++r)
+    if (!runs[r].empty())
+      heap.emplace(r, 0);
+
+  uint64_t prev = 0;
+  while (!heap.empty()) {
+    const Cursor cursor = heap.top();
+    heap.pop();
+    TermPostings &entry = runs[cursor.first][cursor.second];
+
+    if (_terms.empty() || _terms.back() != entry.first) {
+      if (!_terms.empty())
+        _offsets.push_back(_postings.size());
+      _terms.push_back(std::move(entry.first));
+      _doc_freqs.push_back(0);
+      prev = 0;
+    }
+    for (const uint64_t doc_num : entry.second) {
+      write_varint(_postings, doc_num - prev);
+      prev = doc_num;
+    }
+    _doc_freqs.back() += entry.second.size();
+    std::vector<uint64_t>().swap(entry.second);
+
+    if (cursor.second + 1 != runs[cursor.first].size())
+      heap.emplace(cursor.first, cursor.second + 1);
+  }
+  if (!_terms.empty())
+    _offsets.push_back(_postings.size());
+}
+
+
+size_t
+InvertedIndex::find_term(const std::string &term) const {
+  const auto it = std::lower_bound(_terms.begin(), _terms.end(), term);
+  if (it == _terms.end() || *it != term)
+    return _terms.size();
+  return it - _terms.begin();
+}
+
+
+bool
+InvertedIndex::find(const std::string &term, std::vector<uint64_t> &doc_nums) const {
+  doc_nums.clear();
+  const size_t i = find_term(term);
+  if (i == _terms.size())
+    return false;
+  postings(i, doc_nums);
+  return true;
+}
+
+
+void
+InvertedIndex::postings(const size_t i, std::vector<uint64_t> &doc_nums) const {
+  doc_nums.clear();
+  doc_nums.reserve(_doc_freqs[i]);
+  const char *upto = _postings.data() + _offsets[i];
+  const char *const end = _postings.data() + _offsets[i + 1];
+  uint64_t doc_num = 0, delta;
+  while (upto != end && read_varint(upto, end, delta)) {
+    doc_num += delta;
+    doc_nums.push_back(doc_num);
+  }
+}
+
+
+void
+InvertedIndex::load(std::istream &in) {
+  clear();
+  const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  IndexReader reader(data.data(), data.size());
+
+  const size_t magic_nbytes = std::strlen(MAGIC);
+  if (data.size() < magic_nbytes || std::memcmp(reader.read_bytes(magic_nbytes), MAGIC, magic_nbytes) != 0)
+    throw ReaderException("Not an inverted index");
+  const uint64_t version = reader.read_uint();
+  if (version != FORMAT_VERSION) {
+    std::ostringstream msg;
+    msg << "Unsupported inverted index version " << version << " (expected " << FORMAT_VERSION << ")";
+    throw ReaderException(msg.str());
+  }
+
+  _store = reader.read_string();
+  _field = reader.read_string();
+  _ndocs = reader.read_uint();
+  _total_nbytes = reader.read_uint();
+  const uint64_t nterms = reader.read_uint();
+  for (uint64_t i = 0; i != nterms; ++i) {
+    _terms.push_back(reader.read_string());
+    _doc_freqs.push_back(reader.read_uint());
+    const uint64_t nbytes = reader.read_uint();
+    _postings.append(reader.read_bytes(nbytes), nbytes);
+    _offsets.push_back(_postings.size());
+    if (i != 0 && !(_terms[i - 1] < _terms[i]))
+      throw ReaderException("Malformed inverted index: terms are not in sorted order");
+  }
+  if (!reader.at_end())
+    throw ReaderException("Malformed inverted index: trailing bytes");
+}
+
+
+bool
+InvertedIndex::load_sidecar(const std::string &path) {
+  std::ifstream in(sidecar_path(path), std::ios::binary);
+  if (!in)
+    return false;
+  load(in);
+  return true;
+}
+
+
+void
+InvertedIndex::save(std::ostream &out) const {
+  std::string header;
+  header.append(MAGIC);
+  write_varint(header, FORMAT_VERSION);
+  write_string(header, _store);
+  write_string(header, _field);
+  write_varint(header, _ndocs);
+  write_varint(header, _total_nbytes);
+  write_varint(header, _terms.size());
+  out.write(header.data(), header.size());
+
+  std::string entry;
+  for (size_t i = 0; i != _terms.size(); ++i) {
+    entry.clear();
+    write_string(entry, _terms[i]);
+    write_varint(entry, _doc_freqs[i]);
+    write_varint(entry, _offsets[i + 1] - _offsets[i]);
+    out.write(entry.data(), entry.size());
+    out.write(_postings.data() + _offsets[i], _offsets[i + 1] - _offsets[i]);
+  }
+  out.flush();
+}
+
+
+std::string
+InvertedIndex::sidecar_path(const std::string &path) {
+  return path + SIDECAR_SUFFIX;
+}
+
+}  // namespace dr
+}  // namespace schwa
@@ -0,0 +1,118 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_DR_INVERTED_INDEX_H_
+#define SCHWA_DR_INVERTED_INDEX_H_
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <schwa/_base.h>
+
+namespace schwa {
+  namespace dr {
+
+    class Doc;
+    class DocIndex;
+
+
+    /**
+     * Appends to \p terms the string value of the field with serial \p field of each annotation in
+     * the store with serial \p store of the lazily read document \p doc, such as the "norm" field
+     * of the "tokens" store. The store is scanned directly from its lazy serialised bytes. Values
+     * which are not strings are skipped. Nothing is appended if the document does not have the
+     * store or the store does not have the field.
+     **/
+    void extract_terms(const Doc &doc, const std::string &store, const std::string &field, std::vector<std::string> &terms);
+
+
+    /**
+     * A postings index over a docrep file, mapping each of the distinct string values ("terms") of
+     * one field of the annotations in one store to the numbers of the documents which contain it.
+     * Combined with a \ref DocIndex over the same docrep file, the documents containing a term can
+     * be read by seeking straight to them rather than scanning the whole file.
+     *
+     * Each postings list is stored as the differences between consecutive ascending document
+     * numbers, encoded as LEB128 varints, so the postings of frequent terms take about a byte per
+     * document. The terms are kept in sorted order and are looked up by binary search.
+     **/
+    class InvertedIndex {
+    public:
+      static const char *const SIDECAR_SUFFIX;
+      static const char *const MAGIC;
+      static constexpr uint32_t FORMAT_VERSION = 1;
+
+    private:
+      std::string _store;
+      std::string _field;
+      uint64_t _ndocs;
+      uint64_t _total_nbytes;
+      std::vector<std::string> _terms;
+      std::vector<uint64_t> _doc_freqs;
+      std::vector<uint64_t> _offsets;  // nterms() + 1 entries into _postings.
+      std::string _postings;
+
+    public:
+      InvertedIndex(void);
+      ~InvertedIndex(void) { }
+
+      inline const std::string &store(void) const { return _store; }
+      inline const std::string &field(void) const { return _field; }
+      inline uint64_t ndocs(void) const { return _ndocs; }
+      inline uint64_t total_nbytes(void) const { return _total_nbytes; }
+      inline size_t nterms(void) const { return _terms.size(); }
+      inline const std::string &term(const size_t i) const { return _terms[i]; }
+      inline uint64_t doc_freq(const size_t i) const { return _doc_freqs[i]; }
+      inline size_t postings_nbytes(void) const { return _postings.size(); }
+
+      void clear(void);
+
+      /**
+       * Builds the index over the \p store store's \p field field for the documents in \p data,
+       * such as an mmapped docrep file, whose documents are located by \p index. The documents
+       * are split into \p nthreads contiguous ranges which are inverted in parallel, and the
+       * sorted postings of each range are then merged. Throws a ReaderException if a document
+       * cannot be read.
+       **/
+      void build(const char *data, const DocIndex &index, const std::string &store, const std::string &field, unsigned int nthreads=1);
+
+      /**
+       * Looks up \p term, replacing the contents of \p doc_nums with the ascending numbers of the
+       * documents which contain it. Returns false if no document contains \p term.
+       **/
+      bool find(const std::string &term, std::vector<uint64_t> &doc_nums) const;
+
+      /**
+       * Returns the index of \p term within the sorted terms, or nterms() if no document contains
+       * \p term.
+       **/
+      size_t find_term(const std::string &term) const;
+
+      /** Decodes the postings of the term at index \p i into \p doc_nums. */
+      void postings(size_t i, std::vector<uint64_t> &doc_nums) const;
+
+      /**
+       * Loads the index from \p in. Throws a ReaderException if the index is malformed or was
+       * written by a different version of this class.
+       **/
+      void load(std::istream &in);
+
+      /**
+       * Attempts to load the sidecar index for the docrep file at \p path. Returns false if no
+       * sidecar exists.
+       **/
+      bool load_sidecar(const std::string &path);
+
+      /** Writes the index to \p out. */
+      void save(std::ostream &out) const;
+
+      /** Returns the path of the sidecar postings index for the docrep file at \p path. */
+      static std::string sidecar_path(const std::string &path);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(InvertedIndex);
+    };
+
+  }
+}
+
+#endif  // SCHWA_DR_INVERTED_INDEX_H_
@@ -0,0 +1,195 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <schwa/dr.h>
+#include <schwa/dr/inverted_index.h>
+
+
+namespace schwa {
+namespace dr {
+
+namespace {
+
+class Token : public Ann {
+public:
+  std::string norm;
+  uint32_t length;
+
+  Token(void) : Ann(), length(0) { }
+
+  class Schema;
+};
+
+class DocWithTokens : public Doc {
+public:
+  Store<Token> tokens;
+
+  class Schema;
+};
+
+class Token::Schema : public Ann::Schema<Token> {
+public:
+  DR_FIELD(&Token::norm) norm;
+  DR_FIELD(&Token::length) length;
+
+  Schema(void) :
+    Ann::Schema<Token>("Token", "Some help text about Token"),
+    norm(*this, "norm", "some help text about norm", FieldMode::READ_WRITE),
+    length(*this, "length", "some help text about length", FieldMode::READ_WRITE)
+    { }
+  virtual ~Schema(void) { }
+};
+
+class DocWithTokens::Schema : public Doc::Schema<DocWithTokens> {
+public:
+  DR_STORE(&DocWithTokens::tokens) tokens;
+
+  Schema(void) :
+    Doc::Schema<DocWithTokens>("DocWithTokens", "Some help text about DocWithTokens"),
+    tokens(*this, "tokens", "some help text about tokens", FieldMode::READ_WRITE)
+    { }
+  virtual ~Schema(void) { }
+};
+
+
+/**
+ * Writes a stream of documents with one document per space-separated sentence, returning the
+ * stream.
+ **/
+std::string
+write_docs(const std::vector<std::string> &sentences) {
+  DocWithTokens::Schema schema;
+  std::ostringstream out;
+  Writer writer(out, schema);
+  for (const std::string &sentence : sentences) {
+    std::vector<std::string> words;
+    std::istringstream ss(sentence);
+    for (std::string word; ss >> word; )
+      words.push_back(word);
+
+    DocWithTokens doc;
+    doc.tokens.create(words.size());
+    for (size_t i = 0; i != words.size(); ++i) {
+      doc.tokens[i].norm = words[i];
+      doc.tokens[i].length = words[i].size();
+    }
+    writer << doc;
+  }
+  return out.str();
+}
+
+
+const std::vector<std::string> SENTENCES = {
+  "the quick brown fox",
+  "",
+  "the lazy dog",
+  "fox fox fox",
+  "a dog and a fox",
+};
+
+
+std::vector<uint64_t>
+find(const InvertedIndex &index, const std::string &term) {
+  std::vector<uint64_t> doc_nums;
+  index.find(term, doc_nums);
+  return doc_nums;
+}
+
+}  // namespace
+
+
+SUITE(schwa__dr__inverted_index) {
+
+TEST(extract_terms) {
+  const std::string data = write_docs({"the quick the"});
+  std::istringstream in(data);
+  FauxDoc::Schema schema;
+  Reader reader(in, schema);
+  FauxDoc doc;
+  reader >> doc;
+
+  std::vector<std::string> terms;
+  extract_terms(doc, "tokens", "norm", terms);
+  CHECK_EQUAL(3, terms.size());
+  CHECK_EQUAL("the", terms[0]);
+  CHECK_EQUAL("quick", terms[1]);
+  CHECK_EQUAL("the", terms[2]);
+
+  // Missing stores and fields, and fields which are not strings, produce no terms.
+  terms.clear();
+  extract_terms(doc, "missing", "norm", terms);
+  extract_terms(doc, "tokens", "missing", terms);
+  extract_terms(doc, "tokens", "length", terms);
+  CHECK_EQUAL(0, terms.size());
+}
+
+
+TEST(build) {
+  const std::string data = write_docs(SENTENCES);
+  DocIndex doc_index;
+  doc_index.build(data.data(), data.size());
+
+  for (const unsigned int nthreads : {1, 2, 3, 8}) {
+    InvertedIndex index;
+    index.build(data.data(), doc_index, "tokens", "norm", nthreads);
+    CHECK_EQUAL(5, index.ndocs());
+    CHECK_EQUAL(data.size(), index.total_nbytes());
+    CHECK_EQUAL(8, index.nterms());
+
+    CHECK(find(index, "fox") == std::vector<uint64_t>({0, 3, 4}));
+    CHECK(find(index, "the") == std::vector<uint64_t>({0, 2}));
+    CHECK(find(index, "a") == std::vector<uint64_t>({4}));
+    CHECK(find(index, "dog") == std::vector<uint64_t>({2, 4}));
+    CHECK(find(index, "cat").empty());
+    CHECK_EQUAL(index.nterms(), index.find_term("cat"));
+    CHECK_EQUAL(3, index.doc_freq(index.find_term("fox")));
+
+    for (size_t i = 1; i < index.nterms(); ++i)
+      CHECK(index.term(i - 1) < index.term(i));
+  }
+}
+
+
+TEST(save_load) {
+  std::vector<std::string> sentences = SENTENCES;
+  for (size_t i = 0; i != 300; ++i)
+    sentences.push_back(i % 2 == 0 ? "even" : "odd");
+  const std::string data = write_docs(sentences);
+  DocIndex doc_index;
+  doc_index.build(data.data(), data.size());
+  InvertedIndex index;
+  index.build(data.data(), doc_index, "tokens", "norm", 2);
+
+  std::stringstream sidecar;
+  index.save(sidecar);
+  const std::string saved = sidecar.str();
+
+  InvertedIndex loaded;
+  loaded.load(sidecar);
+  CHECK_EQUAL("tokens", loaded.store());
+  CHECK_EQUAL("norm", loaded.field());
+  CHECK_EQUAL(index.ndocs(), loaded.ndocs());
+  CHECK_EQUAL(index.total_nbytes(), loaded.total_nbytes());
+  CHECK_EQUAL(index.nterms(), loaded.nterms());
+  for (size_t i = 0; i != index.nterms(); ++i) {
+    CHECK_EQUAL(index.term(i), loaded.term(i));
+    CHECK(find(index, index.term(i)) == find(loaded, index.term(i)));
+  }
+  CHECK_EQUAL(150, find(loaded, "odd").size());
+  CHECK_EQUAL(304, find(loaded, "odd").back());
+
+  // Truncated and foreign indexes are rejected.
+  std::istringstream truncated(saved.substr(0, saved.size() - 1));
+  CHECK_THROW(loaded.load(truncated), ReaderException);
+  std::istringstream foreign("0 10\n");
+  CHECK_THROW(loaded.load(foreign), ReaderException);
+}
+
+}  // SUITE
+
+}  // namespace dr
+}  // namespace schwa
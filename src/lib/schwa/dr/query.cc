@@ -6,6 +6,7 @@ the `_tokens' deque. A recursive descent parse over the tokens is performed
 here, buildling up an expresssion tree as it goes along.
 
 var ::= [_a-zA-Z][_a-zA-Z0-9]*
+function ::= "all" | "any" | "count" | "distinct" | "hash" | "int" | "len" | "max" | "min" | "str" | "sum"
 var_attribute ::= "." [_a-zA-Z][_a-zA-Z0-9]*
 
 <e1> ::= <e2> (<op_boolean> <e1>)?
@@ -21,20 +22,24 @@ var_attribute ::= "." [_a-zA-Z][_a-zA-Z0-9]*
 
 */
 #include <schwa/dr/query.h>
+#include <config.h>
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <cinttypes>
 #include <cstring>
 #include <cstdio>
 #include <iterator>
 #include <regex>
+#include <set>
 #include <sstream>
-#include <stack>
 #include <string>
-#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <schwa/dr.h>
+#include <schwa/io/null_writer.h>
 #include <schwa/msgpack.h>
 #include <schwa/utils/enums.h>
 #include <schwa/utils/hash.h>
@@ -129,41 +134,118 @@ Value::to_bool(void) const {
 // ============================================================================
 // Evaluation context data
 // ============================================================================
+enum class Variable : uint32_t {
+  DOC, INDEX, ANN,
+  UNKNOWN,
+};
+constexpr const size_t NVARIABLES = to_underlying(Variable::UNKNOWN);
+
+
+/**
+ * Maps a variable name onto the fixed slot it occupies in the evaluation context.
+ **/
+static Variable
+variable_slot(const char *const name) {
+  if (std::strcmp(name, "doc") == 0)
+    return Variable::DOC;
+  else if (std::strcmp(name, "index") == 0)
+    return Variable::INDEX;
+  else if (std::strcmp(name, "ann") == 0)
+    return Variable::ANN;
+  else
+    return Variable::UNKNOWN;
+}
+
+
+/**
+ * Evaluation state, owned by the Interpreter and rewound between documents so that steady-state
+ * evaluation does not need to allocate. Variables live in fixed slots resolved at compile time and
+ * all string values produced during evaluation live in the scratch pool.
+ **/
 class EvalContext {
 private:
-  const dr::Doc &_doc;
+  const dr::Doc *_doc;
+  const std::set<std::string> &_doc_attributes;
+  const std::set<std::string> &_ann_attributes;
   Pool _pool;
-  std::stack<const dr::RTStoreDef *> _stores;
-  std::unordered_map<const char *, Value, cstr_hash, cstr_equal_to> _vars;
+  std::vector<const dr::RTStoreDef *> _stores;
+  Value _vars[NVARIABLES];
+  bool _has_vars[NVARIABLES];
+  std::cmatch _match;
 
 public:
-  explicit EvalContext(const dr::Doc &doc) : _doc(doc), _pool(4 * 1024) { }
+  /** The values seen so far by a call to 'distinct'. */
+  struct DistinctValues {
+    std::unordered_set<int64_t> ints;
+    std::unordered_set<std::string> strs;
+  };
 
-  inline const dr::Doc &doc(void) const { return _doc; }
+private:
+  std::deque<DistinctValues> _distinct;
+  size_t _distinct_depth;
 
-  inline decltype(_vars)::mapped_type &
-  get_var(decltype(_vars)::key_type key) {
-    return _vars.find(key)->second;
+public:
+  EvalContext(const std::set<std::string> &doc_attributes, const std::set<std::string> &ann_attributes) :
+      _doc(nullptr),
+      _doc_attributes(doc_attributes),
+      _ann_attributes(ann_attributes),
+      _pool(4 * 1024),
+      _vars{Value::as_int(0), Value::as_int(0), Value::as_int(0)},
+      _has_vars{false, false, false},
+      _distinct_depth(0)
+    {
+    _stores.reserve(8);
   }
 
-  inline bool
-  has_var(decltype(_vars)::key_type key) const {
-    return _vars.find(key) != _vars.end();
+  inline const dr::Doc &doc(void) const { return *_doc; }
+  inline const std::set<std::string> &doc_attributes(void) const { return _doc_attributes; }
+  inline const std::set<std::string> &ann_attributes(void) const { return _ann_attributes; }
+  inline Pool &pool(void) { return _pool; }
+  inline std::cmatch &match(void) { return _match; }
+
+  void
+  reset(const dr::Doc &doc, const uint32_t doc_num) {
+    _doc = &doc;
+    _pool.clear();
+    _stores.clear();
+    _distinct_depth = 0;
+    for (size_t i = 0; i != NVARIABLES; ++i)
+      _has_vars[i] = false;
+    set_var(Variable::DOC, Value::as_doc(&doc));
+    set_var(Variable::INDEX, Value::as_int(static_cast<int64_t>(doc_num)));
   }
 
+  inline const Value &get_var(const Variable var) const { return _vars[to_underlying(var)]; }
+  inline bool has_var(const Variable var) const { return var != Variable::UNKNOWN && _has_vars[to_underlying(var)]; }
+
   inline void
-  set_var(decltype(_vars)::key_type key, decltype(_vars)::mapped_type value) {
-    _vars.emplace(key, value);
+  set_var(const Variable var, const Value &value) {
+    _vars[to_underlying(var)] = value;
+    _has_vars[to_underlying(var)] = true;
   }
 
-  inline void
-  unset_var(decltype(_vars)::key_type key) {
-    _vars.erase(key);
+  inline void unset_var(const Variable var) { _has_vars[to_underlying(var)] = false; }
+
+  inline void pop_rtstore(void) { _stores.pop_back(); }
+  inline void push_rtstore(const dr::RTStoreDef *store) { _stores.push_back(store); }
+  inline const dr::RTStoreDef *top_rtstore(void) const { return _stores.back(); }
+
+  /**
+   * Returns an empty set of values for a call to 'distinct', which is released by
+   * \ref pop_distinct. The sets are kept between calls and between documents so that their
+   * buckets are reused, and are stacked so that calls can be nested.
+   **/
+  DistinctValues &
+  push_distinct(void) {
+    if (_distinct_depth == _distinct.size())
+      _distinct.emplace_back();
+    DistinctValues &values = _distinct[_distinct_depth++];
+    values.ints.clear();
+    values.strs.clear();
+    return values;
   }
 
-  inline void pop_rtstore(void) { _stores.pop(); }
-  inline void push_rtstore(const dr::RTStoreDef *store) { _stores.push(store); }
-  inline const dr::RTStoreDef *top_rtstore(void) const { return _stores.top(); }
+  inline void pop_distinct(void) { --_distinct_depth; }
 
   char *
   create_str(const char *const orig, const size_t len) {
@@ -188,6 +270,49 @@ private:
 };
 
 
+// ============================================================================
+// Selective decoding helpers
+// ============================================================================
+/**
+ * Flags which of the fields in \p fields are named in \p attributes and so need decoding. The
+ * flags are allocated within \p pool.
+ **/
+static const bool *
+fields_to_decode(const std::vector<dr::RTFieldDef *> &fields, const std::set<std::string> &attributes, Pool &pool) {
+  bool *const decode = pool.alloc<bool *>(fields.size());
+  for (size_t i = 0; i != fields.size(); ++i)
+    decode[i] = attributes.find(fields[i]->serial) != attributes.end();
+  return decode;
+}
+
+
+/**
+ * Decodes a serialised <instance> map into a dynamic msgpack map. Only the values of the fields
+ * flagged in \p decode are decoded. The values of all other fields are skipped over and left nil.
+ **/
+static const mp::Map *
+read_instance(io::ArrayReader &reader, Pool &pool, const bool *const decode, const size_t nfields) {
+  io::NullWriter null_writer;
+  mp::WireType type;
+
+  // <instance> ::= { <field_id> : <obj_val> }
+  const uint32_t size = mp::read_map_size(reader);
+  mp::Map *const map = mp::Map::create(pool, size);
+  for (uint32_t i = 0; i != size; ++i) {
+    mp::Map::Pair &pair = map->get(i);
+    const uint64_t key = mp::read_uint(reader);
+    pair.key = mp::Value(mp::WireType::UINT_64, key);
+    if (key < nfields && decode[key])
+      pair.value = *mp::read_dynamic(reader, pool);
+    else {
+      pair.value = mp::Value(mp::WireType::NIL);
+      mp::read_lazy(reader, null_writer, type);
+    }
+  }
+  return map;
+}
+
+
 // ============================================================================
 // Type casting helpers
 // ============================================================================
@@ -206,10 +331,9 @@ cast_to_int(const char *const str) {
 
 static char *
 cast_to_str(const int64_t value, EvalContext &ctx) {
-  std::ostringstream ss;
-  ss << value;
-  const std::string string = ss.str();
-  return ctx.create_str(string.c_str(), string.size());
+  char buf[24];
+  const int len = std::snprintf(buf, sizeof(buf), "%" PRId64, value);
+  return ctx.create_str(buf, len);
 }
 
 
@@ -225,12 +349,157 @@ public:
   virtual ~Expr(void) { }
 
   virtual Value eval(EvalContext &ctx) const = 0;
+
+  /**
+   * Populates \p literal with a sequence of bytes which must appear verbatim in the serialised
+   * form of any document for which this expression evaluates to true. Returns false if no such
+   * sequence can be determined for this expression.
+   **/
+  virtual bool required_literal(std::string &) const { return false; }
+};
+
+
+class LiteralIntegerExpr : public Expr {
+protected:
+  int64_t _value;
+
+public:
+  explicit LiteralIntegerExpr(const char *token) : Expr(token) {
+    const int ret = std::sscanf(_token, "%" SCNd64, &_value);
+    assert(ret == 1);
+  }
+  virtual ~LiteralIntegerExpr(void) { }
+
+  virtual Value
+  eval(EvalContext &) const override {
+    return Value::as_int(_value);
+  }
+};
+
+
+class LiteralRegexExpr : public Expr {
+protected:
+  std::regex _re;
+
+public:
+  explicit LiteralRegexExpr(const char *token) : Expr(token) {
+    try {
+      _re = std::regex(_token, std::regex::nosubs | std::regex::ECMAScript);
+    }
+    catch (std::regex_error &e) {
+      throw CompileError(e.what());
+    }
+  }
+  virtual ~LiteralRegexExpr(void) { }
+
+  virtual Value
+  eval(EvalContext &) const override {
+    return Value::as_re(&_re);
+  }
+
+  virtual bool
+  required_literal(std::string &literal) const override {
+    // Finds the longest run of plain characters which any match of the regular expression must
+    // contain. This errs on the side of caution: alternations disable the search entirely, and
+    // anything inside of a group or character class is never considered part of a run.
+    std::string run;
+    literal.clear();
+    unsigned int depth = 0;
+    for (const char *p = _token; *p != '\0'; ++p) {
+      bool end_run = true;
+      switch (*p) {
+      case '|':
+        literal.clear();
+        return false;
+      case '[':
+        for (++p; *p != '\0' && *p != ']'; ++p)
+          if (*p == '\\' && p[1] != '\0')
+            ++p;
+        if (*p == '\0')
+          --p;
+        break;
+      case '(':
+        ++depth;
+        break;
+      case ')':
+        if (depth != 0)
+          --depth;
+        break;
+      case '?':
+      case '*':
+      case '{':
+        // The previous character is optional.
+        if (!run.empty())
+          run.pop_back();
+        if (*p == '{')
+          for (; p[1] != '\0' && *p != '}'; ++p) { }
+        break;
+      case '+':
+      case '.':
+      case '^':
+      case '$':
+        break;
+      case '\\':
+        // An escaped punctuation character is a plain character. Any other escape ends the run,
+        // along with the whole of its operand, e.g. the digits of \x41 or \u0041, or the X of \cX.
+        if (p[1] != '\0' && std::ispunct(static_cast<unsigned char>(p[1]))) {
+          ++p;
+          end_run = false;
+        }
+        else if (p[1] != '\0') {
+          ++p;
+          if (*p == 'x' || *p == 'u')
+            for (unsigned int n = (*p == 'x' ? 2 : 4); n != 0 && std::isxdigit(static_cast<unsigned char>(p[1])); --n)
+              ++p;
+          else if (*p == 'c' && p[1] != '\0')
+            ++p;
+          else if (std::isdigit(static_cast<unsigned char>(*p)))
+            while (std::isdigit(static_cast<unsigned char>(p[1])))
+              ++p;
+        }
+        break;
+      default:
+        end_run = false;
+        break;
+      }
+
+      if (end_run || depth != 0) {
+        if (run.size() > literal.size())
+          literal = run;
+        run.clear();
+      }
+      else
+        run.push_back(*p);
+    }
+    if (run.size() > literal.size())
+      literal = run;
+    return !literal.empty();
+  }
+};
+
+
+class LiteralStringExpr : public Expr {
+public:
+  explicit LiteralStringExpr(const char *token) : Expr(token) { }
+  virtual ~LiteralStringExpr(void) { }
+
+  virtual Value
+  eval(EvalContext &) const override {
+    return Value::as_str(_token);
+  }
+
+  virtual bool
+  required_literal(std::string &literal) const override {
+    literal = _token;
+    return !literal.empty();
+  }
 };
 
 
 class VariableExpr : public Expr {
 protected:
   const char *const _attribute;
+  const Variable _variable;
 
   mutable const dr::RTManager *_rt;
   mutable const dr::RTStoreDef *_rtstore;
@@ -281,13 +550,11 @@ protected:
   _eval_doc_attribute(EvalContext &ctx) const {
     const dr::RTSchema *rtdschema = _rt->doc;
 
-    // Decode the lazy document values into dynamic msgpack objects.
-    Pool pool(4096);
+    // Decode the referenced lazy document values into dynamic msgpack objects.
+    Pool &pool = ctx.pool();
     io::ArrayReader reader(rtdschema->lazy_data, rtdschema->lazy_nbytes);
-    mp::Value *value = mp::read_dynamic(reader, pool);
-    assert(value != nullptr);
-    assert(mp::is_map(value->type));
-    const mp::Map &map = *value->via._map;
+    const bool *const decode = fields_to_decode(rtdschema->fields, ctx.doc_attributes(), pool);
+    const mp::Map &map = *read_instance(reader, pool, decode, rtdschema->fields.size());
 
     // <instance> ::= { <field_id> : <obj_val> }
     for (uint32_t j = 0; j != map.size(); ++j) {
@@ -308,54 +575,24 @@ protected:
     return Value::as_missing(this);
   }
 
-  bool
-  _store_iter(EvalContext &ctx, const Expr *const expr, const bool is_any) const {
-    assert(_rtstore != nullptr);
-
-    // Decode the lazy store values into dynamic msgpack objects.
-    Pool pool(4096);
-    io::ArrayReader reader(_rtstore->lazy_data, _rtstore->lazy_nbytes);
-    mp::Value *value = mp::read_dynamic(reader, pool);
-
-    // <instances> ::= [ <instance> ]
-    assert(is_array(value->type));
-    const mp::Array &array = *value->via._array;
-    for (uint32_t i = 0; i != array.size(); ++i) {
-      assert(is_map(array[i].type));
-      const mp::Map &map = *array[i].via._map;
-
-      ctx.set_var("ann", Value::as_ann(&map));
-      ctx.push_rtstore(_rtstore);
-      const Value v = expr->eval(ctx);
-      ctx.pop_rtstore();
-      ctx.unset_var("ann");
-
-      if (is_any && v.to_bool())
-        return true;
-      else if (!is_any && !v.to_bool())
-        return false;
-    }
-
-    return is_any ? false : true;
-  }
-
 public:
-  explicit VariableExpr(const char *token, const char *attribute=nullptr) : Expr(token), _attribute(attribute), _rtstore(nullptr) { }
+  explicit VariableExpr(const char *token, const char *attribute=nullptr) : Expr(token), _attribute(attribute), _variable(variable_slot(token)), _rtstore(nullptr) { }
   virtual ~VariableExpr(void) { }
 
+  inline bool has_attribute(void) const { return _attribute != nullptr; }
   inline uint32_t store_nelem(void) const { return _rtstore->lazy_nelem; }
 
   virtual Value
   eval(EvalContext &ctx) const override {
     // Ensure the variable exists.
-    if (!ctx.has_var(_token)) {
+    if (!ctx.has_var(_variable)) {
       std::ostringstream msg;
       msg << "Variable '" << _token << "' does not exist";
       throw RuntimeError(msg.str());
     }
 
     // If we don't require an attribute, return the raw value of the variable.
-    const Value v = ctx.get_var(_token);
+    const Value v = ctx.get_var(_variable);
     if (_attribute == nullptr)
       return v;
 
@@ -374,14 +611,55 @@ public:
       return _eval_doc_attribute(ctx);
   }
 
+  /**
+   * Evaluates \p expr once per annotation in the store in a single streaming pass over the lazy
+   * store bytes, with the "ann" variable bound to the current annotation. Each resulting value is
+   * passed to \p fn, which returns whether or not the iteration should continue.
+   **/
+  template <typename F>
+  void
+  store_for_each(EvalContext &ctx, const Expr *const expr, F fn) const {
+    assert(_rtstore != nullptr);
+
+    // Decode only the referenced fields of the lazy store values into dynamic msgpack objects.
+    Pool &pool = ctx.pool();
+    io::ArrayReader reader(_rtstore->lazy_data, _rtstore->lazy_nbytes);
+    const std::vector<dr::RTFieldDef *> &fields = _rtstore->klass->fields;
+    const bool *const decode = fields_to_decode(fields, ctx.ann_attributes(), pool);
+
+    // Nested iterations shadow the outer "ann", so restore it once done.
+    const bool had_ann = ctx.has_var(Variable::ANN);
+    const Value outer_ann = ctx.get_var(Variable::ANN);
+
+    // <instances> ::= [ <instance> ]
+    const uint32_t ninstances = mp::read_array_size(reader);
+    ctx.push_rtstore(_rtstore);
+    for (uint32_t i = 0; i != ninstances; ++i) {
+      const mp::Map &map = *read_instance(reader, pool, decode, fields.size());
+      ctx.set_var(Variable::ANN, Value::as_ann(&map));
+      if (!fn(expr->eval(ctx)))
+        break;
+    }
+    ctx.pop_rtstore();
+
+    if (had_ann)
+      ctx.set_var(Variable::ANN, outer_ann);
+    else
+      ctx.unset_var(Variable::ANN);
+  }
+
   inline bool
   store_all(EvalContext &ctx, const Expr *const expr) const {
-    return _store_iter(ctx, expr, false);
+    bool all = true;
+    store_for_each(ctx, expr, [&](const Value &v) { return (all = v.to_bool()); });
+    return all;
   }
 
   inline bool
   store_any(EvalContext &ctx, const Expr *const expr) const {
-    return _store_iter(ctx, expr, true);
+    bool any = false;
+    store_for_each(ctx, expr, [&](const Value &v) { return !(any = v.to_bool()); });
+    return any;
   }
 };
 
@@ -443,7 +721,7 @@ public:
     else if (std::strcmp(_token, "~=") == 0) {
       check_accepts("left side of ~=", v1.type, TYPE_STRING);
       check_accepts("right side of ~=", v2.type, TYPE_REGEX);
-      std::cmatch m;
+      std::cmatch &m = ctx.match();
       const bool found = std::regex_search(v1.via._str, m, *v2.via._re);
       return Value::as_int(found && static_cast<size_t>(m.length()) == std::strlen(v1.via._str));
     }
@@ -482,6 +760,46 @@ public:
       return Value::as_int(0);
     }
   }
+
+  virtual bool
+  required_literal(std::string &literal) const override {
+    if (std::strcmp(_token, "&&") == 0) {
+      // Both sides need to hold, so either side's literal will do. Prefer the longer one.
+      std::string l, r;
+      const bool has_l = _left->required_literal(l);
+      const bool has_r = _right->required_literal(r);
+      if (!has_l && !has_r)
+        return false;
+      literal = (r.size() > l.size()) ? r : l;
+      return true;
+    }
+    else if (std::strcmp(_token, "==") == 0) {
+      // A field compared for equality against a string literal must contain that string.
+      const Expr *const other = _string_literal_operand(_left, _right);
+      if (other == nullptr)
+        return false;
+      return other->required_literal(literal);
+    }
+    else if (std::strcmp(_token, "~") == 0 || std::strcmp(_token, "~=") == 0) {
+      const VariableExpr *const var = dynamic_cast<const VariableExpr *>(_left);
+      if (var == nullptr || !var->has_attribute())
+        return false;
+      return _right->required_literal(literal);
+    }
+    return false;
+  }
+
+private:
+  static const Expr *
+  _string_literal_operand(const Expr *const a, const Expr *const b) {
+    const VariableExpr *const var_a = dynamic_cast<const VariableExpr *>(a);
+    const VariableExpr *const var_b = dynamic_cast<const VariableExpr *>(b);
+    if (var_a != nullptr && var_a->has_attribute() && dynamic_cast<const LiteralStringExpr *>(b) != nullptr)
+      return b;
+    else if (var_b != nullptr && var_b->has_attribute() && dynamic_cast<const LiteralStringExpr *>(a) != nullptr)
+      return a;
+    return nullptr;
+  }
 };
 
 
@@ -554,60 +872,110 @@ public:
       case TYPE_STRING: return v;
       }
     }
-    assert(!"Should never get here");
-    return Value::as_int(0);
-  }
-};
-
-
-class LiteralIntegerExpr : public Expr {
-protected:
-  int64_t _value;
-
-public:
-  explicit LiteralIntegerExpr(const char *token) : Expr(token) {
-    const int ret = std::sscanf(_token, "%" SCNd64, &_value);
-    assert(ret == 1);
-  }
-  virtual ~LiteralIntegerExpr(void) { }
-
-  virtual Value
-  eval(EvalContext &) const override {
-    return Value::as_int(_value);
-  }
-};
-
-
-class LiteralRegexExpr : public Expr {
-protected:
-  std::regex _re;
-
-public:
-  explicit LiteralRegexExpr(const char *token) : Expr(token) {
-    try {
-      _re = std::regex(_token, std::regex::nosubs | std::regex::ECMAScript);
+    else if (std::strcmp(_token, "count") == 0) {
+      if (_args.size() == 1) {
+        const Value v = _args[0]->eval(ctx);
+        check_accepts("arg0 of 'count'", v.type, TYPE_MISSING | TYPE_STORE);
+        return Value::as_int(v.type == TYPE_MISSING ? 0 : v.via._variable->store_nelem());
+      }
+      _check_arity(2);
+      const Value v = _args[0]->eval(ctx);
+      check_accepts("arg0 of 'count'", v.type, TYPE_MISSING | TYPE_STORE);
+      int64_t count = 0;
+      if (v.type == TYPE_STORE)
+        v.via._variable->store_for_each(ctx, _args[1], [&](const Value &x) { count += x.to_bool(); return true; });
+      return Value::as_int(count);
     }
-    catch (std::regex_error &e) {
-      throw CompileError(e.what());
+    else if (std::strcmp(_token, "sum") == 0) {
+      _check_arity(2);
+      const Value v = _args[0]->eval(ctx);
+      check_accepts("arg0 of 'sum'", v.type, TYPE_MISSING | TYPE_STORE);
+      int64_t sum = 0;
+      if (v.type == TYPE_STORE) {
+        v.via._variable->store_for_each(ctx, _args[1], [&](const Value &x) {
+          check_accepts("arg1 of 'sum'", x.type, TYPE_INTEGER | TYPE_MISSING);
+          if (x.type == TYPE_INTEGER)
+            sum += x.via._int;
+          return true;
+        });
+      }
+      return Value::as_int(sum);
     }
+    else if (std::strcmp(_token, "min") == 0 || std::strcmp(_token, "max") == 0) {
+      _check_arity(2);
+      const bool is_min = _token[1] == 'i';
+      const Value v = _args[0]->eval(ctx);
+      check_accepts(is_min ? "arg0 of 'min'" : "arg0 of 'max'", v.type, TYPE_MISSING | TYPE_STORE);
+      Value best = Value::as_missing(nullptr);
+      if (v.type == TYPE_STORE) {
+        v.via._variable->store_for_each(ctx, _args[1], [&](const Value &x) {
+          if (x.type == TYPE_MISSING)
+            return true;
+          if (best.type == TYPE_MISSING) {
+            check_accepts(is_min ? "arg1 of 'min'" : "arg1 of 'max'", x.type, TYPE_INTEGER | TYPE_STRING);
+            best = x;
+            return true;
+          }
+          check_same_accepts(_token, best.type, x.type, TYPE_INTEGER | TYPE_STRING);
+          const int cmp = (x.type == TYPE_INTEGER) ? ((x.via._int > best.via._int) - (x.via._int < best.via._int)) : std::strcmp(x.via._str, best.via._str);
+          if ((is_min && cmp < 0) || (!is_min && cmp > 0))
+            best = x;
+          return true;
+        });
+      }
+      return best;
+    }
+    else if (std::strcmp(_token, "distinct") == 0) {
+      _check_arity(2);
+      const Value v = _args[0]->eval(ctx);
+      check_accepts("arg0 of 'distinct'", v.type, TYPE_MISSING | TYPE_STORE);
+      if (v.type != TYPE_STORE)
+        return Value::as_int(0);
+      EvalContext::DistinctValues &values = ctx.push_distinct();
+      v.via._variable->store_for_each(ctx, _args[1], [&](const Value &x) {
+        check_accepts("arg1 of 'distinct'", x.type, TYPE_INTEGER | TYPE_MISSING | TYPE_STRING);
+        if (x.type == TYPE_INTEGER)
+          values.ints.insert(x.via._int);
+        else if (x.type == TYPE_STRING)
+          values.strs.emplace(x.via._str);
+        return true;
+      });
+      const size_t ndistinct = values.ints.size() + values.strs.size();
+      ctx.pop_distinct();
+      return Value::as_int(ndistinct);
+    }
+    else if (std::strcmp(_token, "hash") == 0) {
+      // A 64-bit hash of the sequence of values, where each value is tagged with its type and
+      // strings are NUL terminated so that different sequences do not run together.
+      _check_arity(2);
+      const Value v = _args[0]->eval(ctx);
+      check_accepts("arg0 of 'hash'", v.type, TYPE_MISSING | TYPE_STORE);
+      uint64_t hash = fnv1a_64(nullptr, 0);
+      if (v.type == TYPE_STORE) {
+        v.via._variable->store_for_each(ctx, _args[1], [&](const Value &x) {
+          check_accepts("arg1 of 'hash'", x.type, TYPE_INTEGER | TYPE_MISSING | TYPE_STRING);
+          const char tag = static_cast<char>(x.type);
+          hash = fnv1a_64(&tag, 1, hash);
+          if (x.type == TYPE_INTEGER)
+            hash = fnv1a_64(&x.via._int, sizeof(x.via._int), hash);
+          else if (x.type == TYPE_STRING)
+            hash = fnv1a_64(x.via._str, std::strlen(x.via._str) + 1, hash);
+          return true;
+        });
+      }
+      return Value::as_int(static_cast<int64_t>(hash));
+    }
+    assert(!"Should never get here");
+    return Value::as_int(0);
   }
-  virtual ~LiteralRegexExpr(void) { }
-
-  virtual Value
-  eval(EvalContext &) const override {
-    return Value::as_re(&_re);
-  }
-};
 
-
-class LiteralStringExpr : public Expr {
-public:
-  explicit LiteralStringExpr(const char *token) : Expr(token) { }
-  virtual ~LiteralStringExpr(void) { }
-
-  virtual Value
-  eval(EvalContext &) const override {
-    return Value::as_str(_token);
+  virtual bool
+  required_literal(std::string &literal) const override {
+    // any(store, pred) can only hold if pred holds for some annotation in the store. all(...) holds
+    // vacuously over an empty store, so nothing can be said about it.
+    if (std::strcmp(_token, "any") == 0 && _args.size() == 2)
+      return _args[1]->required_literal(literal);
+    return false;
   }
 };
 
@@ -615,10 +983,27 @@ public:
 // ============================================================================
 // Interpreter
 // ============================================================================
-Interpreter::Interpreter(void) : _pool(4 * 1024), _expr(nullptr) { }
+Interpreter::Interpreter(void) :
+    _pool(4 * 1024),
+    _expr(nullptr),
+    _ctx(new EvalContext(_doc_attributes, _ann_attributes))
+  { }
 
 Interpreter::~Interpreter(void) {
-  delete _expr;
+  delete _ctx;
+
+  // The expression nodes live inside of the pool, so only their destructors need to be run.
+  for (auto it = _exprs.rbegin(); it != _exprs.rend(); ++it)
+    (*it)->~Expr();
+}
+
+
+template <typename T, typename... Args>
+T *
+Interpreter::_create_expr(Args &&... args) {
+  T *const expr = new (_pool) T(std::forward<Args>(args)...);
+  _exprs.push_back(expr);
+  return expr;
 }
 
 
@@ -629,7 +1014,7 @@ Interpreter::_parse_e1(void) {
     decltype(_tokens)::value_type pair = _tokens.front();
     _tokens.pop_front();
     Expr *right = _parse_e1();
-    left = new (_pool) BinaryOperatorExpr(pair.second, left, right);
+    left = _create_expr<BinaryOperatorExpr>(pair.second, left, right);
   }
   return left;
 }
@@ -642,7 +1027,7 @@ Interpreter::_parse_e2(void) {
     decltype(_tokens)::value_type pair = _tokens.front();
     _tokens.pop_front();
     Expr *right = _parse_e3();
-    left = new (_pool) BinaryOperatorExpr(pair.second, left, right);
+    left = _create_expr<BinaryOperatorExpr>(pair.second, left, right);
   }
   return left;
 }
@@ -655,7 +1040,7 @@ Interpreter::_parse_e3(void) {
     decltype(_tokens)::value_type pair = _tokens.front();
     _tokens.pop_front();
     Expr *right = _parse_e3();
-    left = new (_pool) BinaryOperatorExpr(pair.second, left, right);
+    left = _create_expr<BinaryOperatorExpr>(pair.second, left, right);
   }
   return left;
 }
@@ -668,7 +1053,7 @@ Interpreter::_parse_e4(void) {
     decltype(_tokens)::value_type pair = _tokens.front();
     _tokens.pop_front();
     Expr *right = _parse_e4();
-    left = new (_pool) BinaryOperatorExpr(pair.second, left, right);
+    left = _create_expr<BinaryOperatorExpr>(pair.second, left, right);
   }
   return left;
 }
@@ -701,15 +1086,15 @@ Interpreter::_parse_e5(void) {
     break;
 
   case TokenType::LITERAL_INTEGER:
-    expr = new (_pool) LiteralIntegerExpr(pair.second);
+    expr = _create_expr<LiteralIntegerExpr>(pair.second);
     break;
 
   case TokenType::LITERAL_REGEX:
-    expr = new (_pool) LiteralRegexExpr(pair.second);
+    expr = _create_expr<LiteralRegexExpr>(pair.second);
     break;
 
   case TokenType::LITERAL_STRING:
-    expr = new (_pool) LiteralStringExpr(pair.second);
+    expr = _create_expr<LiteralStringExpr>(pair.second);
     break;
 
   case TokenType::VAR:
@@ -717,54 +1102,21 @@ Interpreter::_parse_e5(void) {
       if (!_tokens.empty() && _tokens.front().first == TokenType::VAR_ATTRIBUTE) {
         tmp_pair = _tokens.front();
         _tokens.pop_front();
-        expr = new (_pool) VariableExpr(pair.second, tmp_pair.second);
+        expr = _create_expr<VariableExpr>(pair.second, tmp_pair.second);
+
+        // Keep track of which attributes are accessed so that only they need to be decoded.
+        if (std::strcmp(pair.second, "doc") == 0)
+          _doc_attributes.insert(tmp_pair.second);
+        else if (std::strcmp(pair.second, "ann") == 0)
+          _ann_attributes.insert(tmp_pair.second);
       }
       else
-        expr = new (_pool) VariableExpr(pair.second);
+        expr = _create_expr<VariableExpr>(pair.second);
     }
     break;
 
   case TokenType::FUNCTION:
-    {
-      std::vector<Expr *> args;
-      // "("
-      if (_tokens.empty())
-        throw CompileError("Expected OPEN_PAREN in <e5> function but no more tokens available");
-      tmp_pair = _tokens.front();
-      _tokens.pop_front();
-      if (tmp_pair.first != TokenType::OPEN_PAREN) {
-        std::ostringstream msg;
-        msg << "Expected OPEN_PAREN in <e5> function but found token type " << to_underlying(tmp_pair.first) << " instead";
-        throw CompileError(msg.str());
-      }
-      // Loop for each argument.
-      while (true) {
-        // ")"
-        if (_tokens.empty())
-          throw CompileError("Expected CLOSE_PAREN in <e5> function but no more tokens available");
-        tmp_pair = _tokens.front();
-        if (tmp_pair.first == TokenType::CLOSE_PAREN) {
-          _tokens.pop_front();
-          break;
-        }
-        // ","?
-        if (!args.empty()) {
-          if (_tokens.empty())
-            throw CompileError("Expected COMMA in <e5> function but no more tokens available");
-          tmp_pair = _tokens.front();
-          _tokens.pop_front();
-          if (tmp_pair.first != TokenType::COMMA) {
-            std::ostringstream msg;
-            msg << "Expected COMMA in <e5> function but found token type " << to_underlying(tmp_pair.first) << " instead";
-            throw CompileError(msg.str());
-          }
-        }
-        // <e1>
-        Expr *arg = _parse_e1();
-        args.push_back(arg);
-      }
-      expr = new (_pool) FunctionExpr(pair.second, _pool, args);
-    }
+    expr = _parse_function(pair.second);
     break;
 
   default:
@@ -784,6 +1136,51 @@ Interpreter::_parse_e5(void) {
 }
 
 
+Expr *
+Interpreter::_parse_function(const char *const name) {
+  decltype(_tokens)::value_type tmp_pair;
+  std::vector<Expr *> args;
+
+  // "("
+  if (_tokens.empty())
+    throw CompileError("Expected OPEN_PAREN in <e5> function but no more tokens available");
+  tmp_pair = _tokens.front();
+  _tokens.pop_front();
+  if (tmp_pair.first != TokenType::OPEN_PAREN) {
+    std::ostringstream msg;
+    msg << "Expected OPEN_PAREN in <e5> function but found token type " << to_underlying(tmp_pair.first) << " instead";
+    throw CompileError(msg.str());
+  }
+  // Loop for each argument.
+  while (true) {
+    // ")"
+    if (_tokens.empty())
+      throw CompileError("Expected CLOSE_PAREN in <e5> function but no more tokens available");
+    tmp_pair = _tokens.front();
+    if (tmp_pair.first == TokenType::CLOSE_PAREN) {
+      _tokens.pop_front();
+      break;
+    }
+    // ","?
+    if (!args.empty()) {
+      if (_tokens.empty())
+        throw CompileError("Expected COMMA in <e5> function but no more tokens available");
+      tmp_pair = _tokens.front();
+      _tokens.pop_front();
+      if (tmp_pair.first != TokenType::COMMA) {
+        std::ostringstream msg;
+        msg << "Expected COMMA in <e5> function but found token type " << to_underlying(tmp_pair.first) << " instead";
+        throw CompileError(msg.str());
+      }
+    }
+    // <e1>
+    Expr *arg = _parse_e1();
+    args.push_back(arg);
+  }
+  return _create_expr<FunctionExpr>(name, _pool, args);
+}
+
+
 void
 Interpreter::_parse(void) {
   if (_tokens.empty())
@@ -791,6 +1188,8 @@ Interpreter::_parse(void) {
 
   // Parse and consume the tokens.
   _expr = _parse_e1();
+  if (!_expr->required_literal(_required_literal))
+    _required_literal.clear();
 
   // Ensure there are no more tokens left to consume.
   if (!_tokens.empty()) {
@@ -825,11 +1224,21 @@ Interpreter::compile(const char *const str, const size_t len) {
 
 Value
 Interpreter::eval(const dr::Doc &doc, const uint32_t doc_num) const {
-  EvalContext ctx(doc);
-  ctx.set_var("doc", Value::as_doc(&doc));
-  ctx.set_var("index", Value::as_int(static_cast<int64_t>(doc_num)));
+  _ctx->reset(doc, doc_num);
+  return _expr->eval(*_ctx);
+}
+
 
-  return _expr->eval(ctx);
+bool
+Interpreter::might_match(const char *const data, const size_t nbytes) const {
+  if (_required_literal.empty())
+    return true;
+#ifdef HAVE_MEMMEM
+  return ::memmem(data, nbytes, _required_literal.data(), _required_literal.size()) != nullptr;
+#else
+  const char *const end = data + nbytes;
+  return std::search(data, end, _required_literal.begin(), _required_literal.end()) != end;
+#endif
 }
 
 }  // namespace query
@@ -4,8 +4,10 @@
 
 #include <deque>
 #include <regex>
+#include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <schwa/_base.h>
 #include <schwa/exception.h>
@@ -19,6 +21,7 @@ namespace schwa {
 
     namespace query {
 
+      class EvalContext;
       class Expr;
       class VariableExpr;
 
@@ -84,6 +87,8 @@ namespace schwa {
         Value(const Value &o) : type(o.type), via(o.via) { }
         Value(const Value &&o) : type(o.type), via(o.via) { }
 
+        inline Value &operator =(const Value &o) { type = o.type; via = o.via; return *this; }
+
         bool to_bool(void) const;
         inline operator bool(void) const { return to_bool(); }
 
@@ -102,12 +107,20 @@ namespace schwa {
         Pool _pool;
         std::deque<std::pair<TokenType, const char *>> _tokens;
         Expr *_expr;
+        std::vector<Expr *> _exprs;
+        std::string _required_literal;
+        std::set<std::string> _doc_attributes;
+        std::set<std::string> _ann_attributes;
+        EvalContext *const _ctx;
+
+        template <typename T, typename... Args> T *_create_expr(Args &&... args);
 
         Expr *_parse_e1(void);
         Expr *_parse_e2(void);
         Expr *_parse_e3(void);
         Expr *_parse_e4(void);
         Expr *_parse_e5(void);
+        Expr *_parse_function(const char *name);
 
         void _parse(void);
         void _push_token(const TokenType type, const char *ts, const char *te);
@@ -121,9 +134,37 @@ namespace schwa {
         void compile(const char *str, size_t len);
         inline void compile(const std::string &str) { compile(str.c_str(), str.size()); }
 
+        /**
+         * Evaluates the compiled expression against \p doc. The evaluation state is owned by the
+         * Interpreter and reused between calls, so any string value returned is only valid until
+         * the next call, and a single Interpreter must not be used from multiple threads at once.
+         **/
         Value eval(const Doc &doc, uint32_t doc_num) const;
         inline Value operator ()(const Doc &doc, uint32_t doc_num) const { return eval(doc, doc_num); }
 
+        /**
+         * Returns a sequence of bytes which must occur somewhere within the serialised form of a
+         * document for the compiled expression to evaluate to true, or the empty string if no such
+         * sequence could be determined.
+         **/
+        inline const std::string &required_literal(void) const { return _required_literal; }
+
+        /**
+         * The names of the attributes of the doc (fields or stores) and of annotations which the
+         * compiled expression references. Only these are decoded during evaluation; everything
+         * else is skipped over in its serialised form.
+         **/
+        inline const std::set<std::string> &referenced_doc_attributes(void) const { return _doc_attributes; }
+        inline const std::set<std::string> &referenced_ann_attributes(void) const { return _ann_attributes; }
+
+        /**
+         * Cheaply checks whether or not the serialised document in \p data could possibly satisfy
+         * the compiled expression, without decoding it. A return value of false means that the
+         * document definitely does not match, allowing the caller to skip the full evaluation.
+         **/
+        bool might_match(const char *data, size_t nbytes) const;
+        inline bool might_match(const std::string &data) const { return might_match(data.data(), data.size()); }
+
       private:
         SCHWA_DISALLOW_COPY_AND_ASSIGN(Interpreter);
       };
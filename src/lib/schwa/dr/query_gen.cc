@@ -114,35 +114,35 @@ tr26:
 #line 46 "../ragel/dr-query/language.rl"
 	{te = p+1;{ PUSH_TOKEN(LITERAL_INTEGER); }}
 	goto st11;
-tr35:
+tr39:
 #line 63 "../ragel/dr-query/language.rl"
 	{te = p;p--;}
 	goto st11;
-tr36:
+tr40:
 #line 48 "../ragel/dr-query/language.rl"
 	{te = p;p--;{ _push_token(TokenType::LITERAL_STRING, ts + 1, te - 1); }}
 	goto st11;
-tr37:
+tr41:
 #line 52 "../ragel/dr-query/language.rl"
 	{te = p;p--;{ PUSH_TOKEN(OP_NUMERIC3); }}
 	goto st11;
-tr38:
+tr42:
 #line 46 "../ragel/dr-query/language.rl"
 	{te = p;p--;{ PUSH_TOKEN(LITERAL_INTEGER); }}
 	goto st11;
-tr39:
+tr43:
 #line 57 "../ragel/dr-query/language.rl"
 	{te = p;p--;{ _push_token(TokenType::VAR_ATTRIBUTE, ts + 1, te); }}
 	goto st11;
-tr40:
+tr44:
 #line 53 "../ragel/dr-query/language.rl"
 	{te = p;p--;{ PUSH_TOKEN(OP_NUMERIC4); }}
 	goto st11;
-tr41:
+tr45:
 #line 51 "../ragel/dr-query/language.rl"
 	{te = p;p--;{ PUSH_TOKEN(OP_COMPARISON); }}
 	goto st11;
-tr42:
+tr46:
 #line 56 "../ragel/dr-query/language.rl"
 	{te = p;p--;{ PUSH_TOKEN(VAR); }}
 	goto st11;
@@ -173,9 +173,13 @@ case 11:
 		case 61: goto st1;
 		case 95: goto tr29;
 		case 97: goto st20;
-		case 105: goto st23;
-		case 108: goto st25;
-		case 115: goto st27;
+		case 99: goto st23;
+		case 100: goto st27;
+		case 104: goto st33;
+		case 105: goto st25;
+		case 108: goto st36;
+		case 109: goto st38;
+		case 115: goto st40;
 		case 124: goto st10;
 		case 126: goto st18;
 	}
@@ -208,7 +212,7 @@ case 12:
 		goto st12;
 	if ( 9 <= (*p) && (*p) <= 13 )
 		goto st12;
-	goto tr35;
+	goto tr39;
 st1:
 	if ( ++p == pe )
 		goto _test_eof1;
@@ -244,7 +248,7 @@ st13:
 	if ( ++p == pe )
 		goto _test_eof13;
 case 13:
-#line 248 "schwa/dr/query_gen.cc"
+#line 252 "schwa/dr/query_gen.cc"
 	switch( (*p) ) {
 		case 34: goto tr4;
 		case 92: goto st3;
@@ -265,14 +269,14 @@ case 14:
 		goto tr26;
 	if ( 49 <= (*p) && (*p) <= 57 )
 		goto st15;
-	goto tr37;
+	goto tr41;
 st15:
 	if ( ++p == pe )
 		goto _test_eof15;
 case 15:
 	if ( 48 <= (*p) && (*p) <= 57 )
 		goto st15;
-	goto tr38;
+	goto tr42;
 st5:
 	if ( ++p == pe )
 		goto _test_eof5;
@@ -299,7 +303,7 @@ case 16:
 			goto st16;
 	} else
 		goto st16;
-	goto tr39;
+	goto tr43;
 tr25:
 #line 1 "NONE"
 	{te = p+1;}
@@ -308,11 +312,11 @@ st17:
 	if ( ++p == pe )
 		goto _test_eof17;
 case 17:
-#line 312 "schwa/dr/query_gen.cc"
+#line 316 "schwa/dr/query_gen.cc"
 	switch( (*p) ) {
-		case 10: goto tr40;
-		case 42: goto tr40;
-		case 47: goto tr40;
+		case 10: goto tr44;
+		case 42: goto tr44;
+		case 47: goto tr44;
 		case 91: goto st7;
 		case 92: goto st9;
 	}
@@ -358,14 +362,14 @@ st18:
 case 18:
 	if ( (*p) == 61 )
 		goto tr0;
-	goto tr41;
+	goto tr45;
 tr29:
 #line 1 "NONE"
 	{te = p+1;}
 #line 56 "../ragel/dr-query/language.rl"
 	{act = 9;}
 	goto st19;
-tr45:
+tr49:
 #line 1 "NONE"
 	{te = p+1;}
 #line 55 "../ragel/dr-query/language.rl"
@@ -375,7 +379,7 @@ st19:
 	if ( ++p == pe )
 		goto _test_eof19;
 case 19:
-#line 379 "schwa/dr/query_gen.cc"
+#line 383 "schwa/dr/query_gen.cc"
 	if ( (*p) == 95 )
 		goto tr29;
 	if ( (*p) < 65 ) {
@@ -404,14 +408,14 @@ case 20:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st21:
 	if ( ++p == pe )
 		goto _test_eof21;
 case 21:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 108: goto tr45;
+		case 108: goto tr49;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -421,14 +425,14 @@ case 21:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st22:
 	if ( ++p == pe )
 		goto _test_eof22;
 case 22:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 121: goto tr45;
+		case 121: goto tr49;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -438,14 +442,14 @@ case 22:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st23:
 	if ( ++p == pe )
 		goto _test_eof23;
 case 23:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 110: goto st24;
+		case 111: goto st24;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -455,14 +459,14 @@ case 23:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st24:
 	if ( ++p == pe )
 		goto _test_eof24;
 case 24:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 116: goto tr45;
+		case 117: goto st25;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -472,14 +476,14 @@ case 24:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st25:
 	if ( ++p == pe )
 		goto _test_eof25;
 case 25:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 101: goto st26;
+		case 110: goto st26;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -489,14 +493,14 @@ case 25:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st26:
 	if ( ++p == pe )
 		goto _test_eof26;
 case 26:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 110: goto tr45;
+		case 116: goto tr49;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -506,14 +510,14 @@ case 26:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st27:
 	if ( ++p == pe )
 		goto _test_eof27;
 case 27:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 116: goto st28;
+		case 105: goto st28;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -523,14 +527,14 @@ case 27:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
 st28:
 	if ( ++p == pe )
 		goto _test_eof28;
 case 28:
 	switch( (*p) ) {
 		case 95: goto tr29;
-		case 114: goto tr45;
+		case 115: goto st29;
 	}
 	if ( (*p) < 65 ) {
 		if ( 48 <= (*p) && (*p) <= 57 )
@@ -540,7 +544,247 @@ case 28:
 			goto tr29;
 	} else
 		goto tr29;
-	goto tr42;
+	goto tr46;
+st29:
+	if ( ++p == pe )
+		goto _test_eof29;
+case 29:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 116: goto st30;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st30:
+	if ( ++p == pe )
+		goto _test_eof30;
+case 30:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 105: goto st31;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st31:
+	if ( ++p == pe )
+		goto _test_eof31;
+case 31:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 110: goto st32;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st32:
+	if ( ++p == pe )
+		goto _test_eof32;
+case 32:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 99: goto st26;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st33:
+	if ( ++p == pe )
+		goto _test_eof33;
+case 33:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 97: goto st34;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 98 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st34:
+	if ( ++p == pe )
+		goto _test_eof34;
+case 34:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 115: goto st35;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st35:
+	if ( ++p == pe )
+		goto _test_eof35;
+case 35:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 104: goto tr49;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st36:
+	if ( ++p == pe )
+		goto _test_eof36;
+case 36:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 101: goto st37;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st37:
+	if ( ++p == pe )
+		goto _test_eof37;
+case 37:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 110: goto tr49;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st38:
+	if ( ++p == pe )
+		goto _test_eof38;
+case 38:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 97: goto st39;
+		case 105: goto st37;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 98 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st39:
+	if ( ++p == pe )
+		goto _test_eof39;
+case 39:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 120: goto tr49;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st40:
+	if ( ++p == pe )
+		goto _test_eof40;
+case 40:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 116: goto st41;
+		case 117: goto st42;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st41:
+	if ( ++p == pe )
+		goto _test_eof41;
+case 41:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 114: goto tr49;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
+st42:
+	if ( ++p == pe )
+		goto _test_eof42;
+case 42:
+	switch( (*p) ) {
+		case 95: goto tr29;
+		case 109: goto tr49;
+	}
+	if ( (*p) < 65 ) {
+		if ( 48 <= (*p) && (*p) <= 57 )
+			goto tr29;
+	} else if ( (*p) > 90 ) {
+		if ( 97 <= (*p) && (*p) <= 122 )
+			goto tr29;
+	} else
+		goto tr29;
+	goto tr46;
 st10:
 	if ( ++p == pe )
 		goto _test_eof10;
@@ -576,35 +820,63 @@ case 10:
 	_test_eof26: cs = 26; goto _test_eof; 
 	_test_eof27: cs = 27; goto _test_eof; 
 	_test_eof28: cs = 28; goto _test_eof; 
+	_test_eof29: cs = 29; goto _test_eof; 
+	_test_eof30: cs = 30; goto _test_eof; 
+	_test_eof31: cs = 31; goto _test_eof; 
+	_test_eof32: cs = 32; goto _test_eof; 
+	_test_eof33: cs = 33; goto _test_eof; 
+	_test_eof34: cs = 34; goto _test_eof; 
+	_test_eof35: cs = 35; goto _test_eof; 
+	_test_eof36: cs = 36; goto _test_eof; 
+	_test_eof37: cs = 37; goto _test_eof; 
+	_test_eof38: cs = 38; goto _test_eof; 
+	_test_eof39: cs = 39; goto _test_eof; 
+	_test_eof40: cs = 40; goto _test_eof; 
+	_test_eof41: cs = 41; goto _test_eof; 
+	_test_eof42: cs = 42; goto _test_eof; 
 	_test_eof10: cs = 10; goto _test_eof; 
 
 	_test_eof: {}
 	if ( p == eof )
 	{
 	switch ( cs ) {
-	case 12: goto tr35;
+	case 12: goto tr39;
 	case 2: goto tr2;
 	case 3: goto tr2;
-	case 13: goto tr36;
-	case 14: goto tr37;
-	case 15: goto tr38;
-	case 16: goto tr39;
-	case 17: goto tr40;
+	case 13: goto tr40;
+	case 14: goto tr41;
+	case 15: goto tr42;
+	case 16: goto tr43;
+	case 17: goto tr44;
 	case 6: goto tr9;
 	case 7: goto tr9;
 	case 8: goto tr9;
 	case 9: goto tr9;
-	case 18: goto tr41;
+	case 18: goto tr45;
 	case 19: goto tr2;
-	case 20: goto tr42;
-	case 21: goto tr42;
-	case 22: goto tr42;
-	case 23: goto tr42;
-	case 24: goto tr42;
-	case 25: goto tr42;
-	case 26: goto tr42;
-	case 27: goto tr42;
-	case 28: goto tr42;
+	case 20: goto tr46;
+	case 21: goto tr46;
+	case 22: goto tr46;
+	case 23: goto tr46;
+	case 24: goto tr46;
+	case 25: goto tr46;
+	case 26: goto tr46;
+	case 27: goto tr46;
+	case 28: goto tr46;
+	case 29: goto tr46;
+	case 30: goto tr46;
+	case 31: goto tr46;
+	case 32: goto tr46;
+	case 33: goto tr46;
+	case 34: goto tr46;
+	case 35: goto tr46;
+	case 36: goto tr46;
+	case 37: goto tr46;
+	case 38: goto tr46;
+	case 39: goto tr46;
+	case 40: goto tr46;
+	case 41: goto tr46;
+	case 42: goto tr46;
 	}
 	}
 
@@ -615,7 +887,7 @@ case 10:
 
   // Did the FSA terminate on an accepting state?
   if (cs < 
-#line 619 "schwa/dr/query_gen.cc"
+#line 891 "schwa/dr/query_gen.cc"
 11
 #line 91 "../ragel/dr-query/language.rl"
 )
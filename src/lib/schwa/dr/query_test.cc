@@ -0,0 +1,206 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <sstream>
+#include <string>
+
+#include <schwa/dr.h>
+#include <schwa/dr/query.h>
+
+
+namespace schwa {
+namespace dr {
+namespace query {
+
+namespace {
+
+class A : public Ann {
+public:
+  std::string v_str;
+  uint8_t v_uint8;
+
+  A(void) : Ann(), v_uint8(0) { }
+
+  class Schema;
+};
+
+class DocA : public Doc {
+public:
+  Store<A> as;
+
+  class Schema;
+};
+
+class A::Schema : public Ann::Schema<A> {
+public:
+  DR_FIELD(&A::v_str) v_str;
+  DR_FIELD(&A::v_uint8) v_uint8;
+
+  Schema(void) :
+    Ann::Schema<A>("A", "Some text about A"),
+    v_str(*this, "v_str", "some text about v_str", FieldMode::READ_WRITE),
+    v_uint8(*this, "v_uint8", "some text about v_uint8", FieldMode::READ_WRITE)
+    { }
+  virtual ~Schema(void) { }
+};
+
+class DocA::Schema : public Doc::Schema<DocA> {
+public:
+  DR_STORE(&DocA::as) as;
+
+  Schema(void) :
+    Doc::Schema<DocA>("DocA", "Some text about DocA"),
+    as(*this, "as", "some text about as", FieldMode::READ_WRITE)
+    { }
+  virtual ~Schema(void) { }
+};
+
+
+/**
+ * Serialises a DocA containing one A per word and reads it back in as a FauxDoc.
+ **/
+void
+create_faux_doc(FauxDoc &doc) {
+  static const char *const WORDS[] = {"The", "quick", "brown", "fox", "jumped", "the", "fox"};
+  static constexpr size_t NWORDS = sizeof(WORDS)/sizeof(char *);
+
+  DocA doc_a;
+  DocA::Schema schema_a;
+  doc_a.as.create(NWORDS);
+  for (size_t i = 0; i != NWORDS; ++i) {
+    doc_a.as[i].v_str = WORDS[i];
+    doc_a.as[i].v_uint8 = i;
+  }
+
+  std::stringstream stream;
+  Writer writer(stream, schema_a);
+  writer << doc_a;
+
+  FauxDoc::Schema schema;
+  Reader reader(stream, schema);
+  reader >> doc;
+}
+
+
+std::string
+required_literal(const std::string &expression) {
+  Interpreter interpreter;
+  interpreter.compile(expression);
+  return interpreter.required_literal();
+}
+
+}  // namespace
+
+
+SUITE(schwa__dr__query) {
+
+TEST(required_literal__equality) {
+  CHECK_EQUAL("Sydney", required_literal("any(doc.tokens, ann.raw == \"Sydney\")"));
+  CHECK_EQUAL("Sydney", required_literal("any(doc.tokens, \"Sydney\" == ann.raw)"));
+  CHECK_EQUAL("Sydney", required_literal("doc.name == \"Sydney\""));
+  CHECK_EQUAL("", required_literal("any(doc.tokens, ann.raw != \"Sydney\")"));
+  CHECK_EQUAL("", required_literal("all(doc.tokens, ann.raw == \"Sydney\")"));
+  CHECK_EQUAL("", required_literal("(doc.name == \"Sydney\") == 0"));
+  CHECK_EQUAL("", required_literal("len(doc.tokens) > 10"));
+}
+
+
+TEST(required_literal__boolean) {
+  CHECK_EQUAL("Sydney", required_literal("doc.a == \"the\" && doc.b == \"Sydney\""));
+  CHECK_EQUAL("Sydney", required_literal("index > 4 && doc.b == \"Sydney\""));
+  CHECK_EQUAL("", required_literal("doc.a == \"the\" || doc.b == \"Sydney\""));
+}
+
+
+TEST(required_literal__regex) {
+  CHECK_EQUAL("Syd", required_literal("doc.name ~ /^Syd/"));
+  CHECK_EQUAL("Sydne", required_literal("doc.name ~= /Sydney?/"));
+  CHECK_EQUAL("Syd", required_literal("doc.name ~ /a*Syd.ney/"));
+  CHECK_EQUAL("ney", required_literal("doc.name ~ /S(yd)+ney/"));
+  CHECK_EQUAL("b.c", required_literal("doc.name ~ /b\\.c\\d/"));
+  CHECK_EQUAL("ney", required_literal("doc.name ~ /[Ss]yd\\wney/"));
+  CHECK_EQUAL("Sy", required_literal("doc.name ~ /Sy+d{2}x/"));
+  CHECK_EQUAL("", required_literal("doc.name ~ /Sydney|Melbourne/"));
+  CHECK_EQUAL("", required_literal("doc.name ~ /[Sydney]/"));
+}
+
+
+TEST(required_literal__regex_escape_operands) {
+  CHECK_EQUAL("bc", required_literal("doc.name ~ /\\x41bc/"));
+  CHECK_EQUAL("bc", required_literal("doc.name ~ /\\u0041bc/"));
+  CHECK_EQUAL("bc", required_literal("doc.name ~ /a\\cJbc/"));
+  CHECK_EQUAL("bc", required_literal("doc.name ~ /x\\0bc/"));
+  CHECK_EQUAL("", required_literal("doc.name ~ /\\x41\\u0042/"));
+}
+
+
+TEST(referenced_attributes) {
+  Interpreter interpreter;
+  interpreter.compile("doc.name == \"x\" && any(doc.tokens, ann.raw ~ /^S/ || len(ann.norm) > 2)");
+  CHECK_EQUAL(2, interpreter.referenced_doc_attributes().size());
+  CHECK_EQUAL(1, interpreter.referenced_doc_attributes().count("name"));
+  CHECK_EQUAL(1, interpreter.referenced_doc_attributes().count("tokens"));
+  CHECK_EQUAL(2, interpreter.referenced_ann_attributes().size());
+  CHECK_EQUAL(1, interpreter.referenced_ann_attributes().count("raw"));
+  CHECK_EQUAL(1, interpreter.referenced_ann_attributes().count("norm"));
+}
+
+TEST(might_match) {
+  Interpreter interpreter;
+  interpreter.compile("any(doc.tokens, ann.raw == \"Sydney\")");
+  CHECK_EQUAL(true, interpreter.might_match(std::string("\xa6Sydney")));
+  CHECK_EQUAL(false, interpreter.might_match(std::string("\xa6Sydnex")));
+  CHECK_EQUAL(false, interpreter.might_match(std::string()));
+
+  Interpreter everything;
+  everything.compile("len(doc.tokens) > 10");
+  CHECK_EQUAL(true, everything.might_match(std::string()));
+}
+
+
+
+TEST(aggregates) {
+  FauxDoc doc;
+  create_faux_doc(doc);
+
+  const auto eval = [&](const std::string &expression) {
+    Interpreter interpreter;
+    interpreter.compile(expression);
+    const Value v = interpreter(doc, 0);
+    return v.type == TYPE_INTEGER ? v.via._int : -1;
+  };
+
+  CHECK_EQUAL(7, eval("count(doc.as)"));
+  CHECK_EQUAL(2, eval("count(doc.as, ann.v_str == \"fox\")"));
+  CHECK_EQUAL(0, eval("count(doc.missing, ann.v_str == \"fox\")"));
+  CHECK_EQUAL(21, eval("sum(doc.as, ann.v_uint8)"));
+  CHECK_EQUAL(28, eval("sum(doc.as, len(ann.v_str))"));
+  CHECK_EQUAL(1, eval("min(doc.as, ann.v_uint8 + 1)"));
+  CHECK_EQUAL(6, eval("max(doc.as, len(ann.v_str))"));
+  CHECK_EQUAL(6, eval("distinct(doc.as, ann.v_str)"));
+  CHECK_EQUAL(2, eval("distinct(doc.as, ann.v_uint8 % 2)"));
+  CHECK_EQUAL(4, eval("distinct(doc.as, distinct(doc.as, ann.v_uint8 % 2) + ann.v_uint8 / 2)"));
+  CHECK_EQUAL(1, eval("any(doc.as, count(doc.as, ann.v_str == \"fox\") == 2 && ann.v_str == \"brown\")"));
+  CHECK_EQUAL(eval("hash(doc.as, ann.v_str)"), eval("hash(doc.as, ann.v_str + \"\")"));
+  CHECK(eval("hash(doc.as, ann.v_str)") != eval("hash(doc.as, ann.v_uint8)"));
+  CHECK(eval("hash(doc.as, ann.v_str)") != eval("hash(doc.missing, ann.v_str)"));
+
+  Interpreter interpreter;
+  interpreter.compile("max(doc.as, ann.v_str)");
+  const Value v = interpreter(doc, 0);
+  CHECK_EQUAL(TYPE_STRING, v.type);
+  CHECK_EQUAL("the", std::string(v.via._str));
+
+  // The distinct sets are reused across evaluations, and so must start out empty each time.
+  interpreter.compile("distinct(doc.as, ann.v_str)");
+  CHECK_EQUAL(6, interpreter(doc, 0).via._int);
+  CHECK_EQUAL(6, interpreter(doc, 0).via._int);
+
+  CHECK_THROW(required_literal("median(doc.as, ann.v_uint8)"), CompileError);
+}
+
+}  // SUITE
+
+}  // namespace query
+}  // namespace dr
+}  // namespace schwa
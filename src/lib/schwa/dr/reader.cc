@@ -1,6 +1,7 @@
 /* -*- Mode: C++; indent-tabs-mode: nil -*- */
 #include <schwa/dr/reader.h>
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <map>
@@ -16,6 +17,8 @@
 #include <schwa/dr/type_info.h>
 #include <schwa/dr/wire.h>
 #include <schwa/io/array_reader.h>
+#include <schwa/io/null_writer.h>
+#include <schwa/io/string_writer.h>
 #include <schwa/io/unsafe_array_writer.h>
 #include <schwa/msgpack.h>
 #include <schwa/utils/enums.h>
@@ -26,25 +29,146 @@ namespace mp = schwa::msgpack;
 namespace schwa {
 namespace dr {
 
-Reader::Reader(std::istream &in, const BaseDocSchema &dschema) :
-    _in(in),
-    _dschema(dschema),
-    _has_more(false)
-  { }
+namespace {
 
+static void
+throw_short_read(const size_t nbytes) {
+  std::stringstream msg;
+  msg << "Failed to read in " << nbytes << " from the input stream";
+  throw ReaderException(msg.str());
+}
 
-Reader &
-Reader::read(Doc &doc) {
-  if (_in.peek() == EOF || _in.eof()) {
-    _has_more = false;
-    return *this;
+
+/**
+ * Reads \p nbytes of lazy data from the input stream into a new buffer owned by \p rt.
+ **/
+static const char *
+read_lazy_bytes(std::istream &in, const size_t nbytes, RTManager &rt) {
+  char *const bytes = new char[nbytes];
+  rt.lazy_buffers.push_back(bytes);
+  in.read(bytes, nbytes);
+  if (!in.good())
+    throw_short_read(nbytes);
+  return bytes;
+}
+
+
+/**
+ * Returns a slice of the next \p nbytes of lazy data from the in-memory input without copying it.
+ * The lazy data remains owned by the caller of \ref Reader::read.
+ **/
+static const char *
+read_lazy_bytes(io::ArrayReader &in, const size_t nbytes, RTManager &) {
+  if (in.left() < nbytes)
+    throw_short_read(nbytes);
+  const char *const bytes = in.upto();
+  in.ignore(nbytes);
+  return bytes;
+}
+
+
+/**
+ * Reads \p nbytes of <instances> data from the input stream into the reusable scratch buffer
+ * \p buf, growing it if required.
+ **/
+static const char *
+read_instances_bytes(std::istream &in, const size_t nbytes, std::unique_ptr<char[]> &buf, size_t &buf_size) {
+  if (nbytes > buf_size) {
+    buf.reset(new char[nbytes]);
+    buf_size = nbytes;
+  }
+  in.read(buf.get(), nbytes);
+  if (!in.good())
+    throw_short_read(nbytes);
+  return buf.get();
+}
+
+
+/**
+ * Returns a slice of the next \p nbytes of <instances> data from the in-memory input without
+ * copying it.
+ **/
+static const char *
+read_instances_bytes(io::ArrayReader &in, const size_t nbytes, std::unique_ptr<char[]> &, size_t &) {
+  const char *const bytes = in.upto();
+  if (in.left() < nbytes)
+    throw_short_read(nbytes);
+  in.ignore(nbytes);
+  return bytes;
+}
+
+
+/**
+ * Reads the headers of the next document on \p in into \p header, using \p skip to skip over
+ * each instances group. Returns false if \p in does not contain a complete document.
+ **/
+template <typename IN, typename SKIP>
+static bool
+read_doc_header(IN &in, DocHeader &header, SKIP skip) {
+  io::NullWriter writer;
+  mp::WireType type;
+
+  if (in.peek() == EOF)
+    return false;
+
+  // <version> (omitted in version 1)
+  if (!mp::read_lazy(in, writer, type))
+    return false;
+
+  if (mp::is_int(type)) {
+    // <klasses> header
+    if (!mp::read_lazy(in, writer, type))
+      return false;
   }
+  if (!mp::is_array(type))
+    return false;
 
+  // <stores> ::= [ <store> ]
+  if (!mp::is_array(mp::header_type(in.peek())))
+    return false;
+  const uint32_t nstores = mp::read_array_size(in);
+  header.stores.resize(nstores);
+  for (auto &store : header.stores) {
+    // <store> ::= ( <store_name>, <klass_id>, <store_nelem> )
+    const uint32_t ntriple = mp::read_array_size(in);
+    if (ntriple != 3) {
+      std::stringstream msg;
+      msg << "Invalid sized tuple read in: expected 3 elements but found " << ntriple;
+      throw ReaderException(msg.str());
+    }
+    store.name = mp::read_raw(in);
+    mp::read_uint(in);
+    store.nelem = mp::read_uint(in);
+  }
+
+  // instances (nstores + 1 size-data pairs), skipped over without being read
+  if (in.peek() == EOF)
+    return false;
+  header.doc_nbytes = mp::read_uint(in);
+  if (!skip(header.doc_nbytes))
+    return false;
+  for (auto &store : header.stores) {
+    if (in.peek() == EOF)
+      return false;
+    store.nbytes = mp::read_uint(in);
+    if (!skip(store.nbytes))
+      return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+
+template <typename IN>
+void
+Reader::_read_doc(IN &in, const BaseDocSchema &dschema, Doc &doc) {
   // check the wire format version before anything else
   {
     uint64_t version = 1;
-    if (is_uint(mp::header_type(_in.peek())))
-      version = mp::read_uint(_in);
+    if (is_uint(mp::header_type(in.peek())))
+      version = mp::read_uint(in);
     if (version != WIRE_VERSION) {
       std::stringstream msg;
       msg << "Invalid wire format version. Stream has version " << version << " but I can read " << WIRE_VERSION << ". Ensure the input is not plain text.";
@@ -58,8 +182,8 @@ Reader::read(Doc &doc) {
 
   // map of each of the registered types
   std::map<std::string, const BaseSchema *> klass_name_map;
-  klass_name_map["__meta__"] = &_dschema;
-  for (auto &s : _dschema.schemas())
+  klass_name_map["__meta__"] = &dschema;
+  for (auto &s : dschema.schemas())
     klass_name_map[s->serial] = s;
 
   // keep track of the klass_id of __meta__
@@ -68,10 +192,10 @@ Reader::read(Doc &doc) {
 
   // read the klasses header
   // <klasses> ::= [ <klass> ]
-  const uint32_t nklasses = mp::read_array_size(_in);
+  const uint32_t nklasses = mp::read_array_size(in);
   for (uint32_t k = 0; k != nklasses; ++k) {
     // <klass> ::= ( <klass_name>, <fields> )
-    const uint32_t npair = mp::read_array_size(_in);
+    const uint32_t npair = mp::read_array_size(in);
     if (npair != 2) {
       std::stringstream msg;
       msg << "Invalid sized tuple read in: expected 2 elements but found " << npair;
@@ -80,7 +204,7 @@ Reader::read(Doc &doc) {
 
     // read in the class name and check that we have a registered class with this name
     RTSchema *rtschema;
-    const std::string klass_name = mp::read_raw(_in);
+    const std::string klass_name = mp::read_raw(in);
     {
       const auto &kit = klass_name_map.find(klass_name);
       if (kit == klass_name_map.end())
@@ -97,7 +221,7 @@ Reader::read(Doc &doc) {
     }
 
     // <fields> ::= [ <field> ]
-    const uint32_t nfields = mp::read_array_size(_in);
+    const uint32_t nfields = mp::read_array_size(in);
 
     for (uint32_t f = 0; f != nfields; ++f) {
       std::string field_name;
@@ -105,27 +229,27 @@ Reader::read(Doc &doc) {
       bool is_pointer = false, is_self_pointer = false, is_slice = false, is_collection = false;
 
       // <field> ::= { <field_type> : <field_val> }
-      const uint32_t nitems = mp::read_map_size(_in);
+      const uint32_t nitems = mp::read_map_size(in);
       for (uint32_t i = 0; i != nitems; ++i) {
-        const uint8_t key = mp::read_uint_fixed(_in);
+        const uint8_t key = mp::read_uint_fixed(in);
         switch (key) {
         case to_underlying(wire::NAME):
-          field_name = mp::read_raw(_in);
+          field_name = mp::read_raw(in);
           break;
         case to_underlying(wire::POINTER_TO):
-          store_id = mp::read_uint(_in) + 1;
+          store_id = mp::read_uint(in) + 1;
           is_pointer = true;
           break;
         case to_underlying(wire::IS_SLICE):
-          mp::read_nil(_in);
+          mp::read_nil(in);
           is_slice = true;
           break;
         case to_underlying(wire::IS_SELF_POINTER):
-          mp::read_nil(_in);
+          mp::read_nil(in);
           is_self_pointer = true;
           break;
         case to_underlying(wire::IS_COLLECTION):
-          mp::read_nil(_in);
+          mp::read_nil(in);
           is_collection = true;
           break;
         default:
@@ -190,18 +314,18 @@ Reader::read(Doc &doc) {
 
   // read the stores header
   // <stores> ::= [ <store> ]
-  const uint32_t nstores = mp::read_array_size(_in);
+  const uint32_t nstores = mp::read_array_size(in);
   for (uint32_t n = 0; n != nstores; ++n) {
     // <store> ::= ( <store_name>, <klass_id>, <store_nelem> )
-    const uint32_t ntriple = mp::read_array_size(_in);
+    const uint32_t ntriple = mp::read_array_size(in);
     if (ntriple != 3) {
       std::stringstream msg;
       msg << "Invalid sized tuple read in: expected 3 elements but found " << ntriple;
       throw ReaderException(msg.str());
     }
-    const std::string store_name = mp::read_raw(_in);
-    const size_t klass_id = mp::read_uint(_in);
-    const size_t nelem = mp::read_uint(_in);
+    const std::string store_name = mp::read_raw(in);
+    const size_t klass_id = mp::read_uint(in);
+    const size_t nelem = mp::read_uint(in);
 
     // sanity check on the value of the klass_id
     if (klass_id >= rt.klasses.size()) {
@@ -212,7 +336,7 @@ Reader::read(Doc &doc) {
 
     // lookup the store on the Doc class
     const BaseStoreDef *def = nullptr;
-    for (auto &s : _dschema.stores()) {
+    for (auto &s : dschema.stores()) {
       if (s->serial == store_name) {
         def = s;
         break;
@@ -283,51 +407,31 @@ Reader::read(Doc &doc) {
 
 
   // buffer for reading the <instances> into
-  const char *instances_bytes = nullptr;
-  size_t instances_bytes_size = 0;
+  std::unique_ptr<char[]> instances_buffer;
+  size_t instances_buffer_size = 0;
 
   // Read the document instance.
   do {
-    // <doc_instance> ::= <instances_nbytes> <instance>
-    const size_t instances_nbytes = mp::read_uint(_in);
-
-    // Allocate space to write the lazy attributes to.
-    char *const lazy_bytes = new char[instances_nbytes];
+    // <docinstance> ::= <instances_nbytes> <instance>
+    const size_t instances_nbytes = mp::read_uint(in);
 
     // Read all of the doc's fields lazily if required.
-    if (!_dschema.has_fields()) {
-      _in.read(lazy_bytes, instances_nbytes);
-      if (!_in.good()) {
-        std::stringstream msg;
-        msg << "Failed to read in " << instances_nbytes << " from the input stream";
-        throw ReaderException(msg.str());
-      }
-
+    if (!dschema.has_fields()) {
       // Attach the lazy fields to the doc.
-      rt_doc_schema->lazy_data = lazy_bytes;
+      rt_doc_schema->lazy_data = read_lazy_bytes(in, instances_nbytes, rt);
       rt_doc_schema->lazy_nbytes = instances_nbytes;
-
-      // Keep track of this buffer so we know to dealloc it later.
-      rt.lazy_buffers.push_back(lazy_bytes);
       break;
     }
 
     // Read in all of the instances data in one go into a buffer.
-    if (instances_nbytes > instances_bytes_size) {
-      delete [] instances_bytes;
-      instances_bytes = new char[instances_nbytes];
-      instances_bytes_size = instances_nbytes;
-    }
-    _in.read(const_cast<char *>(instances_bytes), instances_nbytes);
-    if (!_in.good()) {
-      std::stringstream msg;
-      msg << "Failed to read in " << instances_nbytes << " from the input stream";
-      throw ReaderException(msg.str());
-    }
+    const char *const instances_bytes = read_instances_bytes(in, instances_nbytes, instances_buffer, instances_buffer_size);
 
     // Wrap the read in instances in a reader.
     io::ArrayReader reader(instances_bytes, instances_nbytes);
 
+    // Allocate space to write the lazy attributes to.
+    char *const lazy_bytes = new char[instances_nbytes];
+
     // Wrap the lazy bytes in a writer.
     io::UnsafeArrayWriter lazy_writer(lazy_bytes);
 
@@ -379,45 +483,25 @@ Reader::read(Doc &doc) {
   // <instances_groups> ::= <instances_group>*
   for (auto &store : rt_doc_schema->stores) {
     // <instances_group>  ::= <instances_nbytes> <instances>
-    const size_t instances_nbytes = mp::read_uint(_in);
-
-    // allocate space to write the lazy attributes to
-    char *const lazy_bytes = new char[instances_nbytes];
+    const size_t instances_nbytes = mp::read_uint(in);
 
     // read in the store lazily if required
     if (store->is_lazy()) {
-      // read in all of the bytes in one go
-      _in.read(lazy_bytes, instances_nbytes);
-      if (!_in.good()) {
-        std::stringstream msg;
-        msg << "Failed to read in " << instances_nbytes << " from the input stream";
-        throw ReaderException(msg.str());
-      }
-
       // attach the lazy store to the RTStoreDef instance
-      store->lazy_data = lazy_bytes;
+      store->lazy_data = read_lazy_bytes(in, instances_nbytes, rt);
       store->lazy_nbytes = instances_nbytes;
-
-      rt.lazy_buffers.push_back(lazy_bytes);
       continue;
     }
 
     // read in all of the instances data in one go into a buffer
-    if (instances_nbytes > instances_bytes_size) {
-      delete [] instances_bytes;
-      instances_bytes = new char[instances_nbytes];
-      instances_bytes_size = instances_nbytes;
-    }
-    _in.read(const_cast<char *>(instances_bytes), instances_nbytes);
-    if (!_in.good()) {
-      std::stringstream msg;
-      msg << "Failed to read in " << instances_nbytes << " from the input stream";
-      throw ReaderException(msg.str());
-    }
+    const char *const instances_bytes = read_instances_bytes(in, instances_nbytes, instances_buffer, instances_buffer_size);
 
     // wrap the read in instances in a reader
     io::ArrayReader reader(instances_bytes, instances_nbytes);
 
+    // allocate space to write the lazy attributes to
+    char *const lazy_bytes = new char[instances_nbytes];
+
     // wrap the lazy bytes in a writer
     io::UnsafeArrayWriter lazy_writer(lazy_bytes);
 
@@ -474,8 +558,46 @@ Reader::read(Doc &doc) {
     else
       rt.lazy_buffers.push_back(lazy_bytes);
   } // for each instance group
+}
+
+
+Reader::Reader(std::istream &in, const BaseDocSchema &dschema) :
+    _in(&in),
+    _dschema(dschema),
+    _has_more(false)
+  { }
 
-  delete [] instances_bytes;
+
+Reader::Reader(const BaseDocSchema &dschema) :
+    _in(nullptr),
+    _dschema(dschema),
+    _has_more(false)
+  { }
+
+
+Reader &
+Reader::read(Doc &doc) {
+  if (_in == nullptr || _in->peek() == EOF || _in->eof()) {
+    _has_more = false;
+    return *this;
+  }
+
+  _read_doc(*_in, _dschema, doc);
+
+  _has_more = true;
+  return *this;
+}
+
+
+Reader &
+Reader::read(Doc &doc, const char *const data, const size_t nbytes) {
+  if (nbytes == 0) {
+    _has_more = false;
+    return *this;
+  }
+
+  io::ArrayReader in(data, nbytes);
+  _read_doc(in, _dschema, doc);
 
   _has_more = true;
   return *this;
@@ -529,5 +651,162 @@ read_lazy_doc(std::istream &in, std::ostream &out) {
 }
 
 
+bool
+read_lazy_doc(std::istream &in, std::string &out) {
+  out.clear();
+  return append_lazy_doc(in, out);
+}
+
+
+/**
+ * Does the work of \ref append_lazy_doc, leaving any partially read document at the end of
+ * \p out on failure.
+ **/
+static bool
+append_lazy_doc_unchecked(std::istream &in, std::string &out) {
+  io::StringWriter writer(out);
+  mp::WireType type;
+
+  if (in.peek() == EOF)
+    return false;
+
+  // <version> (omitted in version 1)
+  if (!mp::read_lazy(in, writer, type))
+    return false;
+
+  if (mp::is_int(type)) {
+    // <klasses> header
+    if (!mp::read_lazy(in, writer, type))
+      return false;
+  }
+  if (!mp::is_array(type))
+    return false;
+
+  // <stores> header
+  if (!mp::is_array(mp::header_type(in.peek())))
+    return false;
+  int nstores = mp::read_array_size(in);
+  mp::write_array_size(writer, nstores);
+  for (int i = 0; i < nstores; ++i)
+    if (!mp::read_lazy(in, writer, type))
+      return false;
+
+  // instances (nstores + 1 size-data pairs), read directly into the output buffer
+  for (; nstores >= 0; --nstores) {
+    const uint64_t nbytes = mp::read_uint(in);
+    mp::write_uint(writer, nbytes);
+
+    const size_t offset = out.size();
+    out.resize(offset + nbytes);
+    in.read(&out[offset], nbytes);
+    if (!in.good())
+      return false;
+  }
+
+  return true;
+}
+
+
+bool
+append_lazy_doc(std::istream &in, std::string &out) {
+  const size_t original_size = out.size();
+  if (append_lazy_doc_unchecked(in, out))
+    return true;
+  out.resize(original_size);
+  return false;
+}
+
+
+// ============================================================================
+// DocHeaderReader
+// ============================================================================
+const size_t DocHeaderReader::MIN_SEEK_NBYTES = 64 * 1024;
+
+DocHeaderReader::DocHeaderReader(std::istream &in) : _in(in), _is_seekable(in.tellg() != std::streampos(-1)), _has_more(false), _skip_buffer(MIN_SEEK_NBYTES) {
+  _in.clear();
+}
+
+
+DocHeaderReader &
+DocHeaderReader::read(DocHeader &header) {
+  // Seeking discards the stream's buffer, so small groups are cheaper to skip by reading past.
+  const auto skip = [&](const uint64_t nbytes) {
+    if (_is_seekable && nbytes >= MIN_SEEK_NBYTES) {
+      _in.seekg(nbytes, std::ios_base::cur);
+      return static_cast<bool>(_in);
+    }
+    // std::istream::ignore reads a character at a time from std::cin, so read in blocks instead.
+    for (uint64_t left = nbytes; left != 0; ) {
+      const size_t n = std::min<uint64_t>(left, _skip_buffer.size());
+      _in.read(_skip_buffer.data(), n);
+      if (!_in)
+        return false;
+      left -= n;
+    }
+    return true;
+  };
+  _has_more = read_doc_header(_in, header, skip);
+  return *this;
+}
+
+
+size_t
+read_doc_header(const char *const data, const size_t nbytes, DocHeader &header) {
+  io::ArrayReader in(data, nbytes);
+  const auto skip = [&](const uint64_t nbytes) {
+    if (nbytes > in.left())
+      return false;
+    in.ignore(nbytes);
+    return true;
+  };
+  if (!read_doc_header(in, header, skip))
+    return 0;
+  return in.upto() - in.data();
+}
+
+
+size_t
+frame_lazy_doc(const char *const data, const size_t nbytes) {
+  io::ArrayReader in(data, nbytes);
+  io::NullWriter writer;
+  mp::WireType type;
+
+  if (in.peek() == EOF)
+    return 0;
+
+  // <version> (omitted in version 1)
+  if (!mp::read_lazy(in, writer, type))
+    return 0;
+
+  if (mp::is_int(type)) {
+    // <klasses> header
+    if (!mp::read_lazy(in, writer, type))
+      return 0;
+  }
+  if (!mp::is_array(type))
+    return 0;
+
+  // <stores> header
+  if (!mp::is_array(mp::header_type(in.peek())))
+    return 0;
+  int nstores = mp::read_array_size(in);
+  for (int i = 0; i < nstores; ++i)
+    if (!mp::read_lazy(in, writer, type))
+      return 0;
+
+  // instances (nstores + 1 size-data pairs), skipped over without being read
+  for (; nstores >= 0; --nstores) {
+    if (in.peek() == EOF || !mp::is_uint(mp::header_type(in.peek())))
+      return 0;
+    const uint64_t instances_nbytes = mp::read_uint(in);
+    if (instances_nbytes > in.left())
+      return 0;
+    in.ignore(instances_nbytes);
+  }
+
+  return in.upto() - in.data();
+}
+
+
 }  // namespace dr
 }  // namespace schwa
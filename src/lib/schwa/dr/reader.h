@@ -3,6 +3,8 @@
 #define SCHWA_DR_READER_H_
 
 #include <iosfwd>
+#include <string>
+#include <vector>
 
 #include <schwa/_base.h>
 
@@ -18,16 +20,28 @@ namespace schwa {
       static constexpr uint64_t WIRE_VERSION = 2;
 
     protected:
-      std::istream &_in;
+      std::istream *const _in;
       const BaseDocSchema &_dschema;
       bool _has_more;
 
+      template <typename IN>
+      static void _read_doc(IN &in, const BaseDocSchema &dschema, Doc &doc);
+
     public:
       Reader(std::istream &in, const BaseDocSchema &dschema);
+      explicit Reader(const BaseDocSchema &dschema);
       ~Reader(void) { }
 
       Reader &read(Doc &doc);
 
+      /**
+       * Reads a single document from the \p nbytes bytes pointed to by \p data instead of from the
+       * input stream. \p data should contain exactly one framed document, such as those produced by
+       * \ref read_lazy_doc. Lazy stores and fields are not copied out of \p data but are kept as
+       * slices into it, so \p data must remain valid for as long as \p doc is in use.
+       **/
+      Reader &read(Doc &doc, const char *data, size_t nbytes);
+
       inline operator bool(void) const { return _has_more; }
       inline Reader &operator >>(Doc &doc) { return read(doc); }
 
@@ -36,12 +50,94 @@ namespace schwa {
     };
 
 
+    /**
+     * The information about a document which is available from its headers alone: the name and
+     * number of instances of each of its stores, along with the number of bytes of serialised
+     * instances data for the document and for each store.
+     **/
+    class DocHeader {
+    public:
+      class Store {
+      public:
+        std::string name;
+        uint64_t nelem;
+        uint64_t nbytes;
+      };
+
+      uint64_t doc_nbytes;
+      std::vector<Store> stores;
+
+      DocHeader(void) : doc_nbytes(0) { }
+    };
+
+
+    /**
+     * Reads only the headers of each of the documents on a docrep stream, skipping over the
+     * serialised instances data using the length prefixes instead of reading it in. When the
+     * underlying stream is seekable, the instances data is skipped with seekg for all but
+     * the smallest groups, so little more than the headers are read from disk.
+     **/
+    class DocHeaderReader {
+    public:
+      static const size_t MIN_SEEK_NBYTES;
+
+    private:
+      std::istream &_in;
+      const bool _is_seekable;
+      bool _has_more;
+      std::vector<char> _skip_buffer;
+
+    public:
+      explicit DocHeaderReader(std::istream &in);
+      ~DocHeaderReader(void) { }
+
+      DocHeaderReader &read(DocHeader &header);
+
+      inline operator bool(void) const { return _has_more; }
+      inline DocHeaderReader &operator >>(DocHeader &header) { return read(header); }
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(DocHeaderReader);
+    };
+
+    /**
+     * Reads the headers of the document framed at the start of the \p nbytes bytes pointed to by
+     * \p data into \p header. Returns the number of bytes in the framed document, or 0 if \p data
+     * does not start with a complete document.
+     **/
+    size_t read_doc_header(const char *data, size_t nbytes, DocHeader &header);
+
+
     /**
      * Lazily read a document from \p in without forming any objects, writing the read in data back
      * to \p out. Returns whether or not a document was successfully read and copied.
      **/
     bool read_lazy_doc(std::istream &in, std::ostream &out);
 
+    /**
+     * Lazily read a document from \p in without forming any objects, replacing the contents of
+     * \p out with the read in data. \p out can be reused between calls to avoid reallocating the
+     * buffer for each document. Returns whether or not a document was successfully read.
+     **/
+    bool read_lazy_doc(std::istream &in, std::string &out);
+
+    /**
+     * Lazily read a document from \p in without forming any objects, appending the read in data to
+     * the end of \p out. This allows several documents to be framed back to back into a single
+     * buffer without copying them. If no document could be read, \p out is left unchanged.
+     * Returns whether or not a document was successfully read.
+     **/
+    bool append_lazy_doc(std::istream &in, std::string &out);
+
+    /**
+     * Finds the extent of the document framed at the start of the \p nbytes bytes pointed to by
+     * \p data, such as an mmapped docrep file, without decoding or copying any of it. Only the
+     * headers are parsed; the instances groups are skipped using their length prefixes. Returns
+     * the number of bytes in the framed document, or 0 if \p data does not start with a complete
+     * document.
+     **/
+    size_t frame_lazy_doc(const char *data, size_t nbytes);
+
   }
 }
 
@@ -233,6 +233,40 @@ TEST(DocWithField__name) {
 }
 
 
+TEST(DocWithField__name__from_memory) {
+  std::stringstream correct;
+  correct << '\x02';  // <wire_version>
+  correct << '\x91';  // <klasses>: 1-element array
+  correct << '\x92';  // <klass>: 2-element array
+  correct << '\xa8' << "__meta__";  // <klass_name>: utf-8 encoded "__meta__"
+  correct << '\x91';  // <fields>: 1-element array
+  correct << '\x81';  // <field>: 1-element map
+  correct << '\x00';  // 0: NAME
+  correct << '\xa4' << "name";  // utf-8 encoded "name"
+  correct << '\x90';  // <stores>: 0-element array
+  correct << '\x0e';  // <instance_nbytes>: 14 bytes after this
+  correct << '\x81';  // <instance>: 1-element map
+  correct << '\x00';  // 0: field number 0 (=> name;
+  correct << '\xab' << "/etc/passwd";  // utf-8 encoded "/etc/passwd"
+  const std::string expected = correct.str();
+
+  std::string frame;
+  CHECK_EQUAL(true, read_lazy_doc(correct, frame));
+  CHECK_EQUAL(expected, frame);
+  CHECK_EQUAL(false, read_lazy_doc(correct, frame));
+
+  DocWithField::Schema schema;
+  Reader reader(schema);
+
+  DocWithField doc;
+  reader.read(doc, expected.data(), expected.size());
+  CHECK_EQUAL(true, static_cast<bool>(reader));
+  CHECK_EQUAL("/etc/passwd", doc.name);
+
+  reader.read(doc, expected.data(), 0);
+  CHECK_EQUAL(false, static_cast<bool>(reader));
+}
+
 TEST(DocWithFieldWithSerial__name_is_null) {
   std::stringstream correct;
   correct << '\x02';  // <wire_version>
@@ -406,6 +440,59 @@ TEST(DocWithA__four_elements) {
   delete doc;
 }
 
+
+TEST(DocWithA__four_elements__header) {
+  std::stringstream correct;
+  correct << '\x02';  // <wire_version>
+  correct << '\x92';  // <klasses>: 2-element array
+  correct << '\x92';  // <klass>: 2-element array
+  correct << '\xa8' << "__meta__";  // <klass_name>: utf-8 encoded "__meta__"
+  correct << '\x90';  // <fields>: 0-element array
+  correct << '\x92';  // <klass>: 2-element array
+  correct << '\xa8' << "writer.A";  // <klass_name>: utf-8 encoded "writer.A"
+  correct << '\x91';  // <fields>: 1-element array
+  correct << '\x81';  // <field>: 1-element map
+  correct << '\x00';  // 0: NAME
+  correct << '\xa7' << "v_uint8";  // utf-8 encoded "v_uint8"
+  correct << '\x91';  // <stores>: 1-element array
+  correct << '\x93';  // <store>: 3-element array
+  correct << '\xa2' << "as";  // <store_name>: utf-8 encoded "as"
+  correct << '\x01';  // <klass_id>: 1
+  correct << '\x04';  // <store_nelem>: 4
+  correct << '\x01';  // <instance_nbytes>: 1 byte after this for the document
+  correct << '\x80';  // <instance>: 0-element map
+  correct << '\x0d';  // <instance_nbytes>: 13 byte after this for the "as" store
+  correct << '\x94';  // <instance>: 4-element array
+  correct << '\x81' << '\x00' << '\x01';  // {0: 1}
+  correct << '\x81' << '\x00' << '\x02';  // {0: 2}
+  correct << '\x81' << '\x00' << '\x03';  // {0: 3}
+  correct << '\x81' << '\x00' << '\x04';  // {0: 4}
+  const std::string expected = correct.str();
+
+  DocHeader header;
+  CHECK_EQUAL(expected.size(), read_doc_header(expected.data(), expected.size(), header));
+  CHECK_EQUAL(1, header.doc_nbytes);
+  CHECK_EQUAL(1, header.stores.size());
+  CHECK_EQUAL("as", header.stores[0].name);
+  CHECK_EQUAL(4, header.stores[0].nelem);
+  CHECK_EQUAL(13, header.stores[0].nbytes);
+  CHECK_EQUAL(0, read_doc_header(expected.data(), expected.size() - 1, header));
+
+  // Read two copies of the document off a stream.
+  std::stringstream in(expected + expected);
+  DocHeaderReader reader(in);
+  for (int i = 0; i != 2; ++i) {
+    header = DocHeader();
+    reader >> header;
+    CHECK_EQUAL(true, static_cast<bool>(reader));
+    CHECK_EQUAL(1, header.stores.size());
+    CHECK_EQUAL(4, header.stores[0].nelem);
+    CHECK_EQUAL(13, header.stores[0].nbytes);
+  }
+  reader >> header;
+  CHECK_EQUAL(false, static_cast<bool>(reader));
+}
+
 }  // SUITE
 
 }  // namespace dr
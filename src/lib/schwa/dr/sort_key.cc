@@ -0,0 +1,84 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/dr/sort_key.h>
+
+#include <iostream>
+#include <sstream>
+
+
+namespace schwa {
+namespace dr {
+namespace query {
+
+// ============================================================================
+// SortKey
+// ============================================================================
+void
+SortKey::assign(const Value &v) {
+  switch (v.type) {
+  case TYPE_MISSING:
+    type = MISSING;
+    break;
+  case TYPE_INTEGER:
+    type = INTEGER;
+    integer = v.via._int;
+    break;
+  case TYPE_STRING:
+    type = STRING;
+    str.assign(v.via._str);
+    break;
+  default:
+    std::ostringstream msg;
+    msg << "The key expression must evaluate to a string or an integer but found " << valuetype_name(v.type);
+    throw RuntimeError(msg.str());
+  }
+}
+
+
+bool
+SortKey::read(std::istream &in) {
+  char t;
+  if (!in.get(t))
+    return false;
+  type = static_cast<Type>(t);
+  if (type == INTEGER)
+    in.read(reinterpret_cast<char *>(&integer), sizeof(integer));
+  else if (type == STRING) {
+    uint64_t nbytes;
+    in.read(reinterpret_cast<char *>(&nbytes), sizeof(nbytes));
+    str.resize(nbytes);
+    in.read(&str[0], nbytes);
+  }
+  return static_cast<bool>(in);
+}
+
+
+void
+SortKey::write(std::ostream &out) const {
+  out.put(type);
+  if (type == INTEGER)
+    out.write(reinterpret_cast<const char *>(&integer), sizeof(integer));
+  else if (type == STRING) {
+    const uint64_t nbytes = str.size();
+    out.write(reinterpret_cast<const char *>(&nbytes), sizeof(nbytes));
+    out.write(str.data(), nbytes);
+  }
+}
+
+
+// ============================================================================
+// SortKeyExtractor
+// ============================================================================
+SortKeyExtractor::SortKeyExtractor(const std::string &expression) : _reader(_schema) {
+  _interpreter.compile(expression);
+}
+
+
+void
+SortKeyExtractor::operator ()(const char *const data, const size_t nbytes, const uint32_t doc_num, SortKey &key) {
+  _reader.read(_doc, data, nbytes);
+  key.assign(_interpreter(_doc, doc_num));
+}
+
+}  // namespace query
+}  // namespace dr
+}  // namespace schwa
@@ -0,0 +1,82 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_DR_SORT_KEY_H_
+#define SCHWA_DR_SORT_KEY_H_
+
+#include <iosfwd>
+#include <string>
+
+#include <schwa/_base.h>
+#include <schwa/dr/query.h>
+#include <schwa/dr/reader.h>
+#include <schwa/dr/schema.h>
+
+
+namespace schwa {
+  namespace dr {
+    namespace query {
+
+      /**
+       * The value of a key expression for a document, as sorted on by dr-sort and merged on by
+       * dr-merge. Only strings and integers can be keys. Keys which are missing sort before
+       * integers, which sort before strings.
+       **/
+      class SortKey {
+      public:
+        enum Type : char {
+          MISSING = 0, INTEGER = 1, STRING = 2,
+        };
+
+        Type type;
+        int64_t integer;
+        std::string str;
+
+        SortKey(void) : type(MISSING), integer(0) { }
+
+        /** Sets the key to \p v, throwing a RuntimeError if it is not a string or an integer. */
+        void assign(const Value &v);
+
+        inline int
+        compare(const SortKey &o) const {
+          if (type != o.type)
+            return type < o.type ? -1 : 1;
+          else if (type == INTEGER)
+            return integer < o.integer ? -1 : (integer == o.integer ? 0 : 1);
+          else if (type == STRING)
+            return str.compare(o.str);
+          return 0;
+        }
+
+        /** Reads a key written by \ref write, returning false at the end of the stream. */
+        bool read(std::istream &in);
+
+        /** Writes the key in a native representation, such as for temporary files. */
+        void write(std::ostream &out) const;
+      };
+
+
+      /**
+       * Evaluates a key expression on framed documents. Each thread needs its own, as the reader
+       * and the interpreter hold state for the document being evaluated.
+       **/
+      class SortKeyExtractor {
+      private:
+        FauxDoc _doc;
+        FauxDoc::Schema _schema;
+        Reader _reader;
+        Interpreter _interpreter;
+
+      public:
+        explicit SortKeyExtractor(const std::string &expression);
+
+        /** Sets \p key to the value of the key expression for the framed document \p data. */
+        void operator ()(const char *data, size_t nbytes, uint32_t doc_num, SortKey &key);
+
+      private:
+        SCHWA_DISALLOW_COPY_AND_ASSIGN(SortKeyExtractor);
+      };
+
+    }
+  }
+}
+
+#endif  // SCHWA_DR_SORT_KEY_H_
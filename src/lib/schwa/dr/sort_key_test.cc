@@ -0,0 +1,61 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <sstream>
+#include <string>
+
+#include <schwa/dr/sort_key.h>
+
+
+namespace schwa {
+namespace dr {
+namespace query {
+
+SUITE(schwa__dr__sort_key) {
+
+TEST(compare) {
+  SortKey missing, small, big, a, b;
+  small.assign(Value::as_int(-3));
+  big.assign(Value::as_int(7));
+  a.assign(Value::as_str("a"));
+  b.assign(Value::as_str("b"));
+
+  // Missing keys sort before integers, which sort before strings.
+  const SortKey *const order[] = {&missing, &small, &big, &a, &b};
+  for (size_t i = 0; i != 5; ++i) {
+    CHECK_EQUAL(0, order[i]->compare(*order[i]));
+    for (size_t j = i + 1; j != 5; ++j) {
+      CHECK_EQUAL(-1, order[i]->compare(*order[j]) < 0 ? -1 : 1);
+      CHECK_EQUAL(1, order[j]->compare(*order[i]) > 0 ? 1 : -1);
+    }
+  }
+
+  SortKey store;
+  CHECK_THROW(store.assign(Value::as_store(nullptr)), RuntimeError);
+}
+
+
+TEST(read_write) {
+  SortKey keys[3];
+  keys[1].assign(Value::as_int(42));
+  keys[2].assign(Value::as_str("hello world"));
+
+  std::stringstream stream;
+  for (const SortKey &key : keys)
+    key.write(stream);
+
+  for (const SortKey &key : keys) {
+    SortKey read;
+    CHECK(read.read(stream));
+    CHECK_EQUAL(key.type, read.type);
+    CHECK_EQUAL(0, key.compare(read));
+  }
+  SortKey read;
+  CHECK(!read.read(stream));
+}
+
+}  // SUITE
+
+}  // namespace query
+}  // namespace dr
+}  // namespace schwa
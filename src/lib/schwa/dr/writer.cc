@@ -5,6 +5,8 @@
 #include <schwa/dr/istore.h>
 #include <schwa/dr/runtime.h>
 #include <schwa/dr/schema.h>
+#include <schwa/exception.h>
+#include <schwa/io/string_writer.h>
 #include <schwa/io/write_buffer.h>
 #include <schwa/msgpack/wire.h>
 #include <schwa/utils/enums.h>
@@ -62,105 +64,112 @@ write_instance(io::WriteBuffer &out, const Ann &obj, const IStore &current_store
 
 
 Writer::Writer(std::ostream &out, BaseDocSchema &dschema) :
-    _out(out),
+    _out(&out),
     _dschema(dschema)
   { }
 
 
+Writer::Writer(BaseDocSchema &dschema) :
+    _out(nullptr),
+    _dschema(dschema)
+  { }
+
+
+template <typename OUT>
 void
-Writer::write(const Doc &doc) {
+Writer::_write_doc(OUT &out, BaseDocSchema &dschema, const Doc &doc) {
   // get or construct the RTManager for the document
   RTManager *rt;
   if (doc.rt() == nullptr)
-    rt = build_rt(_dschema);
+    rt = build_rt(dschema);
   else
-    rt = merge_rt(const_cast<RTManager *>(doc.rt()), _dschema);
+    rt = merge_rt(const_cast<RTManager *>(doc.rt()), dschema);
   const RTSchema *const rtdschema = rt->doc;
 
   // <wire_version>
-  mp::write_uint(_out, WIRE_VERSION);
+  mp::write_uint(out, WIRE_VERSION);
 
   // <klasses> ::= [ <klass> ]
-  mp::write_array_size(_out, rt->klasses.size());
+  mp::write_array_size(out, rt->klasses.size());
   for (auto &schema : rt->klasses) {
     // <klass> ::= ( <klass_name>, <fields> )
-    mp::write_array_size(_out, 2);
+    mp::write_array_size(out, 2);
 
     // <klass_name>
     if (schema == rt->doc)
-      mp::write_raw(_out, "__meta__");
+      mp::write_raw(out, "__meta__");
     else if (schema->is_lazy())
-      mp::write_raw(_out, schema->serial);
+      mp::write_raw(out, schema->serial);
     else
-      mp::write_raw(_out, schema->def->serial);
+      mp::write_raw(out, schema->def->serial);
 
     // <fields> ::= [ <field> ]
-    mp::write_array_size(_out, schema->fields.size());
+    mp::write_array_size(out, schema->fields.size());
     for (auto &field : schema->fields) {
       // <field> ::= { <field_type> : <field_val> }
       const uint32_t nelem = 1 + (field->points_into != nullptr) + field->is_slice + field->is_self_pointer + field->is_collection;
-      mp::write_map_size(_out, nelem);
+      mp::write_map_size(out, nelem);
 
       // <field_type> ::= 0 # NAME => the name of the field
-      mp::write_uint_fixed(_out, to_underlying(wire::NAME));
-      mp::write_raw(_out, field->is_lazy() ? field->serial : field->def->serial);
+      mp::write_uint_fixed(out, to_underlying(wire::NAME));
+      mp::write_raw(out, field->is_lazy() ? field->serial : field->def->serial);
 
       // <field_type> ::= 1 # POINTER_TO => the <store_id> that this field points into
       if (field->points_into != nullptr) {
-        mp::write_uint_fixed(_out, to_underlying(wire::POINTER_TO));
-        mp::write_uint(_out, field->points_into->store_id);
+        mp::write_uint_fixed(out, to_underlying(wire::POINTER_TO));
+        mp::write_uint(out, field->points_into->store_id);
       }
 
       // <field_type> ::= 2 # IS_SLICE => whether or not this field is a "Slice" field
       if (field->is_slice) {
-        mp::write_uint_fixed(_out, to_underlying(wire::IS_SLICE));
-        mp::write_nil(_out);
+        mp::write_uint_fixed(out, to_underlying(wire::IS_SLICE));
+        mp::write_nil(out);
       }
 
       // <field_type>  ::= 3 # IS_SELF_POINTER => whether or not this field is a self-pointer. POINTER_TO and IS_SELF_POINTER are mutually exclusive.
       if (field->is_self_pointer) {
-        mp::write_uint_fixed(_out, to_underlying(wire::IS_SELF_POINTER));
-        mp::write_nil(_out);
+        mp::write_uint_fixed(out, to_underlying(wire::IS_SELF_POINTER));
+        mp::write_nil(out);
       }
 
       // <field_type>  ::= 4 # IS_COLLECTION => whether or not this field is a collection. IS_COLLECTION and IS_SLICE are mutually exclusive.
       if (field->is_collection) {
-        mp::write_uint_fixed(_out, to_underlying(wire::IS_COLLECTION));
-        mp::write_nil(_out);
+        mp::write_uint_fixed(out, to_underlying(wire::IS_COLLECTION));
+        mp::write_nil(out);
       }
     } // for each field
   } // for each klass
 
 
   // <stores> ::= [ <store> ]
-  mp::write_array_size(_out, rtdschema->stores.size());
+  mp::write_array_size(out, rtdschema->stores.size());
   for (auto &store : rtdschema->stores) {
     // <store> ::= ( <store_name>, <type_id>, <store_nelem> )
-    mp::write_array_size(_out, 3);
+    mp::write_array_size(out, 3);
     if (store->is_lazy()) {
-      mp::write_raw(_out, store->serial);
-      mp::write_uint(_out, store->klass->klass_id);
-      mp::write_uint(_out, store->lazy_nelem);
+      mp::write_raw(out, store->serial);
+      mp::write_uint(out, store->klass->klass_id);
+      mp::write_uint(out, store->lazy_nelem);
     }
     else {
       IStore &istore = store->def->istore(doc);
-      mp::write_raw(_out, store->def->serial);
-      mp::write_uint(_out, store->klass->klass_id);
-      mp::write_uint(_out, istore.nelem());
+      mp::write_raw(out, store->def->serial);
+      mp::write_uint(out, store->klass->klass_id);
+      mp::write_uint(out, istore.nelem());
     }
   }
 
   // <doc_instance> ::= <instances_nbytes> <instance>
   {
     if (rtdschema->has_lazy_data()) {
-      mp::write_uint(_out, rtdschema->lazy_nbytes);
-      _out.write(rtdschema->lazy_data, rtdschema->lazy_nbytes);
+      mp::write_uint(out, rtdschema->lazy_nbytes);
+      out.write(rtdschema->lazy_data, rtdschema->lazy_nbytes);
     }
     else {
       io::WriteBuffer buf;
       write_instance(buf, doc, *rtdschema);
-      mp::write_uint(_out, buf.size());
-      buf.copy_to(_out);
+      mp::write_uint(out, buf.size());
+      buf.copy_to(out);
     }
   }
 
@@ -168,8 +177,8 @@ Writer::write(const Doc &doc) {
   for (auto &store : rtdschema->stores) {
     // <instances_group> ::= <instances_nbytes> <instances>
     if (store->is_lazy()) {
-      mp::write_uint(_out, store->lazy_nbytes);
-      _out.write(store->lazy_data, store->lazy_nbytes);
+      mp::write_uint(out, store->lazy_nbytes);
+      out.write(store->lazy_data, store->lazy_nbytes);
     }
     else {
       io::WriteBuffer buf;
@@ -185,17 +194,32 @@ Writer::write(const Doc &doc) {
         write_instance(buf, ann, istore, doc, *store->klass);
       }
 
-      mp::write_uint(_out, buf.size());
-      buf.copy_to(_out);
+      mp::write_uint(out, buf.size());
+      buf.copy_to(out);
     }
   }
 
   // delete the temp RTManager
   if (doc.rt() == nullptr)
     delete rt;
+}
+
+
+void
+Writer::write(const Doc &doc) {
+  if (_out == nullptr)
+    throw ValueException("Cannot write a document as the writer has no output stream");
+  _write_doc(*_out, _dschema, doc);
 
   // flush since we've finished writing a whole document
-  _out.flush();
+  _out->flush();
+}
+
+
+void
+Writer::write(const Doc &doc, std::string &out) {
+  io::StringWriter writer(out);
+  _write_doc(writer, _dschema, doc);
 }
 
 }  // namespace dr
@@ -3,6 +3,7 @@
 #define SCHWA_DR_WRITER_H_
 
 #include <iosfwd>
+#include <string>
 
 #include <schwa/_base.h>
 
@@ -18,15 +19,31 @@ namespace schwa {
       static constexpr uint64_t WIRE_VERSION = 2;
 
     protected:
-      std::ostream &_out;
+      std::ostream *const _out;
       BaseDocSchema &_dschema;
 
+      template <typename OUT>
+      static void _write_doc(OUT &out, BaseDocSchema &dschema, const Doc &doc);
+
     public:
       Writer(std::ostream &out, BaseDocSchema &dschema);
+
+      /**
+       * Constructs a writer without an output stream, which can only append documents to strings.
+       * Writing to the output stream throws a ValueException.
+       **/
+      explicit Writer(BaseDocSchema &dschema);
       ~Writer(void) { }
 
       void write(const Doc &doc);
 
+      /**
+       * Appends the serialised \p doc to \p out instead of writing it to the output stream, so
+       * that documents can be built up in a reusable buffer, such as the body of a message. The
+       * appended bytes are exactly those \ref write would have written.
+       **/
+      void write(const Doc &doc, std::string &out);
+
       inline Writer &
       operator <<(const Doc &doc) {
         write(doc);
@@ -362,6 +362,34 @@ TEST(DocWithA__four_elements) {
 }
 
 
+TEST(DocWithA__four_elements__to_string) {
+  std::stringstream correct;
+  DocWithA::Schema schema;
+  Writer stream_writer(correct, schema);
+  Writer writer(schema);
+
+  schema.types<A>().serial = "writer.A";
+
+  DocWithA d;
+  d.as.create(4);
+  d.as[0].v_str = "first";
+  d.as[1].v_uint8 = 2;
+  d.as[3].v_bool = true;
+  stream_writer << d;
+
+  // Documents are appended to the string, byte for byte as they would be written to a stream.
+  std::string out = "prefix";
+  writer.write(d, out);
+  CHECK_COMPARE_BYTES2("prefix" + correct.str(), out);
+  writer.write(d, out);
+  CHECK_COMPARE_BYTES2("prefix" + correct.str() + correct.str(), out);
+
+  // Without an output stream, there is nowhere else to write to.
+  CHECK_THROW(writer.write(d), ValueException);
+  CHECK_THROW(writer << d, ValueException);
+}
+
+
 TEST(DocWithAYZ__empty) {
   std::stringstream out, correct;
   DocWithAYZ::Schema schema;
@@ -21,6 +21,7 @@ namespace schwa {
       inline const char *data(void) const { return _data; }
       inline const char *upto(void) const { return _upto; }
       inline size_t nbytes(void) const { return _nbytes; }
+      inline size_t left(void) const { return _left; }
 
       int get(void);
       int peek(void);
@@ -104,5 +104,11 @@ MMappedSource::read(char *buffer, size_t nbytes) {
   return _impl->read(buffer, nbytes);
 }
 
+bool
+MMappedSource::can_mmap(const char *const filename) {
+  struct stat stat;
+  return ::stat(filename, &stat) == 0 && S_ISREG(stat.st_mode) && stat.st_size != 0;
+}
+
 }  // namespace io
 }  // namespace schwa
@@ -25,6 +25,12 @@ namespace schwa {
 
       size_t read(char *buffer, size_t nbytes) override;
 
+      /**
+       * Returns whether \p filename is a non-empty regular file, and so can be mmapped. Pipes and
+       * terminals cannot be mmapped, and mmapping a zero-length region fails.
+       **/
+      static bool can_mmap(const char *filename);
+
       /** Returns a pointer to the underlying mmapped region. */
       const char *data(void) const;
 
@@ -0,0 +1,29 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_IO_NULL_WRITER_H_
+#define SCHWA_IO_NULL_WRITER_H_
+
+#include <schwa/_base.h>
+
+namespace schwa {
+  namespace io {
+
+    /**
+     * Output sink which discards everything written to it, used when only the extent of msgpack
+     * values is of interest, such as when skipping over them.
+     **/
+    class NullWriter {
+    public:
+      NullWriter(void) { }
+      ~NullWriter(void) { }
+
+      inline void put(const char) { }
+      inline void write(const char *const, const size_t) { }
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(NullWriter);
+    };
+
+  }
+}
+
+#endif  // SCHWA_IO_NULL_WRITER_H_
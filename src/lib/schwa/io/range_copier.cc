@@ -0,0 +1,120 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/io/range_copier.h>
+
+#include <config.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>     // open
+#include <unistd.h>    // close, copy_file_range, pread, write
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>  // sendfile
+#endif
+
+#include <schwa/exception.h>
+
+
+namespace schwa {
+namespace io {
+
+// The kernel copying functions transfer at most this many bytes per call.
+static constexpr const uint64_t MAX_KERNEL_COPY_NBYTES = 0x7ffff000;
+
+
+RangeCopier::RangeCopier(const std::string &in_filename, const int out_fd) :
+    _in_filename(in_filename),
+    _in_fd(-1),
+    _out_fd(out_fd),
+#ifdef HAVE_COPY_FILE_RANGE
+    _try_copy_file_range(true),
+#else
+    _try_copy_file_range(false),
+#endif
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+    _try_sendfile(true)
+#else
+    _try_sendfile(false)
+#endif
+  {
+  _in_fd = ::open(_in_filename.c_str(), O_RDONLY);
+  if (_in_fd == -1) {
+    const int err = errno;
+    ::close(_out_fd);
+    throw IOException(err, _in_filename);
+  }
+}
+
+RangeCopier::~RangeCopier(void) {
+  ::close(_in_fd);
+  ::close(_out_fd);
+}
+
+
+void
+RangeCopier::copy(uint64_t offset, uint64_t nbytes) {
+  // Each of the kernel copying functions is only attempted until it first fails. Failures mostly
+  // mean the function is not supported for this pair of file descriptors (EINVAL, EXDEV, EBADF,
+  // ENOSYS, ...), and any genuine IO error will be raised again by the buffered copy.
+#ifdef HAVE_COPY_FILE_RANGE
+  while (nbytes != 0 && _try_copy_file_range) {
+    loff_t in_offset = offset;
+    const ssize_t n = ::copy_file_range(_in_fd, &in_offset, _out_fd, nullptr, std::min(nbytes, MAX_KERNEL_COPY_NBYTES), 0);
+    if (n > 0) {
+      offset += n;
+      nbytes -= n;
+    }
+    else if (n == -1 && errno == EINTR)
+      continue;
+    else
+      _try_copy_file_range = false;
+  }
+#endif
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+  while (nbytes != 0 && _try_sendfile) {
+    off_t in_offset = offset;
+    const ssize_t n = ::sendfile(_out_fd, _in_fd, &in_offset, std::min(nbytes, MAX_KERNEL_COPY_NBYTES));
+    if (n > 0) {
+      offset += n;
+      nbytes -= n;
+    }
+    else if (n == -1 && errno == EINTR)
+      continue;
+    else
+      _try_sendfile = false;
+  }
+#endif
+  if (nbytes != 0)
+    _copy_buffered(offset, nbytes);
+}
+
+
+void
+RangeCopier::_copy_buffered(uint64_t offset, uint64_t nbytes) {
+  if (!_buffer)
+    _buffer.reset(new char[BUFFER_NBYTES]);
+
+  while (nbytes != 0) {
+    const ssize_t nread = ::pread(_in_fd, _buffer.get(), std::min<uint64_t>(nbytes, BUFFER_NBYTES), offset);
+    if (nread == -1 && errno == EINTR)
+      continue;
+    else if (nread == -1)
+      throw IOException(errno, _in_filename);
+    else if (nread == 0)
+      throw IOException("Unexpected end of file", _in_filename);
+    offset += nread;
+    nbytes -= nread;
+
+    for (ssize_t written = 0; written != nread; ) {
+      const ssize_t n = ::write(_out_fd, _buffer.get() + written, nread - written);
+      if (n == -1 && errno == EINTR)
+        continue;
+      else if (n == -1)
+        throw IOException(errno, "<output>");
+      written += n;
+    }
+  }
+}
+
+}  // namespace io
+}  // namespace schwa
@@ -0,0 +1,52 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_IO_RANGE_COPIER_H_
+#define SCHWA_IO_RANGE_COPIER_H_
+
+#include <memory>
+#include <string>
+
+#include <schwa/_base.h>
+
+
+namespace schwa {
+  namespace io {
+
+    /**
+     * Copies byte ranges of an input file to an output file descriptor. Where the platform supports
+     * it, the bytes are moved by the kernel using \p copy_file_range or \p sendfile, so they never
+     * pass through user space. If neither is available, or the kernel rejects them for the pair of
+     * file descriptors in question (e.g. the output is a terminal or was opened for appending), the
+     * copy falls back to \p pread and \p write through a large buffer.
+     *
+     * The input file is opened by the constructor, and both the input and output file descriptors
+     * are closed by the destructor. Failures to open, read, or write throw an IOException.
+     **/
+    class RangeCopier {
+    public:
+      static constexpr const size_t BUFFER_NBYTES = 1 << 20;
+
+    private:
+      const std::string _in_filename;
+      int _in_fd;
+      int _out_fd;
+      bool _try_copy_file_range;
+      bool _try_sendfile;
+      std::unique_ptr<char[]> _buffer;
+
+      void _copy_buffered(uint64_t offset, uint64_t nbytes);
+
+    public:
+      RangeCopier(const std::string &in_filename, int out_fd);
+      ~RangeCopier(void);
+
+      /** Copies the \p nbytes bytes starting at \p offset in the input file to the output. */
+      void copy(uint64_t offset, uint64_t nbytes);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(RangeCopier);
+    };
+
+  }
+}
+
+#endif  // SCHWA_IO_RANGE_COPIER_H_
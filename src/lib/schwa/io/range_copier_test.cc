@@ -0,0 +1,106 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <schwa/exception.h>
+#include <schwa/io/range_copier.h>
+
+
+namespace schwa {
+namespace io {
+
+SUITE(schwa__io__range_copier) {
+
+static std::string
+make_temp_file(const std::string &contents) {
+  char path[] = "/tmp/schwa-range-copier-XXXXXX";
+  const int fd = ::mkstemp(path);
+  CHECK(fd != -1);
+  ::close(fd);
+  std::ofstream out(path, std::ios::binary);
+  out.write(contents.data(), contents.size());
+  return path;
+}
+
+
+static std::string
+read_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+
+static std::string
+make_contents(void) {
+  // Larger than the fallback buffer, so that the buffered copy needs multiple reads.
+  std::string contents(RangeCopier::BUFFER_NBYTES * 2 + 123, '\0');
+  for (size_t i = 0; i != contents.size(); ++i)
+    contents[i] = static_cast<char>((i * 7) % 251);
+  return contents;
+}
+
+
+static void
+check_copy(const int flags) {
+  const std::string contents = make_contents();
+  const std::string in_path = make_temp_file(contents);
+  const std::string out_path = make_temp_file("");
+  {
+    const int out_fd = ::open(out_path.c_str(), flags);
+    CHECK(out_fd != -1);
+    RangeCopier copier(in_path, out_fd);
+    copier.copy(10, 20);
+    copier.copy(0, 0);
+    copier.copy(5, contents.size() - 5);
+    copier.copy(0, 3);
+  }
+
+  const std::string expected = contents.substr(10, 20) + contents.substr(5) + contents.substr(0, 3);
+  const std::string actual = read_file(out_path);
+  CHECK_EQUAL(expected.size(), actual.size());
+  CHECK(expected == actual);
+
+  std::remove(in_path.c_str());
+  std::remove(out_path.c_str());
+}
+
+
+TEST(copy) {
+  check_copy(O_WRONLY);
+}
+
+
+TEST(copy_append) {
+  // Some of the kernel copying functions reject outputs opened with O_APPEND.
+  check_copy(O_WRONLY | O_APPEND);
+}
+
+
+TEST(copy_past_end) {
+  const std::string in_path = make_temp_file("abc");
+  const std::string out_path = make_temp_file("");
+  {
+    RangeCopier copier(in_path, ::open(out_path.c_str(), O_WRONLY));
+    CHECK_THROW(copier.copy(1, 10), IOException);
+  }
+  std::remove(in_path.c_str());
+  std::remove(out_path.c_str());
+}
+
+
+TEST(missing_input) {
+  CHECK_THROW(RangeCopier("/nonexistent/schwa-range-copier", ::dup(STDERR_FILENO)), IOException);
+}
+
+}  // SUITE
+
+}  // namespace io
+}  // namespace schwa
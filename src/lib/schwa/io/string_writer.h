@@ -0,0 +1,43 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_IO_STRING_WRITER_H_
+#define SCHWA_IO_STRING_WRITER_H_
+
+#include <string>
+
+#include <schwa/_base.h>
+
+namespace schwa {
+  namespace io {
+
+    /**
+     * Output sink which appends everything written to it to a string, for building up msgpack
+     * output in a buffer which can be reused across writes.
+     **/
+    class StringWriter {
+    private:
+      std::string &_str;
+
+    public:
+      explicit StringWriter(std::string &str) : _str(str) { }
+      ~StringWriter(void) { }
+
+      inline std::string &str(void) const { return _str; }
+
+      inline void
+      put(const char c) {
+        _str.push_back(c);
+      }
+
+      inline void
+      write(const char *const data, const size_t nbytes) {
+        _str.append(data, nbytes);
+      }
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(StringWriter);
+    };
+
+  }
+}
+
+#endif  // SCHWA_IO_STRING_WRITER_H_
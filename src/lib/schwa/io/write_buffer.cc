@@ -113,14 +113,6 @@ WriteBuffer::write_zerocopy(const char *const data, const size_t nbytes) {
 }
 
 
-void
-WriteBuffer::copy_to(std::ostream &out) {
-  _blocks[_current_block].size = _lb_size;
-  for (size_t i = 0; i <= _current_block; ++i)
-    out.write(_blocks[i].data, _blocks[i].size);
-}
-
-
 void
 WriteBuffer::copy_from(const WriteBuffer &o) {
   o._blocks[o._current_block].size = o._lb_size;
@@ -60,7 +60,9 @@ namespace schwa {
       void write(const char *const data, const size_t nbytes);
       void write_zerocopy(const char *const data, const size_t nbytes);
 
-      void copy_to(std::ostream &out);
+      /** Writes the buffered bytes to \p out, which can be any type with a write(data, nbytes) method. */
+      template <typename OUT>
+      void copy_to(OUT &out);
       void copy_from(const WriteBuffer &o);
 
       // debugging
@@ -77,6 +79,15 @@ namespace schwa {
       SCHWA_DISALLOW_COPY_AND_ASSIGN(WriteBuffer);
     };
 
+
+    template <typename OUT>
+    void
+    WriteBuffer::copy_to(OUT &out) {
+      _blocks[_current_block].size = _lb_size;
+      for (size_t i = 0; i <= _current_block; ++i)
+        out.write(_blocks[i].data, _blocks[i].size);
+    }
+
   }
 }
 
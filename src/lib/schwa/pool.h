@@ -29,6 +29,8 @@ namespace schwa {
       inline size_t size(void) const { return _size; }
       inline size_t upto(void) const { return _upto; }
 
+      inline void reset(void) { _upto = 0; }
+
       inline void *
       alloc(size_t size) {
         size_t upto = _upto + size;
@@ -57,10 +59,11 @@ namespace schwa {
 
     const size_t _block_size;
     Block *_current;
+    size_t _current_index;
     std::vector<Block *> _blocks;
 
   public:
-    explicit Pool(size_t block_size) : _block_size(block_size), _current(Block::create(block_size)) {
+    explicit Pool(size_t block_size) : _block_size(block_size), _current(Block::create(block_size)), _current_index(0) {
       _blocks.push_back(_current);
     }
 
@@ -73,14 +76,29 @@ namespace schwa {
     inline T
     alloc(size_t size) {
       void *ptr = _current->alloc(size);
-      if (ptr == nullptr) {
-        _current = Block::create(size > _block_size ? size : _block_size);
-        _blocks.push_back(_current);
+      while (ptr == nullptr) {
+        if (++_current_index == _blocks.size())
+          _blocks.push_back(Block::create(size > _block_size ? size : _block_size));
+        _current = _blocks[_current_index];
         ptr = _current->alloc(size);
       }
       return static_cast<T>(ptr);
     }
 
+    /**
+     * Rewinds the Pool so that all of its memory can be reused by subsequent allocations. The
+     * blocks already allocated are kept, so a Pool which is repeatedly cleared and refilled with
+     * a similar workload stops allocating once it has grown to the required size. As with
+     * destruction, no destructors are called for the objects previously allocated.
+     **/
+    inline void
+    clear(void) {
+      for (Block *b : _blocks)
+        b->reset();
+      _current = _blocks.front();
+      _current_index = 0;
+    }
+
     inline size_t nblocks(void) const { return _blocks.size(); }
     inline size_t allocd(void) const {
       size_t count = 0;
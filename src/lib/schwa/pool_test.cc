@@ -45,6 +45,34 @@ TEST(test) {
   CHECK_EQUAL(209, p.used());
 }
 
+
+TEST(clear) {
+  Pool p(64);
+  p.alloc(60);
+  p.alloc(80);
+  p.alloc(32);
+  CHECK_EQUAL(3, p.nblocks());
+  CHECK_EQUAL(208, p.allocd());
+  CHECK_EQUAL(172, p.used());
+
+  p.clear();
+  CHECK_EQUAL(3, p.nblocks());
+  CHECK_EQUAL(208, p.allocd());
+  CHECK_EQUAL(0, p.used());
+
+  p.alloc(60);
+  p.alloc(80);
+  p.alloc(32);
+  CHECK_EQUAL(3, p.nblocks());
+  CHECK_EQUAL(208, p.allocd());
+  CHECK_EQUAL(172, p.used());
+
+  p.alloc(100);
+  CHECK_EQUAL(4, p.nblocks());
+  CHECK_EQUAL(308, p.allocd());
+  CHECK_EQUAL(272, p.used());
+}
+
 }  // SUITE
 
 }  // namespace schwa
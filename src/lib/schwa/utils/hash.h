@@ -2,6 +2,8 @@
 #ifndef SCHWA_UTILS_HASH_H_
 #define SCHWA_UTILS_HASH_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 
@@ -27,6 +29,57 @@ namespace schwa {
     }
   };
 
+  /**
+   * 64-bit FNV-1a hash of the \p nbytes bytes pointed to by \p data. Unlike std::hash, the value
+   * is the same across platforms and runs, so it can be used to partition data reproducibly.
+   **/
+  inline uint64_t
+  fnv1a_64(const void *const data, const size_t nbytes, uint64_t hash=0xcbf29ce484222325ULL) {
+    const unsigned char *const bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i != nbytes; ++i) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  /**
+   * 64-bit MurmurHash64A of the \p nbytes bytes pointed to by \p data. This consumes 8 bytes at a
+   * time, so is much faster than fnv1a_64 over large inputs such as whole documents. The input is
+   * read in the byte order of the platform.
+   **/
+  inline uint64_t
+  murmur64a(const void *const data, const size_t nbytes, const uint64_t seed=0) {
+    static constexpr const uint64_t M = 0xc6a4a7935bd1e995ULL;
+    static constexpr const int R = 47;
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    const unsigned char *const end = bytes + (nbytes & ~static_cast<size_t>(7));
+
+    uint64_t hash = seed ^ (nbytes * M);
+    for ( ; bytes != end; bytes += 8) {
+      uint64_t k;
+      std::memcpy(&k, bytes, sizeof(k));
+      k *= M;
+      k ^= k >> R;
+      k *= M;
+      hash ^= k;
+      hash *= M;
+    }
+
+    // Mix in the remaining 0-7 bytes as the low bytes of a final little-endian word.
+    const size_t ntail = nbytes & 7;
+    if (ntail != 0) {
+      for (size_t i = 0; i != ntail; ++i)
+        hash ^= static_cast<uint64_t>(bytes[i]) << (8*i);
+      hash *= M;
+    }
+
+    hash ^= hash >> R;
+    hash *= M;
+    hash ^= hash >> R;
+    return hash;
+  }
+
   // using cstr_map<T> = std::unordered_map<const char *, T, cstr_hash, cstr_equal_to>;
 
 }
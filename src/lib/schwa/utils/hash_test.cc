@@ -0,0 +1,35 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <string>
+
+#include <schwa/utils/hash.h>
+
+
+namespace schwa {
+
+SUITE(schwa__utils__hash) {
+
+TEST(test_fnv1a_64) {
+  CHECK_EQUAL(0xcbf29ce484222325ULL, fnv1a_64("", 0));
+  CHECK_EQUAL(0xaf63dc4c8601ec8cULL, fnv1a_64("a", 1));
+  CHECK_EQUAL(0x85944171f73967e8ULL, fnv1a_64("foobar", 6));
+}
+
+TEST(test_fnv1a_64_incremental) {
+  CHECK_EQUAL(fnv1a_64("foobar", 6), fnv1a_64("bar", 3, fnv1a_64("foo", 3)));
+}
+
+TEST(test_murmur64a) {
+  const std::string fox = "The quick brown fox jumps over the lazy dog";
+  CHECK_EQUAL(0x0ULL, murmur64a("", 0));
+  CHECK_EQUAL(0x071717d2d36b6b11ULL, murmur64a("a", 1));
+  CHECK_EQUAL(0xd49f461720d7a196ULL, murmur64a("foobar", 6));
+  CHECK_EQUAL(0x241aa52b0a62005dULL, murmur64a("abcdefg", 7));
+  CHECK_EQUAL(0x5589ca33042a861bULL, murmur64a(fox.data(), fox.size()));
+  CHECK_EQUAL(0x91f7f14d8b0732d2ULL, murmur64a(fox.data(), fox.size(), 42));
+}
+
+}  // SUITE
+
+}  // namespace schwa
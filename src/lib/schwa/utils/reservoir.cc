@@ -0,0 +1,65 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/utils/reservoir.h>
+
+#include <cmath>
+#include <limits>
+
+namespace schwa {
+namespace utils {
+
+ReservoirSampler::ReservoirSampler(const uint64_t seed, const uint64_t count) : _generator(seed), _count(count), _next(0), _w(0) {
+  if (_count == 0)
+    _next = std::numeric_limits<uint64_t>::max();
+  else
+    _w = _random_w();
+}
+
+
+/** Returns a uniformly distributed double in the open interval (0, 1). */
+double
+ReservoirSampler::_random(void) {
+  uint64_t bits;
+  do {
+    bits = _generator() >> 11;
+  } while (bits == 0);
+  return bits * (1.0 / 9007199254740992.0);
+}
+
+
+double
+ReservoirSampler::_random_w(void) {
+  return std::exp(std::log(_random()) / _count);
+}
+
+
+/** Moves next() on from item number \p last, which has just entered the reservoir. */
+void
+ReservoirSampler::_skip(const uint64_t last) {
+  const double skip = std::floor(std::log(_random()) / std::log(1 - _w)) + 1;
+  if (skip >= static_cast<double>(std::numeric_limits<uint64_t>::max() - last))
+    _next = std::numeric_limits<uint64_t>::max();
+  else
+    _next = last + static_cast<uint64_t>(skip);
+}
+
+
+size_t
+ReservoirSampler::advance(void) {
+  size_t slot;
+  if (_next < _count) {
+    slot = _next;
+    if (_next + 1 == _count)
+      _skip(_next);
+    else
+      ++_next;
+  }
+  else {
+    slot = _generator() % _count;
+    _w *= _random_w();
+    _skip(_next);
+  }
+  return slot;
+}
+
+}  // namespace utils
+}  // namespace schwa
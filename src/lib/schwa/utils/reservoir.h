@@ -0,0 +1,49 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#ifndef SCHWA_UTILS_RESERVOIR_H_
+#define SCHWA_UTILS_RESERVOIR_H_
+
+#include <random>
+
+#include <schwa/_base.h>
+
+namespace schwa {
+  namespace utils {
+
+    /**
+     * Reservoir sampler which decides which item numbers end up in the reservoir without needing
+     * to see the items, using Li's "Algorithm L". Rather than drawing a random number for every
+     * item, it draws how many items to skip before the next one which enters the reservoir. The
+     * items chosen depend only on the seed, so the same seed selects the same items whether a
+     * stream is read sequentially or the chosen items are seeked to directly.
+     **/
+    class ReservoirSampler {
+    private:
+      std::mt19937_64 _generator;
+      const uint64_t _count;
+      uint64_t _next;
+      double _w;
+
+      double _random(void);
+      double _random_w(void);
+      void _skip(uint64_t last);
+
+    public:
+      ReservoirSampler(uint64_t seed, uint64_t count);
+
+      /** The number of the next item which enters the reservoir. */
+      inline uint64_t next(void) const { return _next; }
+
+      /**
+       * Returns the reservoir slot which item number next() is placed into, and moves on to the
+       * following item to enter the reservoir.
+       **/
+      size_t advance(void);
+
+    private:
+      SCHWA_DISALLOW_COPY_AND_ASSIGN(ReservoirSampler);
+    };
+
+  }
+}
+
+#endif  // SCHWA_UTILS_RESERVOIR_H_
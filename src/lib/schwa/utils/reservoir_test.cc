@@ -0,0 +1,78 @@
+/* -*- Mode: C++; indent-tabs-mode: nil -*- */
+#include <schwa/unittest.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <schwa/utils/reservoir.h>
+
+
+namespace schwa {
+namespace utils {
+
+namespace {
+
+/**
+ * Samples \p count of \p n items with the seed \p seed, returning how many times each item was
+ * chosen over \p ntrials consecutive seeds.
+ **/
+std::vector<unsigned int>
+sample_counts(const uint64_t n, const uint64_t count, const unsigned int ntrials) {
+  std::vector<unsigned int> counts(n);
+  for (unsigned int seed = 0; seed != ntrials; ++seed) {
+    ReservoirSampler sampler(seed, count);
+    std::vector<uint64_t> reservoir;
+    while (sampler.next() < n) {
+      const uint64_t item = sampler.next();
+      const size_t slot = sampler.advance();
+      if (slot == reservoir.size())
+        reservoir.push_back(item);
+      else
+        reservoir[slot] = item;
+    }
+    for (const uint64_t item : reservoir)
+      ++counts[item];
+  }
+  return counts;
+}
+
+}  // namespace
+
+
+SUITE(schwa__utils__reservoir) {
+
+TEST(fills_reservoir) {
+  for (uint64_t n = 0; n != 10; ++n) {
+    const std::vector<unsigned int> counts = sample_counts(n, 3, 10);
+    unsigned int total = 0;
+    for (const unsigned int c : counts)
+      total += c;
+    CHECK_EQUAL(10*std::min<uint64_t>(n, 3), total);
+  }
+}
+
+TEST(uniform) {
+  // Every item must be chosen with probability count/n, including the one straight after the
+  // reservoir is first filled.
+  static constexpr unsigned int NTRIALS = 20000;
+  for (const auto &nk : {std::make_pair(2, 1), std::make_pair(5, 2), std::make_pair(10, 3)}) {
+    const std::vector<unsigned int> counts = sample_counts(nk.first, nk.second, NTRIALS);
+    const double expected = static_cast<double>(NTRIALS) * nk.second / nk.first;
+    for (const unsigned int c : counts) {
+      CHECK(c > 0.95*expected);
+      CHECK(c < 1.05*expected);
+    }
+  }
+}
+
+TEST(empty) {
+  ReservoirSampler sampler(0, 0);
+  CHECK_EQUAL(std::numeric_limits<uint64_t>::max(), sampler.next());
+}
+
+}  // SUITE
+
+}  // namespace utils
+}  // namespace schwa
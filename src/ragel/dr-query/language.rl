@@ -38,7 +38,7 @@
   op_numeric3 = "+" | "-" | "%" ;
   op_numeric4 = "*" | "/" ;
 
-  function = "all" | "any" | "int" | "len" | "str" ;
+  function = "all" | "any" | "count" | "distinct" | "hash" | "int" | "len" | "max" | "min" | "str" | "sum" ;
   var = [_a-zA-Z][_9a-zA-Z0-9]* ;
   var_attribute = "." [_a-zA-Z][_9a-zA-Z0-9]* ;
 